@@ -1,14 +1,18 @@
 #include "Alignment.h"
 #include "AlignmentReader.h"
+#include "utils.h"
 
-AlignmentReader::AlignmentReader(input_format_t mode_, string file)
-	: mode(mode_) {
+#include <cctype>
+#include <algorithm>
 
-	in.open(file.c_str());
+AlignmentReader::AlignmentReader(input_format_t mode_, string file_, string genomefile_)
+	: mode(mode_), genomefile(genomefile_), flag(0), failed(false) {
 
-	if(!in.is_open()) {
+	in = &open_input(file_, file);
 
-		cerr << "AlignmentReader: Failed to open the file " << file << "." << endl;
+	if(!*in) {
+
+		cerr << "AlignmentReader: Failed to open the file " << file_ << "." << endl;
 		abort();
 	}
 }
@@ -18,9 +22,9 @@ bool AlignmentReader::next(Alignment &a) {
 
 	string row;
 
-	getline(in, row);
+	getline(*in, row);
 
-	if(in.eof())
+	if(in->eof())
 		return false;
 
 	else {
@@ -56,8 +60,251 @@ bool AlignmentReader::next(Alignment &a) {
 			a = Alignment(name, strand, length, chromosome, start, edits);
 
 		}
+
+		else if(mode == input_sam) {
+
+			// Header lines and secondary alignments are skipped
+			while(row.empty() || row.at(0) == '@' || !parseSam(split(row.c_str(), '\t'), a)) {
+
+				getline(*in, row);
+
+				if(in->eof())
+					return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+bool AlignmentReader::nextPair(Alignment &first, Alignment &second) {
+
+	if(failed || !next(first))
+		return false;
+
+	int first_flag = flag;
+
+	if(!(first_flag & 0x1)) {
+		cerr << "AlignmentReader: SAM record " << first.getName() << " is not paired, paired methods need both mates of every read." << endl;
+		failed = true;
+		return false;
+	}
+
+	string first_sequence = sequence;
+
+	if(!next(second)) {
+		cerr << "AlignmentReader: Mate of SAM record " << first.getName() << " is missing." << endl;
+		failed = true;
+		return false;
+	}
+
+	// One of the records has to be flagged as the first segment and the other as the last
+	int segments = (first_flag & 0xC0) | ((flag & 0xC0) << 2);
+
+	if(second.getName() != first.getName() || !(flag & 0x1) || (segments != 0x240 && segments != 0x180)) {
+
+		cerr << "AlignmentReader: SAM records " << first.getName() << " and " << second.getName() << " are not mates, "
+			"paired methods need input sorted by name (samtools sort -n or samtools collate)." << endl;
+		failed = true;
+		return false;
+	}
+
+	mate_sequence = sequence;
+	sequence = first_sequence;
+
+	// The record flagged as the last segment is the second mate
+	if(first_flag & 0x80) {
+		swap(first, second);
+		swap(sequence, mate_sequence);
 	}
 
 	return true;
 }
 
+
+bool AlignmentReader::parseSam(const vector<string>& fields, Alignment &a) {
+
+	if(fields.size() < 11) {
+		cerr << "AlignmentReader: Malformed SAM record " << fields.at(0) << "." << endl;
+		abort();
+	}
+
+	flag = atoi(fields.at(1).c_str());
+
+	// Only primary alignments describe the read
+	if(flag & (0x100 | 0x800))
+		return false;
+
+	string name = fields.at(0);
+	string seq = fields.at(9);
+
+	if(seq == "*") {
+		cerr << "AlignmentReader: SAM record " << name << " has no sequence, it cannot be compressed." << endl;
+		abort();
+	}
+
+	for(unsigned i = 0; i < seq.length(); i++)
+		seq[i] = toupper(seq[i]);
+
+	// SEQ is stored on the forward strand of the reference, the original read is its reverse complement
+	sequence = seq;
+
+	if(flag & 0x10) {
+		complement(sequence);
+		revstr(sequence);
+	}
+
+	string chromosome = fields.at(2);
+	string cigar = fields.at(5);
+
+	if((flag & 0x4) || chromosome == "*" || cigar == "*") {
+
+		a = unalignedAlignment(name, sequence);
+		return true;
+	}
+
+	long start = atol(fields.at(3).c_str());
+
+	// Reference offsets of the mismatches from the MD tag, if there is one
+	vector<long> mismatches;
+	bool has_md = false;
+
+	for(unsigned i = 11; i < fields.size(); i++) {
+
+		if(fields.at(i).compare(0, 5, "MD:Z:") != 0)
+			continue;
+
+		has_md = true;
+
+		const string& md = fields.at(i);
+		long ref_offset = 0;
+		unsigned j = 5;
+
+		while(j < md.length()) {
+
+			if(isdigit(md.at(j))) {
+				long matches = 0;
+				while(j < md.length() && isdigit(md.at(j)))
+					matches = matches * 10 + (md.at(j++) - '0');
+				ref_offset += matches;
+			}
+			else if(md.at(j) == '^') {
+				j++;
+				while(j < md.length() && isalpha(md.at(j))) {
+					ref_offset++;
+					j++;
+				}
+			}
+			else {
+				mismatches.push_back(ref_offset++);
+				j++;
+			}
+		}
+	}
+
+	const string* reference = NULL;
+
+	if(!has_md) {
+
+		if(genomefile == "") {
+			cerr << "AlignmentReader: SAM record " << name << " has no MD tag and no reference was given." << endl;
+			abort();
+		}
+
+		const map<string, string>& chromosomes = load_reference(genomefile).getChromosomes();
+		map<string, string>::const_iterator it = chromosomes.find(chromosome);
+
+		if(it == chromosomes.end()) {
+			cerr << "AlignmentReader: Chromosome " << chromosome << " of SAM record " << name << " is not in the reference." << endl;
+			abort();
+		}
+
+		reference = &(it->second);
+	}
+
+	// Walk the CIGAR, edit positions are offsets in the reference window of the alignment
+	vector<pair<int, char> > edits;
+	long ref_offset = 0;
+	unsigned read_index = 0;
+	unsigned next_mismatch = 0;
+	unsigned i = 0;
+
+	while(i < cigar.length()) {
+
+		long count = 0;
+		while(i < cigar.length() && isdigit(cigar.at(i)))
+			count = count * 10 + (cigar.at(i++) - '0');
+
+		if(i == cigar.length()) {
+			cerr << "AlignmentReader: Malformed CIGAR in SAM record " << name << "." << endl;
+			abort();
+		}
+
+		char op = cigar.at(i++);
+
+		switch(op) {
+
+			case 'M':
+			case '=':
+			case 'X':
+				for(long k = 0; k < count; k++, ref_offset++, read_index++) {
+
+					bool mismatch;
+
+					if(op == 'X')
+						mismatch = true;
+					else if(op == '=')
+						mismatch = false;
+					else if(has_md) {
+						while(next_mismatch < mismatches.size() && mismatches.at(next_mismatch) < ref_offset)
+							next_mismatch++;
+						mismatch = next_mismatch < mismatches.size() && mismatches.at(next_mismatch) == ref_offset;
+					}
+					else {
+						long ref_pos = start - 1 + ref_offset;
+						mismatch = ref_pos >= (long)reference->length() || toupper(reference->at(ref_pos)) != seq.at(read_index);
+					}
+
+					if(mismatch)
+						edits.push_back(make_pair((int)ref_offset, seq.at(read_index)));
+				}
+				break;
+
+			case 'I':
+			case 'S':
+				for(long k = 0; k < count; k++, read_index++)
+					edits.push_back(make_pair((int)ref_offset, (char)tolower(seq.at(read_index))));
+				break;
+
+			case 'D':
+			case 'N':
+				for(long k = 0; k < count; k++, ref_offset++)
+					edits.push_back(make_pair((int)ref_offset, 'D'));
+				break;
+
+			case 'H':
+			case 'P':
+				break;
+
+			default:
+				cerr << "AlignmentReader: Unknown CIGAR operation " << op << " in SAM record " << name << "." << endl;
+				abort();
+		}
+	}
+
+	if(read_index != seq.length()) {
+		cerr << "AlignmentReader: CIGAR and sequence lengths differ in SAM record " << name << "." << endl;
+		abort();
+	}
+
+	// Fully clipped records don't cover any reference
+	if(ref_offset == 0) {
+		a = unalignedAlignment(name, sequence);
+		return true;
+	}
+
+	a = Alignment(name, (flag & 0x10) ? 'R' : 'F', ref_offset, chromosome, start, edits);
+
+	return true;
+}
@@ -4,6 +4,7 @@
 #include <sstream>
 #include <iostream>
 #include <fstream>
+#include <map>
 #include "Alignment.h"
 
 using namespace std;
@@ -11,18 +12,51 @@ using namespace std;
 class AlignmentReader {
 
 public:
-	enum input_format_t {input_tabdelimited };
+	enum input_format_t {input_tabdelimited, input_sam };
 
-	AlignmentReader(input_format_t mode_, std::string file);
+	/* For SAM input genomefile is used for finding mismatches of the records which lack the MD tag. File "-" is the standard input. */
+	AlignmentReader(input_format_t mode_, std::string file_, std::string genomefile_ = "");
 
 	/* Reads the next alignment. */
 	bool next(Alignment &alignment);
 
+	/* Reads the next pair from SAM input. The mates have to be adjacent records with the same name, as in name sorted
+	 * (samtools sort -n) or collated (samtools collate) files. Returns false at the end of the file or if the records
+	 * don't pair up, in which case good() is false too. */
+	bool nextPair(Alignment &first, Alignment &second);
+
+	/* False if nextPair found records which aren't mates. */
+	inline bool good() const {
+		return !failed;
+	}
+
+	/* Original sequence of the read returned last, or of the first mate of the pair (SAM input only). */
+	inline const std::string& getSequence() const {
+		return sequence;
+	}
+
+	/* Original sequence of the second mate of the pair returned last (SAM input only). */
+	inline const std::string& getMateSequence() const {
+		return mate_sequence;
+	}
+
 private:
 
-	ifstream in;
+	ifstream file;
+	istream* in;
 	input_format_t mode;
 
+	std::string genomefile;
+	std::string sequence;
+	std::string mate_sequence;
+
+	// SAM flag of the record returned last
+	int flag;
+	bool failed;
+
+	/* Converts one SAM record to an alignment, returns false if the record should be skipped. */
+	bool parseSam(const vector<string>& fields, Alignment &a);
+
 	static vector<string> split(const char *str, char c = ' ')
 	{
 	    vector<string> result;
@@ -0,0 +1,549 @@
+#include "Archive.h"
+
+#include <cstring>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include "bitfile.h"
+#include "Checksum.h"
+#include "utils.h"
+#include <unistd.h>
+
+static const char ARCHIVE_MAGIC[4] = {'R', 'Z', 'A', 'R'};
+static const char TABLE_MAGIC[4] = {'R', 'Z', 'B', 'T'};
+static const uint32_t ARCHIVE_VERSION = 8;
+
+// Magic and version, then the method, codecs, chromosomes, checksum, reads and table offset of the header
+static const uint64_t READS_OFFSET = 4 + sizeof(uint32_t) + 1 + 3 * sizeof(uint32_t);
+static const uint64_t HEADER_SIZE = READS_OFFSET + 2 * sizeof(uint64_t);
+static const uint64_t BLOCK_HEADER_SIZE = 9 * sizeof(uint32_t);
+
+// Block count, table offset, table checksum and magic
+static const uint64_t TRAILER_SIZE = 2 * sizeof(uint64_t) + sizeof(uint32_t) + 4;
+
+ArchiveHeader archiveHeader(char method, const Reference& reference)
+{
+	ArchiveHeader header;
+	header.method = method;
+	header.chromosomes = reference.getNames().size();
+
+	// FNV-1a over the names, each ended by a newline
+	header.chromosome_checksum = 2166136261u;
+
+	for(size_t i = 0; i < reference.getNames().size(); i++) {
+		const std::string& name = reference.getNames()[i];
+		for(size_t j = 0; j <= name.size(); j++)
+			header.chromosome_checksum = (header.chromosome_checksum ^ (unsigned char)(j < name.size() ? name[j] : '\n')) * 16777619u;
+	}
+
+	return header;
+}
+
+static void writeHeader(std::ostream& out, const ArchiveHeader& header)
+{
+	out.write(ARCHIVE_MAGIC, 4);
+	out.write((const char*)&ARCHIVE_VERSION, sizeof(ARCHIVE_VERSION));
+	out.write(&header.method, 1);
+	out.write((const char*)&header.codecs, sizeof(header.codecs));
+	out.write((const char*)&header.chromosomes, sizeof(header.chromosomes));
+	out.write((const char*)&header.chromosome_checksum, sizeof(header.chromosome_checksum));
+	out.write((const char*)&header.reads, sizeof(header.reads));
+	out.write((const char*)&header.table_offset, sizeof(header.table_offset));
+}
+
+// Returns false if the stream doesn't start with a header of this version
+static bool readHeader(std::istream& in, ArchiveHeader& header)
+{
+	char magic[4];
+	uint32_t version;
+
+	in.read(magic, 4);
+	in.read((char*)&version, sizeof(version));
+
+	if(!in || memcmp(magic, ARCHIVE_MAGIC, 4) != 0 || version != ARCHIVE_VERSION)
+		return false;
+
+	in.read(&header.method, 1);
+	in.read((char*)&header.codecs, sizeof(header.codecs));
+	in.read((char*)&header.chromosomes, sizeof(header.chromosomes));
+	in.read((char*)&header.chromosome_checksum, sizeof(header.chromosome_checksum));
+	in.read((char*)&header.reads, sizeof(header.reads));
+	in.read((char*)&header.table_offset, sizeof(header.table_offset));
+
+	// Sorted blocks are only coded by method a, other codecs are of a later version
+	return in && header.method >= 'a' && header.method <= 'd' &&
+		(header.codecs & ~CODEC_SORTED_BLOCKS) == 0 && (header.method == 'a' || header.codecs == 0);
+}
+
+static void writeBlockHeader(std::ostream& out, const BlockHeader& header)
+{
+	out.write((const char*)&header.size, sizeof(header.size));
+	out.write((const char*)&header.reads, sizeof(header.reads));
+	out.write((const char*)&header.chromosome, sizeof(header.chromosome));
+	out.write((const char*)&header.checksum, sizeof(header.checksum));
+	out.write((const char*)&header.read_length, sizeof(header.read_length));
+	out.write((const char*)&header.duplicates, sizeof(header.duplicates));
+	out.write((const char*)&header.insert_size, sizeof(header.insert_size));
+	out.write((const char*)&header.insert_rice, sizeof(header.insert_rice));
+	out.write((const char*)&header.orientations, sizeof(header.orientations));
+}
+
+static void readBlockHeader(std::istream& in, BlockHeader& header)
+{
+	in.read((char*)&header.size, sizeof(header.size));
+	in.read((char*)&header.reads, sizeof(header.reads));
+	in.read((char*)&header.chromosome, sizeof(header.chromosome));
+	in.read((char*)&header.checksum, sizeof(header.checksum));
+	in.read((char*)&header.read_length, sizeof(header.read_length));
+	in.read((char*)&header.duplicates, sizeof(header.duplicates));
+	in.read((char*)&header.insert_size, sizeof(header.insert_size));
+	in.read((char*)&header.insert_rice, sizeof(header.insert_rice));
+	in.read((char*)&header.orientations, sizeof(header.orientations));
+}
+
+bool ArchiveWriter::open(std::string file_, const ArchiveHeader& header_)
+{
+	out = &open_output(file_, file);
+
+	if(!*out)
+		return false;
+
+	header = header_;
+	header.reads = 0;
+	header.table_offset = 0;
+	writeHeader(*out, header);
+
+	appended.clear();
+
+	blocks.clear();
+	offset = HEADER_SIZE;
+	reads = 0;
+	checksum = 0;
+
+	return out->good();
+}
+
+bool ArchiveWriter::append(std::string file_, const ArchiveHeader& header_)
+{
+	ArchiveReader existing;
+
+	if(file_ == "-" || !existing.open(file_))
+		return false;
+
+	header = existing.getHeader();
+
+	// Sorted archives keep their blocks in reference order, new reads can't go after them
+	if(header.method != header_.method || (header.method != 'a' && header.method != 'c')) {
+		std::cerr << "Reads can only be added to an archive of the same method, a or c." << std::endl;
+		return false;
+	}
+
+	if(header.chromosome_checksum != header_.chromosome_checksum) {
+		std::cerr << "The archive was compressed against another reference." << std::endl;
+		return false;
+	}
+
+	blocks = existing.getBlocks();
+	offset = HEADER_SIZE;
+	reads = 0;
+	checksum = 0;
+
+	for(size_t i = 0; i < blocks.size(); i++) {
+
+		offset = blocks[i].offset + BLOCK_HEADER_SIZE + blocks[i].header.size;
+		reads = blocks[i].first_read + blocks[i].header.reads;
+		checksum = crc32c(checksum, &blocks[i].header.checksum, sizeof(blocks[i].header.checksum));
+	}
+
+	// The new blocks are written over the end block and the table, which are kept to put back if the append fails
+	std::ifstream old(file_.c_str(), std::ios::binary);
+	old.seekg(0, std::ios::end);
+	uint64_t size = old.tellg();
+	old.seekg(offset);
+
+	tail.assign(size - offset, 0);
+	old.read(&tail[0], tail.size());
+
+	if(!old) {
+		std::cerr << "Failure to read the end of the archive for appending." << std::endl;
+		return false;
+	}
+
+	appended = file_;
+	original = header;
+	tail_offset = offset;
+
+	file.open(file_.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+	file.seekp(offset);
+	out = &file;
+
+	return out->good();
+}
+
+// Puts back the end block and the table of the archive appended to, cutting off the blocks written after its old ones,
+// and the reads and the table offset of its header.
+void ArchiveWriter::restore()
+{
+	file.clear();
+	file.seekp(tail_offset);
+	file.write(tail.data(), tail.size());
+	file.seekp(READS_OFFSET);
+	file.write((const char*)&original.reads, sizeof(original.reads));
+	file.write((const char*)&original.table_offset, sizeof(original.table_offset));
+	file.close();
+
+	if(file.fail() || truncate(appended.c_str(), tail_offset + tail.size()) != 0)
+		std::cerr << "Failure to restore the archive " << appended << ", it may be damaged." << std::endl;
+}
+
+bool ArchiveWriter::writeBlock(const CodedBlock& block)
+{
+	BlockInfo info;
+	info.offset = offset;
+	info.first_read = reads;
+	info.header = block.header;
+	info.header.checksum = crc32c(0, block.data.data(), block.data.size());
+	info.checkpoints = block.checkpoints;
+	info.first_position = block.first_position;
+	info.last_position = block.last_position;
+	blocks.push_back(info);
+
+	checksum = crc32c(checksum, &info.header.checksum, sizeof(info.header.checksum));
+
+	writeBlockHeader(*out, info.header);
+	out->write(block.data.data(), block.data.size());
+
+	offset += BLOCK_HEADER_SIZE + block.data.size();
+	reads += block.header.reads;
+
+	return out->good();
+}
+
+bool ArchiveWriter::close(bool keep)
+{
+	if(!keep && !appended.empty()) {
+		restore();
+		return false;
+	}
+
+	BlockHeader end;
+	end.size = 0;
+	end.reads = 0;
+	end.chromosome = -1;
+	end.checksum = checksum;
+	end.read_length = 0;
+	end.duplicates = 0;
+	end.insert_size = 0;
+	end.insert_rice = 0;
+	end.orientations = 0;
+
+	writeBlockHeader(*out, end);
+
+	uint64_t table_offset = offset + BLOCK_HEADER_SIZE;
+	uint64_t count = blocks.size();
+
+	// The table is put together first for its checksum
+	std::ostringstream table;
+
+	for(size_t i = 0; i < blocks.size(); i++) {
+		table.write((const char*)&blocks[i].offset, sizeof(blocks[i].offset));
+		table.write((const char*)&blocks[i].first_read, sizeof(blocks[i].first_read));
+		writeBlockHeader(table, blocks[i].header);
+		table.write((const char*)&blocks[i].first_position, sizeof(blocks[i].first_position));
+		table.write((const char*)&blocks[i].last_position, sizeof(blocks[i].last_position));
+
+		uint32_t checkpoints = blocks[i].checkpoints.size();
+		table.write((const char*)&checkpoints, sizeof(checkpoints));
+		table.write((const char*)blocks[i].checkpoints.data(), checkpoints * sizeof(uint32_t));
+	}
+
+	std::string entries = table.str();
+	uint32_t table_checksum = crc32c(0, entries.data(), entries.size());
+
+	out->write(entries.data(), entries.size());
+	out->write((const char*)&count, sizeof(count));
+	out->write((const char*)&table_offset, sizeof(table_offset));
+	out->write((const char*)&table_checksum, sizeof(table_checksum));
+	out->write(TABLE_MAGIC, 4);
+	out->flush();
+
+	// A stream can't be rewound, its readers find the end from the end block. The header is written last, an
+	// archive appended to keeps its old one until the table is in.
+	if(out == &file && out->good()) {
+		header.reads = reads;
+		header.table_offset = table_offset;
+		out->seekp(READS_OFFSET);
+		out->write((const char*)&header.reads, sizeof(header.reads));
+		out->write((const char*)&header.table_offset, sizeof(header.table_offset));
+		out->flush();
+	}
+
+	if(out->fail() && !appended.empty()) {
+		restore();
+		return false;
+	}
+
+	bool ok = !out->fail();
+
+	if(file.is_open())
+		file.close();
+
+	return ok && !file.fail();
+}
+
+bool ArchiveReader::open(std::string file_)
+{
+	failed = false;
+	streaming = (file_ == "-");
+	reads = 0;
+	checksum = 0;
+	blocks.clear();
+
+	in = &open_input(file_, file);
+
+	if(!readHeader(*in, header) || (!streaming && !readTable())) {
+		failed = true;
+		return false;
+	}
+
+	position = HEADER_SIZE;
+
+	if(!streaming)
+		in->seekg(HEADER_SIZE);
+
+	return in->good();
+}
+
+bool ArchiveReader::readTable()
+{
+	in->seekg(0, std::ios::end);
+	uint64_t file_size = in->tellg();
+
+	if(file_size < HEADER_SIZE + TRAILER_SIZE)
+		return false;
+
+	uint64_t count, table_offset;
+	uint32_t table_checksum;
+	char magic[4];
+
+	in->seekg(file_size - TRAILER_SIZE);
+	in->read((char*)&count, sizeof(count));
+	in->read((char*)&table_offset, sizeof(table_offset));
+	in->read((char*)&table_checksum, sizeof(table_checksum));
+	in->read(magic, 4);
+
+	const uint64_t entry_size = 4 * sizeof(uint64_t) + BLOCK_HEADER_SIZE + sizeof(uint32_t);
+
+	if(!*in || memcmp(magic, TABLE_MAGIC, 4) != 0 || table_offset > file_size - TRAILER_SIZE || count > (file_size - table_offset) / entry_size)
+		return false;
+
+	std::string entries(file_size - TRAILER_SIZE - table_offset, '\0');
+	in->seekg(table_offset);
+	in->read(&entries[0], entries.size());
+
+	if(!*in || crc32c(0, entries.data(), entries.size()) != table_checksum) {
+		std::cerr << "The table of blocks of the archive is corrupted." << std::endl;
+		return false;
+	}
+
+	std::istringstream table(entries);
+	blocks.resize(count);
+
+	for(uint64_t i = 0; i < count && table; i++) {
+		table.read((char*)&blocks[i].offset, sizeof(blocks[i].offset));
+		table.read((char*)&blocks[i].first_read, sizeof(blocks[i].first_read));
+		readBlockHeader(table, blocks[i].header);
+		table.read((char*)&blocks[i].first_position, sizeof(blocks[i].first_position));
+		table.read((char*)&blocks[i].last_position, sizeof(blocks[i].last_position));
+
+		uint32_t checkpoints = 0;
+		table.read((char*)&checkpoints, sizeof(checkpoints));
+
+		if(checkpoints > blocks[i].header.reads / READ_INDEX_INTERVAL + 1)
+			return false;
+
+		blocks[i].checkpoints.resize(checkpoints);
+		table.read((char*)blocks[i].checkpoints.data(), checkpoints * sizeof(uint32_t));
+	}
+
+	if(!table)
+		return false;
+
+	// The header and the table agree on where the table is and how many reads the blocks hold
+	uint64_t total = blocks.empty() ? 0 : blocks.back().first_read + blocks.back().header.reads;
+
+	if(header.table_offset != 0 && (header.table_offset != table_offset || header.reads != total))
+		return false;
+
+	// Archives written to a stream have them in the table only
+	header.table_offset = table_offset;
+	header.reads = total;
+
+	return in->good();
+}
+
+bool checkArchive(const ArchiveReader& in, const Reference& reference, const std::string& methods)
+{
+	const ArchiveHeader& header = in.getHeader();
+
+	if(methods != "" && methods.find(header.method) == std::string::npos) {
+		std::cerr << "The archive was compressed with method " << header.method << "." << std::endl;
+		return false;
+	}
+
+	if(header.chromosome_checksum != archiveHeader(header.method, reference).chromosome_checksum) {
+		std::cerr << "The archive was compressed against another reference." << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool ArchiveReader::nextBlock(BlockInfo& info, std::string& data)
+{
+	info.offset = position;
+	info.first_read = reads;
+	readBlockHeader(*in, info.header);
+
+	if(!*in) {
+		failed = true;
+		return false;
+	}
+
+	// End of the blocks, its checksum is of the checksums of the blocks before it
+	if(info.header.reads == 0 && info.header.size == 0) {
+
+		if(info.header.checksum != checksum) {
+			std::cerr << "The blocks of the archive don't match its end, some are missing or out of order." << std::endl;
+			failed = true;
+		}
+
+		return false;
+	}
+
+	// A corrupted size isn't read past the end block before the table
+	if(!streaming && position + 2 * BLOCK_HEADER_SIZE + info.header.size > header.table_offset) {
+		std::cerr << "The block at offset " << info.offset << " of the archive is corrupted." << std::endl;
+		failed = true;
+		return false;
+	}
+
+	data.resize(info.header.size);
+
+	if(info.header.size > 0)
+		in->read(&data[0], info.header.size);
+
+	if(!*in || !checkBlock(info, data)) {
+		failed = true;
+		return false;
+	}
+
+	checksum = crc32c(checksum, &info.header.checksum, sizeof(info.header.checksum));
+	reads += info.header.reads;
+	position += BLOCK_HEADER_SIZE + info.header.size;
+
+	return true;
+}
+
+bool ArchiveReader::readBlock(const BlockInfo& info, std::string& data)
+{
+	if(streaming) {
+		failed = true;
+		return false;
+	}
+
+	in->clear();
+	in->seekg(info.offset + BLOCK_HEADER_SIZE);
+
+	data.resize(info.header.size);
+
+	if(info.header.size > 0)
+		in->read(&data[0], info.header.size);
+
+	if(!*in || !checkBlock(info, data)) {
+		failed = true;
+		return false;
+	}
+
+	return true;
+}
+
+bool ArchiveReader::checkBlock(const BlockInfo& info, const std::string& data)
+{
+	if(crc32c(0, data.data(), data.size()) == info.header.checksum)
+		return true;
+
+	std::cerr << "The block of reads " << info.first_read + 1 << "-" << info.first_read + info.header.reads
+		<< " at offset " << info.offset << " of the archive is corrupted." << std::endl;
+	return false;
+}
+
+void reportPipelineStats(const pipeline_stats_t& stats)
+{
+	double wall = stats.wall > 0 ? stats.wall : 1;
+
+	std::cerr << "Pipeline: reading " << (int)(100 * stats.reading / wall) << "% busy, coding "
+		<< (int)(100 * stats.coding / (wall * stats.coders)) << "% busy on " << stats.coders << (stats.coders == 1 ? " thread" : " threads") << ", writing "
+		<< (int)(100 * stats.writing / wall) << "% busy." << std::endl;
+}
+
+bool readReadRange(ArchiveReader& in, uint64_t from, uint64_t to, std::function<bool(const BlockInfo&, bit_file_c&, uint32_t, uint32_t)> decode)
+{
+	const std::vector<BlockInfo>& blocks = in.getBlocks();
+
+	// First block that ends after the first read asked for
+	size_t i = std::upper_bound(blocks.begin(), blocks.end(), from,
+		[](uint64_t read, const BlockInfo& block) { return read < block.first_read + block.header.reads; }) - blocks.begin();
+
+	for(; i < blocks.size() && blocks[i].first_read <= to; i++) {
+
+		const BlockInfo& block = blocks[i];
+
+		uint64_t first = std::max(from, block.first_read) - block.first_read;
+		uint64_t last = std::min(to, block.first_read + block.header.reads - 1) - block.first_read;
+
+		// Closest indexed read at or before the first one asked for
+		uint64_t checkpoint = first / READ_INDEX_INTERVAL;
+
+		if(checkpoint >= block.checkpoints.size())
+			checkpoint = block.checkpoints.empty() ? 0 : block.checkpoints.size() - 1;
+
+		uint32_t bit_offset = block.checkpoints.empty() ? 0 : block.checkpoints[checkpoint];
+
+		std::string data;
+
+		if(!in.readBlock(block, data) || bit_offset / 8 > data.size())
+			return false;
+
+		std::istringstream stream(data);
+		stream.seekg(bit_offset / 8);
+
+		bit_file_c block_in;
+		block_in.Open(stream);
+
+		for(uint32_t bit = 0; bit < bit_offset % 8; bit++)
+			block_in.GetBit();
+
+		uint64_t skip = first - checkpoint * READ_INDEX_INTERVAL;
+
+		if(!decode(block, block_in, skip, last - first + 1))
+			return false;
+	}
+
+	return true;
+}
+
+std::vector<BlockInfo> regionBlocks(const ArchiveReader& in, int32_t chromosome, uint64_t from, uint64_t to)
+{
+	std::vector<BlockInfo> result;
+
+	for(size_t i = 0; i < in.getBlocks().size(); i++) {
+
+		const BlockInfo& block = in.getBlocks()[i];
+
+		if(block.header.chromosome == chromosome && block.first_position <= to && block.last_position >= from)
+			result.push_back(block);
+	}
+
+	return result;
+}
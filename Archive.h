@@ -0,0 +1,323 @@
+/*
+ * Container format shared by all methods. A header at the start tells the method that wrote the archive and against
+ * which reference, so that the archive can be decompressed without naming its method. The reads are coded in blocks
+ * that are independent of each other:
+ * every block starts byte aligned with a header giving its size and number of reads, and the coding state
+ * (e.g. the previous start position of methods B and D) starts over in every block. An empty block ends the blocks,
+ * and a table of the blocks at the end of the file gives the restart points without reading the blocks before them.
+ * Every block, the table and the blocks as a whole have CRC32C checksums that are checked whenever they are read.
+ *
+ */
+
+#ifndef _Archive_H_
+#define _Archive_H_
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <chrono>
+#include <stdint.h>
+#include "ThreadPool.h"
+#include "RingBuffer.h"
+
+// What the archive holds, written at the start of it
+struct ArchiveHeader {
+	char method;                    // Method that coded the reads, 'a', 'b', 'c' or 'd'
+	uint32_t codecs;                // Options of coding the records, CODEC_* flags
+	uint32_t chromosomes;           // Chromosome codes of the reference, "*" included
+	uint32_t chromosome_checksum;   // Checksum of the chromosome names of the reference in code order
+	uint64_t reads;                 // Reads (pairs) in the archive, 0 if written to a stream and read from one
+	uint64_t table_offset;          // Offset of the table of blocks, 0 if written to a stream and read from one
+
+	ArchiveHeader() : method(0), codecs(0), chromosomes(0), chromosome_checksum(0), reads(0), table_offset(0) {}
+};
+
+// Method a: the reads of every block are coded sorted by position, each with its place in the block
+const uint32_t CODEC_SORTED_BLOCKS = 1;
+
+class Reference;
+
+/* Header of an archive of the method (a, b, c or d) coded against the reference. */
+ArchiveHeader archiveHeader(char method, const Reference& reference);
+
+// Reads (pairs for the paired methods) per block
+const uint32_t BLOCK_READS = 65536;
+
+struct BlockHeader {
+	uint32_t size;        // Bytes of coded reads following the header
+	uint32_t reads;       // Reads in the block
+	int32_t chromosome;   // Chromosome code of all reads in the block for methods B and D, -1 for the other methods
+	uint32_t checksum;    // CRC32C of the coded reads, of the checksums of all the blocks in the end block
+	uint32_t read_length; // Modal length of the reads in the block (see writeLength), 0 if their lengths are coded as they are
+	uint32_t duplicates;  // Reads coded as repeats of earlier reads: runs repeating the read before them (methods B and
+	                      // D) or back-references (method A), 0 if the block has none
+	uint32_t insert_size; // Typical distance between the starts of the mates of a pair (methods C and D, see
+	uint32_t insert_rice; // writeMateDistance) and the Rice parameter of the differences to it, 0 for the other methods
+	uint32_t orientations; // Orientations of the pairs from the most common (methods C and D, see writeMateOrientation)
+};
+
+// Restart point of the decoders: where the block starts and the number of reads before it
+struct BlockInfo {
+	uint64_t offset;
+	uint64_t first_read;
+	BlockHeader header;
+	std::vector<uint32_t> checkpoints;
+	uint64_t first_position;
+	uint64_t last_position;
+};
+
+// Reads between the indexed reads of order-preserving archives
+const uint32_t READ_INDEX_INTERVAL = 1024;
+
+struct CodedBlock {
+	BlockHeader header;
+	std::string data;
+	std::vector<uint32_t> checkpoints;  // Bit offsets of every READ_INDEX_INTERVAL'th read of the block (methods A and C, none in sorted blocks)
+	uint64_t first_position;            // Reference range covered by the reads of the block (methods B and D)
+	uint64_t last_position;
+
+	CodedBlock() : header(), first_position(0), last_position(0) {}
+};
+
+class ArchiveWriter {
+
+public:
+
+	/* Opens the archive for writing, file "-" writes it to the standard output. The reads and the offset of the table
+	 * are filled in the header when the archive is closed, unless it's written to a stream. */
+	bool open(std::string file, const ArchiveHeader& header);
+
+	/* Opens an existing archive of an order-preserving method for adding blocks after its last one. The blocks and
+	 * the table are written over the end block and the table of the archive, which are kept in memory and put back
+	 * if the new reads fail. The archive needs to have the method and reference of the header. */
+	bool append(std::string file, const ArchiveHeader& header);
+
+	bool writeBlock(const CodedBlock& block);
+
+	/* Ends the blocks and writes the table of blocks. Without keep, or if writing fails, an archive appended to is
+	 * put back as it was and the new blocks are thrown away. */
+	bool close(bool keep = true);
+
+	/* Header of the archive, that of the existing archive when appending to one. */
+	inline const ArchiveHeader& getHeader() const {
+		return header;
+	}
+
+private:
+
+	std::ofstream file;
+	std::ostream* out;
+	ArchiveHeader header;
+	std::vector<BlockInfo> blocks;
+	uint64_t offset;
+	uint64_t reads;
+	uint32_t checksum;    // Of the checksums of the blocks so far
+	std::string appended; // Archive appended to, empty otherwise
+	ArchiveHeader original;
+	uint64_t tail_offset; // Where its end block and table (tail) were
+	std::string tail;
+
+	void restore();
+
+};
+
+class ArchiveReader {
+
+public:
+
+	/* Opens the archive, returns false if it's missing or not a readzip archive of this version. File "-" reads
+	 * the archive from the standard input: the blocks can then only be read in order, and the table is not read. */
+	bool open(std::string file);
+
+	/* Reads the next block, returns false at the end of the archive or if the block is truncated or corrupted (good()
+	 * tells which). Reaching the end block checks that all the blocks were there. */
+	bool nextBlock(BlockInfo& info, std::string& data);
+
+	/* Reads the block at the restart point, returns false if it's truncated or corrupted. */
+	bool readBlock(const BlockInfo& info, std::string& data);
+
+	inline bool good() const {
+		return !failed;
+	}
+
+	/* Whether the table was read, i.e. the archive can be read out of order. */
+	inline bool seekable() const {
+		return !streaming;
+	}
+
+	inline const ArchiveHeader& getHeader() const {
+		return header;
+	}
+
+	/* Restart points of all blocks from the table at the end of the archive. */
+	inline const std::vector<BlockInfo>& getBlocks() const {
+		return blocks;
+	}
+
+private:
+
+	std::ifstream file;
+	std::istream* in;
+	ArchiveHeader header;
+	bool failed;
+	bool streaming;
+	std::vector<BlockInfo> blocks;
+	uint64_t reads;
+	uint64_t position;
+	uint32_t checksum;    // Of the checksums of the blocks read by nextBlock
+
+	bool readTable();
+	bool checkBlock(const BlockInfo& info, const std::string& data);
+
+};
+
+/* Checks that the archive was coded against the reference (and by one of the methods if given), reports if not. */
+bool checkArchive(const ArchiveReader& in, const Reference& reference, const std::string& methods = "");
+
+// Busy time of the stages of the compression pipeline in seconds, coding summed over the threads of the pool
+struct pipeline_stats_t {
+	double wall;
+	double reading;
+	double coding;
+	double writing;
+	unsigned coders;
+};
+
+/* Reports how busy each stage of the pipeline was, the busiest one limits the speed of the compression. */
+void reportPipelineStats(const pipeline_stats_t& stats);
+
+/* Compresses in a pipeline of three stages: next(block) fills the reads of the next block on the calling thread and
+ * returns false when there are none left, encode(block, coded) codes every block as a task of its own on the pool,
+ * and a writer thread writes them to the archive in input order. The reader passes the writer the results to wait
+ * for through a bounded single-producer/single-consumer queue, which also bounds the blocks kept in memory. */
+template<class Block> bool writeBlocks(ArchiveWriter& out, ThreadPool& pool, std::function<bool(Block&)> next,
+	std::function<bool(const Block&, CodedBlock&)> encode)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	struct Coded {
+		bool ok;
+		CodedBlock block;
+		double busy;
+	};
+
+	Clock::time_point begin = Clock::now();
+	pipeline_stats_t stats = pipeline_stats_t();
+	stats.coders = pool.size();
+
+	// An empty future ends the blocks
+	RingBuffer<std::future<Coded> > pending(2 * pool.size());
+
+	// Failed blocks aren't written, but the rest are still waited for so that the reader isn't left waiting
+	bool ok = true;
+
+	std::thread writer([&]() {
+		while(true) {
+			std::future<Coded> result;
+			pending.popWait(result);
+
+			if(!result.valid())
+				return;
+
+			Coded coded = result.get();
+			stats.coding += coded.busy;
+
+			Clock::time_point start = Clock::now();
+			ok = ok && coded.ok && out.writeBlock(coded.block);
+			stats.writing += std::chrono::duration<double>(Clock::now() - start).count();
+		}
+	});
+
+	while(true) {
+		std::shared_ptr<Block> block(new Block());
+
+		Clock::time_point start = Clock::now();
+		bool more = next(*block);
+		stats.reading += std::chrono::duration<double>(Clock::now() - start).count();
+
+		if(!more)
+			break;
+
+		pending.pushWait(pool.submit<Coded>([block, encode]() {
+			Clock::time_point start = Clock::now();
+			Coded coded;
+			coded.ok = encode(*block, coded.block);
+			coded.busy = std::chrono::duration<double>(Clock::now() - start).count();
+			return coded;
+		}));
+	}
+
+	pending.pushWait(std::future<Coded>());
+	writer.join();
+
+	stats.wall = std::chrono::duration<double>(Clock::now() - begin).count();
+	reportPipelineStats(stats);
+
+	return ok;
+}
+
+class bit_file_c;
+
+/* Decodes reads from..to (0-based, inclusive) of an order-preserving archive without the blocks before them.
+ * For every block holding some of them, decode(info, in, skip, count) is called with in positioned at the closest
+ * indexed read (the start of a block without indexed reads): it decodes and drops skip reads, then decodes the count
+ * reads asked for. */
+bool readReadRange(ArchiveReader& in, uint64_t from, uint64_t to, std::function<bool(const BlockInfo&, bit_file_c&, uint32_t, uint32_t)> decode);
+
+/* Blocks of a sorted archive with reads of the chromosome overlapping positions from..to (1-based, inclusive). */
+std::vector<BlockInfo> regionBlocks(const ArchiveReader& in, int32_t chromosome, uint64_t from, uint64_t to);
+
+/* Decodes the blocks of the archive on the pool, a writer thread passes the decoded blocks to write in archive order.
+ * decode(info, data, output) decodes the block into an output buffer of its own. */
+template<class Output> bool readBlocks(ArchiveReader& in, ThreadPool& pool, std::function<bool(const BlockInfo&, const std::string&, Output&)> decode,
+	std::function<bool(const Output&)> write)
+{
+	typedef std::pair<bool, Output> Decoded;
+
+	// Only a few decoded blocks wait for the writer at a time, an empty future ends the blocks
+	RingBuffer<std::future<Decoded> > pending(2 * pool.size());
+	std::atomic<bool> failed(false);
+
+	std::thread writer([&]() {
+		while(true) {
+			std::future<Decoded> next;
+			pending.popWait(next);
+
+			if(!next.valid())
+				return;
+
+			// The rest of the blocks are still waited for after a failure, but not written
+			Decoded decoded = next.get();
+
+			if(!failed && !(decoded.first && write(decoded.second)))
+				failed = true;
+		}
+	});
+
+	BlockInfo info;
+
+	while(!failed) {
+
+		std::shared_ptr<std::string> data(new std::string());
+
+		if(!in.nextBlock(info, *data))
+			break;
+
+		pending.pushWait(pool.submit<Decoded>([info, data, decode]() {
+			Decoded result;
+			result.first = decode(info, *data, result.second);
+			return result;
+		}));
+	}
+
+	pending.pushWait(std::future<Decoded>());
+	writer.join();
+
+	return !failed && in.good();
+}
+
+#endif // _Archive_H_
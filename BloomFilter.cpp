@@ -0,0 +1,143 @@
+#include "BloomFilter.h"
+
+#include <cstring>
+
+// Bits per k-mer and hash functions per k-mer give about 1% false positives
+static const unsigned BITS_PER_ELEMENT = 10;
+static const unsigned HASHES = 4;
+
+static const char BLOOM_MAGIC[4] = {'R', 'Z', 'B', 'F'};
+static const uint32_t BLOOM_VERSION = 1;
+
+static inline uint64_t mix(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+BloomFilter::BloomFilter()
+	: k(0), hashes(0), mask(0), words(NULL) {}
+
+BloomFilter::BloomFilter(unsigned k_, uint64_t elements)
+	: k(k_), hashes(HASHES), words(NULL) {
+
+	// Power of two number of bits so that the hashes can be masked
+	uint64_t size = 64;
+	while(size < elements * BITS_PER_ELEMENT)
+		size <<= 1;
+
+	mask = size - 1;
+	bits.assign(size / 64, 0);
+}
+
+template<class F> void BloomFilter::forKmers(const std::string& sequence, F f) const
+{
+	uint64_t kmer_mask = (k == 32) ? ~0ULL : ((1ULL << (2 * k)) - 1);
+	uint64_t forward = 0, reverse = 0;
+	unsigned valid = 0;
+
+	for(unsigned i = 0; i < sequence.length(); i++) {
+
+		uint64_t code;
+
+		switch(sequence[i]) {
+			case 'A': case 'a': code = 0; break;
+			case 'C': case 'c': code = 1; break;
+			case 'G': case 'g': code = 2; break;
+			case 'T': case 't': code = 3; break;
+			default:
+				valid = 0;
+				continue;
+		}
+
+		forward = ((forward << 2) | code) & kmer_mask;
+		reverse = (reverse >> 2) | ((3 - code) << (2 * (k - 1)));
+
+		if(++valid >= k)
+			f(forward < reverse ? forward : reverse);
+	}
+}
+
+void BloomFilter::add(uint64_t kmer)
+{
+	uint64_t h1 = mix(kmer);
+	uint64_t h2 = mix(h1) | 1;
+
+	for(unsigned i = 0; i < hashes; i++) {
+		uint64_t bit = (h1 + i * h2) & mask;
+		bits[bit >> 6] |= 1ULL << (bit & 63);
+	}
+}
+
+bool BloomFilter::contains(uint64_t kmer) const
+{
+	const uint64_t* filter = bits.empty() ? words : &bits[0];
+	uint64_t h1 = mix(kmer);
+	uint64_t h2 = mix(h1) | 1;
+
+	for(unsigned i = 0; i < hashes; i++) {
+		uint64_t bit = (h1 + i * h2) & mask;
+		if(!(filter[bit >> 6] & (1ULL << (bit & 63))))
+			return false;
+	}
+
+	return true;
+}
+
+void BloomFilter::addSequence(const std::string& sequence)
+{
+	forKmers(sequence, [this](uint64_t kmer) { add(kmer); });
+}
+
+std::pair<unsigned, unsigned> BloomFilter::countHits(const std::string& sequence) const
+{
+	unsigned kmers = 0, hits = 0;
+
+	forKmers(sequence, [this, &kmers, &hits](uint64_t kmer) {
+		kmers++;
+		if(contains(kmer))
+			hits++;
+	});
+
+	return std::make_pair(kmers, hits);
+}
+
+bool BloomFilter::write(std::ostream& out) const
+{
+	uint32_t header[3] = {BLOOM_VERSION, k, hashes};
+	uint64_t size = mask + 1;
+
+	out.write(BLOOM_MAGIC, 4);
+	out.write((const char*)header, sizeof(header));
+	out.write((const char*)&size, sizeof(size));
+	out.write((const char*)(bits.empty() ? words : &bits[0]), size / 8);
+
+	return out.good();
+}
+
+bool BloomFilter::attach(const char* data, uint64_t size)
+{
+	const uint64_t header_size = 4 + 3 * sizeof(uint32_t) + sizeof(uint64_t);
+
+	if(size < header_size || memcmp(data, BLOOM_MAGIC, 4) != 0)
+		return false;
+
+	uint32_t header[3];
+	uint64_t bit_count;
+
+	memcpy(header, data + 4, sizeof(header));
+	memcpy(&bit_count, data + 4 + sizeof(header), sizeof(bit_count));
+
+	if(header[0] != BLOOM_VERSION || bit_count < 64 || (bit_count & (bit_count - 1)) != 0 || size < header_size + bit_count / 8)
+		return false;
+
+	k = header[1];
+	hashes = header[2];
+	mask = bit_count - 1;
+	bits.clear();
+	words = (const uint64_t*)(data + header_size);
+
+	return true;
+}
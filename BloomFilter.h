@@ -0,0 +1,57 @@
+/*
+ * Bloom filter of the k-mers of a reference, used for finding reads that can't align before calling the aligner.
+ *
+ */
+
+#ifndef _BloomFilter_H_
+#define _BloomFilter_H_
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <stdint.h>
+
+class BloomFilter {
+
+public:
+
+	BloomFilter();
+
+	/* Empty filter for about elements k-mers of length k_. */
+	BloomFilter(unsigned k_, uint64_t elements);
+
+	/* Adds the canonical k-mers of the sequence to the filter. */
+	void addSequence(const std::string& sequence);
+
+	/* Returns the number of k-mers in the sequence (first) and how many of them are in the filter (second). */
+	std::pair<unsigned, unsigned> countHits(const std::string& sequence) const;
+
+	/* Writes the filter to the stream. */
+	bool write(std::ostream& out) const;
+
+	/* Uses a filter written with write() from memory (e.g. a mapped file) without copying it. */
+	bool attach(const char* data, uint64_t size);
+
+	inline unsigned getK() const {
+		return k;
+	}
+
+private:
+
+	unsigned k;
+	unsigned hashes;
+	uint64_t mask;
+	std::vector<uint64_t> bits;
+
+	// Attached memory, used when bits is empty
+	const uint64_t* words;
+
+	void add(uint64_t kmer);
+	bool contains(uint64_t kmer) const;
+
+	/* Calls f for every canonical k-mer of the sequence, k-mers with N are skipped. */
+	template<class F> void forKmers(const std::string& sequence, F f) const;
+
+};
+
+#endif // _BloomFilter_H_
@@ -0,0 +1,73 @@
+#include "Checksum.h"
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+// Reflected polynomial of CRC32C
+static const uint32_t POLYNOMIAL = 0x82f63b78;
+
+struct crc_table_t {
+	uint32_t entries[256];
+
+	crc_table_t() {
+		for(uint32_t i = 0; i < 256; i++) {
+			uint32_t crc = i;
+			for(int bit = 0; bit < 8; bit++)
+				crc = (crc >> 1) ^ ((crc & 1) ? POLYNOMIAL : 0);
+			entries[i] = crc;
+		}
+	}
+};
+
+static uint32_t crc32c_table(uint32_t crc, const unsigned char* data, size_t size)
+{
+	static const crc_table_t table;
+
+	for(size_t i = 0; i < size; i++)
+		crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+
+	return crc;
+}
+
+#if defined(__x86_64__)
+
+// Eight bytes at a time, the rest a byte at a time
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char* data, size_t size)
+{
+	uint64_t crc64 = crc;
+
+	for(; size >= 8; size -= 8, data += 8) {
+		uint64_t word;
+		memcpy(&word, data, 8);
+		crc64 = _mm_crc32_u64(crc64, word);
+	}
+
+	crc = crc64;
+
+	for(; size > 0; size--, data++)
+		crc = _mm_crc32_u8(crc, *data);
+
+	return crc;
+}
+
+#endif
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+
+	crc = ~crc;
+
+#if defined(__x86_64__)
+	static const bool hardware = __builtin_cpu_supports("sse4.2");
+
+	if(hardware)
+		return ~crc32c_sse42(crc, bytes, size);
+#endif
+
+	return ~crc32c_table(crc, bytes, size);
+}
@@ -0,0 +1,16 @@
+/*
+ * CRC32C (Castagnoli) checksums of the blocks of an archive. The SSE4.2 crc32 instruction computes them when the
+ * processor has it, a table does otherwise; both give the same checksums.
+ *
+ */
+
+#ifndef _Checksum_H_
+#define _Checksum_H_
+
+#include <cstddef>
+#include <stdint.h>
+
+/* Continues the checksum crc (0 to start one) over size bytes of data. */
+uint32_t crc32c(uint32_t crc, const void* data, size_t size);
+
+#endif // _Checksum_H_
@@ -0,0 +1,652 @@
+#include "Job.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <climits>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <cstdio>
+#include <getopt.h>
+#include <unistd.h>
+#include "AlignmentReader.h"
+#include "Archive.h"
+#include "MethodA.h"
+#include "MethodB.h"
+#include "MethodC.h"
+#include "MethodD.h"
+#include "ThreadPool.h"
+
+job_t::job_t()
+	: mode(packing_mode_undef), xc_mode(mode_undef), read_mode(read_mode_undef), first_read(0), last_read(0),
+	region_from(1), region_to(LONG_MAX), append(false), sort_blocks(false) {
+}
+
+run_options_t::run_options_t()
+	: threads(0), pin_threads(false), jobs(0), help(false) {
+}
+
+std::string parse_args(const std::vector<std::string>& args, job_t& job, run_options_t& options) {
+
+	static struct option long_options[] = {
+		{"reads", required_argument, 0, 'r'},
+		{"region", required_argument, 0, 'g'},
+		{"threads", required_argument, 0, 't'},
+		{"affinity", no_argument, 0, 'p'},
+		{"batch", required_argument, 0, 'm'},
+		{"jobs", required_argument, 0, 'j'},
+		{"append", no_argument, 0, 'e'},
+		{"sort-blocks", no_argument, 0, 'k'},
+		{0, 0, 0, 0}
+	};
+
+	// getopt keeps its state in globals
+	static std::mutex lock;
+	std::unique_lock<std::mutex> guard(lock);
+
+	std::vector<std::string> copies(args);
+	std::vector<char*> argv;
+
+	for(unsigned i = 0; i < copies.size(); i++)
+		argv.push_back(&copies[i][0]);
+
+	argv.push_back(NULL);
+
+	int argc = args.size();
+	optind = 0;
+	opterr = 0;
+
+	// Parse command line parameters
+	int option_index = 0;
+	int c;
+	while((c = getopt_long(argc, argv.data(), "abcdxofqsht:", long_options, &option_index)) != -1)
+
+	{
+
+	switch(c)
+		{
+		case 'a':
+		case 'b':
+		case 'c':
+		case 'd':
+			if(job.mode != packing_mode_undef)
+				return "Conflicting mode parameters.";
+
+			job.mode = (c == 'a') ? packing_mode_a : (c == 'b') ? packing_mode_b : (c == 'c') ? packing_mode_c : packing_mode_d;
+			break;
+		case 'x':
+		case 'o':
+			if(job.xc_mode != mode_undef)
+				return "Conflicting mode parameters.";
+
+			job.xc_mode = (c == 'x') ? unzip_mode : zip_mode;
+			break;
+		case 'f':
+		case 'q':
+		case 's':
+			if(job.read_mode != read_mode_undef)
+				return "Conflicting mode parameters.";
+
+			job.read_mode = (c == 'f') ? read_mode_fasta : (c == 'q') ? read_mode_fastq : read_mode_sam;
+			break;
+		case 'r':
+			if(sscanf(optarg, "%ld-%ld", &job.first_read, &job.last_read) != 2 || job.first_read < 1 || job.last_read < job.first_read)
+				return "--reads takes a range FROM-TO of read numbers, counting from 1.";
+			break;
+		case 'g':
+		{
+			std::string region(optarg);
+			size_t colon = region.rfind(':');
+
+			job.region_chromosome = region.substr(0, colon);
+
+			if(colon != std::string::npos && (sscanf(region.c_str() + colon + 1, "%ld-%ld", &job.region_from, &job.region_to) != 2 ||
+				job.region_from < 1 || job.region_to < job.region_from || job.region_chromosome.empty()))
+				return "--region takes a region CHR:FROM-TO or a chromosome CHR.";
+			break;
+		}
+		case 't':
+		{
+			int count = 0;
+
+			if(sscanf(optarg, "%d", &count) != 1 || count < 1)
+				return "-t takes the number of threads.";
+
+			options.threads = count;
+			break;
+		}
+		case 'p':
+			options.pin_threads = true;
+			break;
+		case 'm':
+			options.manifest = optarg;
+			break;
+		case 'j':
+		{
+			int count = 0;
+
+			if(sscanf(optarg, "%d", &count) != 1 || count < 1)
+				return "--jobs takes the number of jobs run at a time.";
+
+			options.jobs = count;
+			break;
+		}
+		case 'e':
+			job.append = true;
+			break;
+		case 'k':
+			job.sort_blocks = true;
+			break;
+		case 'h':
+			options.help = true;
+			break;
+		default:
+			return "Unknown option " + std::string(argv[optind - 1]) + ".";
+		}
+	}
+
+	if(optind < argc)
+		job.genome_file = args[optind++];
+
+	job.files.assign(args.begin() + optind, args.end());
+
+	return "";
+}
+
+unsigned job_files(const job_t& job) {
+
+	if(job.mode == packing_mode_a || job.mode == packing_mode_b)
+		return 2;
+
+	// Both mates of SAM input come from the one file
+	if(job.xc_mode == zip_mode && job.read_mode == read_mode_sam)
+		return 2;
+
+	return 3;
+}
+
+// Method of the archive header
+static packing_mode_t archive_mode(const ArchiveReader& in) {
+
+	const char method = in.getHeader().method;
+
+	return (method == 'a') ? packing_mode_a : (method == 'b') ? packing_mode_b : (method == 'c') ? packing_mode_c : packing_mode_d;
+}
+
+std::string detect_mode(job_t& job) {
+
+	if(job.xc_mode != unzip_mode || job.files.empty() || job.files[0] == "-")
+		return "";
+
+	ArchiveReader in;
+
+	if(!in.open(job.files[0]))
+		return "Failure to open the archive " + job.files[0] + ".";
+
+	packing_mode_t mode = archive_mode(in);
+
+	if(job.mode != packing_mode_undef && job.mode != mode)
+		return "The archive was compressed with method " + std::string(1, in.getHeader().method) + ".";
+
+	job.mode = mode;
+	return "";
+}
+
+std::string check_job(const job_t& job) {
+
+	if(job.xc_mode == mode_undef)
+		return "Please specify either compression or decompression mode.";
+
+	if(job.read_mode == read_mode_undef && job.xc_mode == zip_mode)
+		return "Please specify either fasta, fastq or sam format.";
+
+	if(job.mode == packing_mode_undef && job.xc_mode == unzip_mode)
+		return "Please specify method a, b, c or d, it can't be read from an archive in the standard input.";
+
+	if(job.mode == packing_mode_undef)
+		return "Please specify method a, b, c or d.";
+
+	if(job.first_read > 0 && (job.xc_mode != unzip_mode || job.mode == packing_mode_b || job.mode == packing_mode_d))
+		return "--reads needs decompression of an order-preserving archive (method a or c).";
+
+	if(job.region_chromosome != "" && (job.xc_mode != unzip_mode || job.mode == packing_mode_a || job.mode == packing_mode_c))
+		return "--region needs decompression of a sorted archive (method b or d).";
+
+	if(job.append && (job.xc_mode != zip_mode || job.mode == packing_mode_b || job.mode == packing_mode_d))
+		return "--append needs compression to an order-preserving archive (method a or c).";
+
+	if(job.sort_blocks && (job.xc_mode != zip_mode || job.mode != packing_mode_a))
+		return "--sort-blocks needs compression with method a.";
+
+	if(job.genome_file == "" || job.files.size() < job_files(job))
+		return "missing input files!";
+
+	if(job.xc_mode == zip_mode && (job.mode == packing_mode_b || job.mode == packing_mode_d)) {
+		for(unsigned i = 0; i < job.files.size(); i++) {
+			if(job.files[i] == "-")
+				return "methods b and d sort all the reads and can't compress from the standard input.";
+		}
+	}
+
+	if(job.append && job.files.back() == "-")
+		return "--append needs the archive as a file.";
+
+	// The mates are read from the file separately
+	if(job.xc_mode == zip_mode && job.read_mode == read_mode_sam && (job.mode == packing_mode_c || job.mode == packing_mode_d) && job.files[0] == "-")
+		return "paired SAM input can't be read from the standard input.";
+
+	return "";
+}
+
+// Returns SAM file for the given SAM/BAM input, BAM files are converted with samtools. Returns "" on failure.
+static std::string sam_input(const std::string& input_file) {
+
+	if(input_file.length() < 4 || input_file.substr(input_file.length() - 4) != ".bam")
+		return input_file;
+
+	std::string sam_file = temporary_prefix() + ".sam";
+
+	if(!bam_to_sam(input_file, sam_file)) {
+		std::cerr << "Error! Failure in converting " << input_file << " to SAM, is samtools installed?" << std::endl;
+		return "";
+	}
+
+	return sam_file;
+}
+
+static bool compress(const job_t& job) {
+
+	const std::string& genome_file = job.genome_file;
+	bool paired = (job.mode == packing_mode_c || job.mode == packing_mode_d);
+
+	// A missing input fails the job instead of compressing no reads (awk and the aligner don't report it) or aborting
+	// the other jobs of a batch
+	for(unsigned i = 0; i < (paired && job.read_mode != read_mode_sam ? 2 : 1); i++) {
+		if(job.files[i] != "-" && !std::ifstream(job.files[i].c_str()).is_open()) {
+			std::cerr << "Failure to open the input file " << job.files[i] << "." << std::endl;
+			return false;
+		}
+	}
+
+	if(job.read_mode == read_mode_sam) {
+
+		std::string sam_file = sam_input(job.files[0]);
+		const std::string& output_file = job.files[1];
+
+		if(sam_file == "")
+			return false;
+
+		bool ok;
+
+		if(job.mode == packing_mode_a)
+			ok = MethodA::compress_A(sam_file, output_file, genome_file, AlignmentReader::input_sam, job.append, job.sort_blocks);
+		else if(job.mode == packing_mode_b)
+			ok = MethodB::compress(sam_file, output_file, genome_file, AlignmentReader::input_sam);
+		else if(job.mode == packing_mode_c)
+			ok = MethodC::compress_C(sam_file, sam_file, output_file, genome_file, AlignmentReader::input_sam, job.append);
+		else
+			ok = MethodD::compress(sam_file, sam_file, output_file, genome_file, AlignmentReader::input_sam);
+
+		if(sam_file != job.files[0])
+			unlink(sam_file.c_str());
+
+		return ok;
+	}
+
+	if(!paired && job.files[0] == "-") {
+
+		// Reads from the standard input are aligned and compressed a chunk at a time
+		StreamAligner aligner(std::cin, NULL, genome_file, job.read_mode);
+
+		return MethodA::compress_A([&aligner](Alignment& a) { return aligner.next(a); }, job.files[1], genome_file, job.append, job.sort_blocks,
+			[&aligner]() { return aligner.good(); });
+	}
+
+	if(paired && (job.files[0] == "-" || job.files[1] == "-")) {
+
+		// Reads from the standard input are aligned and compressed a chunk at a time, mates interleaved if both are "-"
+		std::ifstream file_1, file_2;
+		std::istream& in_1 = open_input(job.files[0], file_1);
+		std::istream& in_2 = open_input(job.files[1], file_2);
+
+		if(!in_1 || !in_2) {
+			std::cerr << "Failure to open the input files." << std::endl;
+			return false;
+		}
+
+		StreamAligner aligner(in_1, &in_2, genome_file, job.read_mode);
+
+		return MethodC::compress_C([&aligner](Alignment& a_1, Alignment& a_2) { return aligner.next(a_1, a_2); }, job.files[2], genome_file, job.append,
+			[&aligner]() { return aligner.good(); });
+	}
+
+	// Only the order-preserving methods keep the aligner's order
+	bool maintainOrder = (job.mode == packing_mode_a || job.mode == packing_mode_c);
+
+	if(!paired) {
+
+		const std::string& input_file = job.files[0];
+		std::string alignment_file = temporary_prefix() + ".tab";
+
+		// Call to align
+		if(!(align_single(input_file, genome_file, alignment_file, job.read_mode, maintainOrder))) {
+			std::cerr << "Error! Failure in aligning the reads." << std::endl;
+			return false;
+		}
+
+		bool ok = (job.mode == packing_mode_a) ? MethodA::compress_A(alignment_file, job.files[1], genome_file, AlignmentReader::input_tabdelimited, job.append, job.sort_blocks)
+			: MethodB::compress(alignment_file, job.files[1], genome_file);
+
+		unlink(alignment_file.c_str());
+
+		return ok;
+	}
+
+	std::string prefix = temporary_prefix();
+	std::string alignment_file_1 = prefix + ".1.tab";
+	std::string alignment_file_2 = prefix + ".2.tab";
+
+	// Call to align
+	if(!(align_pair(job.files[0], job.files[1], genome_file, alignment_file_1, alignment_file_2, job.read_mode, maintainOrder))) {
+		std::cerr << "Error! Failure in aligning the reads." << std::endl;
+		return false;
+	}
+
+	bool ok = (job.mode == packing_mode_d) ? MethodD::compress(alignment_file_1, alignment_file_2, job.files[2], genome_file)
+		: MethodC::compress_C(alignment_file_1, alignment_file_2, job.files[2], genome_file, AlignmentReader::input_tabdelimited, job.append);
+
+	unlink(alignment_file_1.c_str());
+	unlink(alignment_file_2.c_str());
+
+	return ok;
+}
+
+static bool decompress(const job_t& job) {
+
+	const std::vector<std::string>& files = job.files;
+
+	switch(job.mode) {
+
+		case packing_mode_a:
+			if(job.first_read > 0)
+				return MethodA::extract_A(files[0], files[1], job.genome_file, job.first_read, job.last_read);
+			return MethodA::decompress_A(files[0], files[1], job.genome_file);
+
+		case packing_mode_b:
+			if(job.region_chromosome != "")
+				return MethodB::extract(files[0], files[1], job.genome_file, job.region_chromosome, job.region_from, job.region_to);
+			return MethodB::decompress(files[0], files[1], job.genome_file);
+
+		case packing_mode_c:
+			if(job.first_read > 0)
+				return MethodC::extract_C(files[0], files[1], files[2], job.genome_file, job.first_read, job.last_read);
+			return MethodC::decompress_C(files[0], files[1], files[2], job.genome_file);
+
+		case packing_mode_d:
+			if(job.region_chromosome != "")
+				return MethodD::extract(files[0], files[1], files[2], job.genome_file, job.region_chromosome, job.region_from, job.region_to);
+			return MethodD::decompress(files[0], files[1], files[2], job.genome_file);
+
+		default:
+			return false;
+	}
+}
+
+bool run_job(const job_t& job) {
+
+	if(job.xc_mode == zip_mode) {
+
+		if(compress(job)) {
+			std::cerr << "Done compressing." << std::endl;
+			return true;
+		}
+
+		std::cerr << "Error! Something went wrong with the compression!" << std::endl;
+		return false;
+	}
+
+	if(decompress(job)) {
+		std::cerr << "Done decompressing." << std::endl;
+		return true;
+	}
+
+	std::cerr << "Error! Something went wrong with the decompression!" << std::endl;
+	return false;
+}
+
+bool transcode(packing_mode_t to, const std::string& genome_file, const std::string& input_file, const std::string& output_file) {
+
+	ArchiveReader in;
+
+	if(!in.open(input_file)) {
+		std::cerr << "Failure to open the archive." << std::endl;
+		return false;
+	}
+
+	const Reference& reference = load_reference(genome_file);
+	const std::vector<std::string>& names = reference.getNames();
+
+	if(!checkArchive(in, reference))
+		return false;
+
+	packing_mode_t from = archive_mode(in);
+	bool paired = (from == packing_mode_c || from == packing_mode_d);
+
+	if(from == to || paired != (to == packing_mode_c || to == packing_mode_d)) {
+		std::cerr << "Archives can only be transcoded between methods a and b or between methods c and d." << std::endl;
+		return false;
+	}
+
+	bool ok;
+
+	if(!paired) {
+
+		RecordReader<Alignment> records(in, from == packing_mode_a ? MethodA::decoder_A(names, in.getHeader().codecs) : MethodB::decoder(names));
+		std::function<bool(Alignment&)> next = [&records](Alignment& a) { return records.next(a); };
+
+		ok = ((to == packing_mode_a) ? MethodA::compress_A(next, output_file, genome_file) : MethodB::compress(next, output_file, genome_file)) && records.good();
+	}
+	else if(to == packing_mode_d) {
+
+		RecordReader<std::pair<Alignment, Alignment> > records(in, MethodC::decoder_C(names));
+
+		ok = MethodD::compress([&records](Alignment& a_1, Alignment& a_2) {
+			std::pair<Alignment, Alignment> pair;
+			if(!records.next(pair))
+				return false;
+			a_1 = pair.first;
+			a_2 = pair.second;
+			return true;
+		}, output_file, genome_file) && records.good();
+	}
+	else {
+
+		RecordReader<std::pair<Alignment, Alignment> > records(in, MethodD::decoder(names));
+
+		// Method c codes the distance of the mates with the orientation of the pair, in either direction
+		ok = MethodC::compress_C([&records](Alignment& a_1, Alignment& a_2) {
+			std::pair<Alignment, Alignment> pair;
+			if(!records.next(pair))
+				return false;
+			a_1 = pair.first;
+			a_2 = pair.second;
+			return true;
+		}, output_file, genome_file) && records.good();
+	}
+
+	if(!ok) {
+		std::cerr << "Error! Something went wrong with the transcoding!" << std::endl;
+		return false;
+	}
+
+	std::cerr << "Done transcoding." << std::endl;
+	return true;
+}
+
+bool merge(const std::string& output_file, const std::vector<std::string>& input_files) {
+
+	ArchiveReader in;
+
+	if(input_files.empty() || !in.open(input_files[0])) {
+		std::cerr << "Failure to open the archive." << std::endl;
+		return false;
+	}
+
+	// The rest of the archives are checked against the first one
+	packing_mode_t mode = archive_mode(in);
+	bool ok;
+
+	if(mode == packing_mode_b)
+		ok = MethodB::merge(input_files, output_file);
+	else if(mode == packing_mode_d)
+		ok = MethodD::merge(input_files, output_file);
+	else {
+		std::cerr << "Only archives of methods b and d can be merged, " << input_files[0] << " keeps the order of the reads." << std::endl;
+		return false;
+	}
+
+	if(!ok) {
+		std::cerr << "Error! Something went wrong with the merging!" << std::endl;
+		return false;
+	}
+
+	std::cerr << "Done merging." << std::endl;
+	return true;
+}
+
+bool verify(const std::vector<std::string>& archive_files) {
+
+	bool ok = true;
+
+	for(unsigned i = 0; i < archive_files.size(); i++) {
+
+		ArchiveReader in;
+
+		if(!in.open(archive_files[i])) {
+			std::cerr << archive_files[i] << ": Failure to open the archive." << std::endl;
+			ok = false;
+			continue;
+		}
+
+		// The records are decoded without the reference, only its number of chromosome codes is needed
+		const ArchiveHeader& header = in.getHeader();
+		std::vector<std::string> names(header.chromosomes, "");
+		if(!names.empty())
+			names.back() = "*";
+
+		packing_mode_t mode = archive_mode(in);
+		uint64_t reads = 0, blocks = 0;
+		bool intact;
+
+		if(mode == packing_mode_a)
+			intact = verifyRecords<Alignment>(in, ThreadPool::shared(), MethodA::decoder_A(names, in.getHeader().codecs), reads, blocks);
+		else if(mode == packing_mode_b)
+			intact = verifyRecords<Alignment>(in, ThreadPool::shared(), MethodB::decoder(names), reads, blocks);
+		else if(mode == packing_mode_c)
+			intact = verifyRecords<std::pair<Alignment, Alignment> >(in, ThreadPool::shared(), MethodC::decoder_C(names), reads, blocks);
+		else if(mode == packing_mode_d)
+			intact = verifyRecords<std::pair<Alignment, Alignment> >(in, ThreadPool::shared(), MethodD::decoder(names), reads, blocks);
+		else {
+			std::cerr << archive_files[i] << ": Unknown method " << header.method << "." << std::endl;
+			intact = false;
+		}
+
+		if(intact && header.reads != 0 && header.reads != reads) {
+			std::cerr << "The archive has " << reads << " reads, its header " << header.reads << "." << std::endl;
+			intact = false;
+		}
+
+		if(intact)
+			std::cerr << archive_files[i] << ": OK, " << reads << " reads in " << blocks << " blocks." << std::endl;
+		else
+			std::cerr << archive_files[i] << ": CORRUPTED" << std::endl;
+
+		ok = ok && intact;
+	}
+
+	return ok;
+}
+
+bool run_batch(const job_t& options, const std::string& manifest, unsigned jobs) {
+
+	std::ifstream in(manifest.c_str());
+
+	if(!in.is_open()) {
+		std::cerr << "Failure to open the manifest " << manifest << "." << std::endl;
+		return false;
+	}
+
+	std::vector<job_t> batch;
+	std::string row;
+
+	for(unsigned line = 1; getline(in, row); line++) {
+
+		std::istringstream fields(row);
+		job_t job = options;
+		std::string file;
+
+		job.files.clear();
+
+		while(fields >> file)
+			job.files.push_back(file);
+
+		// Empty lines and comments
+		if(job.files.empty() || job.files[0][0] == '#')
+			continue;
+
+		std::string problem = detect_mode(job);
+
+		if(problem == "")
+			problem = check_job(job);
+
+		for(unsigned i = 0; i < job.files.size(); i++) {
+			if(job.files[i] == "-")
+				problem = "the jobs of a batch can't use the standard input or output.";
+		}
+
+		if(problem == "" && job.files.size() > job_files(job))
+			problem = "too many files.";
+
+		if(problem != "") {
+			std::cerr << manifest << ":" << line << ": " << problem << std::endl;
+			return false;
+		}
+
+		batch.push_back(job);
+	}
+
+	// The reference is loaded once for all of the jobs, and its index is built (if it's missing or stale) before they
+	// start instead of by every job at the same time
+	load_reference(options.genome_file);
+
+	ReferenceIndex reference_index;
+
+	if(options.xc_mode == zip_mode && options.read_mode != read_mode_sam)
+		open_reference_index(options.genome_file, reference_index);
+
+	if(jobs == 0)
+		jobs = ThreadPool::shared().size();
+
+	std::atomic<size_t> next(0);
+	std::atomic<size_t> failed(0);
+	std::vector<std::thread> runners;
+
+	for(unsigned i = 0; i < jobs && i < batch.size(); i++) {
+		runners.push_back(std::thread([&]() {
+			for(size_t n = next++; n < batch.size(); n = next++) {
+				if(!run_job(batch[n])) {
+					std::cerr << "Error! Job " << n + 1 << " (" << batch[n].files[0] << ") failed." << std::endl;
+					failed++;
+				}
+			}
+		}));
+	}
+
+	for(unsigned i = 0; i < runners.size(); i++)
+		runners[i].join();
+
+	std::cerr << "Batch: " << batch.size() - failed << " of " << batch.size() << " jobs succeeded." << std::endl;
+
+	return failed == 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * One compression or decompression as given on the command line, so that it can also be run from a batch manifest
+ * or by the server against a reference that is already loaded.
+ *
+ */
+
+#ifndef _Job_H_
+#define _Job_H_
+
+#include <string>
+#include <vector>
+#include "utils.h"
+
+enum packing_mode_t {packing_mode_undef, packing_mode_a, packing_mode_b, packing_mode_c, packing_mode_d };
+enum pack_unpack_mode_t {mode_undef, zip_mode, unzip_mode };
+
+struct job_t {
+	packing_mode_t mode;
+	pack_unpack_mode_t xc_mode;
+	read_mode_t read_mode;
+	std::string genome_file;
+	std::vector<std::string> files;   // Input and output files in the order of the command line
+
+	// Range of reads to decompress, all of them if 0
+	long first_read;
+	long last_read;
+
+	// Region to decompress, the whole archive if there's no chromosome
+	std::string region_chromosome;
+	long region_from;
+	long region_to;
+
+	// Compress the reads after the ones already in the archive
+	bool append;
+
+	// Code the reads of every block of method a sorted by position (CODEC_SORTED_BLOCKS)
+	bool sort_blocks;
+
+	job_t();
+};
+
+// Options of the whole run rather than of one job
+struct run_options_t {
+	unsigned threads;         // Threads coding the blocks, one per core if 0
+	bool pin_threads;
+	std::string manifest;     // Manifest of a batch
+	unsigned jobs;            // Jobs of the batch run at a time, one per thread if 0
+	bool help;
+
+	run_options_t();
+};
+
+/* Parses the command line arguments (args[0] being the program) into the job and the options of the run, the first
+ * argument after the options is the reference and the rest are the files of the job. Returns the problem or "". */
+std::string parse_args(const std::vector<std::string>& args, job_t& job, run_options_t& options);
+
+/* Number of files (inputs and outputs) the job takes. */
+unsigned job_files(const job_t& job);
+
+/* Sets the method of a decompression job from the header of its archive, unless the archive is read from the
+ * standard input. Returns the problem (e.g. a method given that the archive doesn't have) or "". */
+std::string detect_mode(job_t& job);
+
+/* Checks the modes and options of the job, returns the problem or "" if it can be run. */
+std::string check_job(const job_t& job);
+
+/* Runs the compression or decompression, returns true on success. */
+bool run_job(const job_t& job);
+
+/* Transcodes the archive into an archive of the other method (a and b, or c and d) from the alignments of its
+ * records, without aligning the reads or building them from the reference. Returns true on success. */
+bool transcode(packing_mode_t to, const std::string& genome_file, const std::string& input_file, const std::string& output_file);
+
+/* Merges the sorted archives (method b or d, read from their headers) into one. Returns true on success. */
+bool merge(const std::string& output_file, const std::vector<std::string>& input_files);
+
+/* Checks the checksums and the records of the archives without the reference or building the reads, reporting every
+ * archive on the standard error. Returns true if all of them are intact. */
+bool verify(const std::vector<std::string>& archive_files);
+
+/* Runs the jobs of the manifest, one job per line giving its files separated by whitespace, with the modes and
+ * reference of the options job. Up to jobs of them run at a time (one per thread of the shared pool if 0), their
+ * blocks are coded on the shared pool. Returns true if all of them succeeded. */
+bool run_batch(const job_t& options, const std::string& manifest, unsigned jobs);
+
+#endif // _Job_H_
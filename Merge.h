@@ -0,0 +1,377 @@
+/*
+ * Reading archives at the record level: the records are decoded into their alignments without the reference, so that
+ * archives can be merged and transcoded without building the read sequences. Merging sorted archives (methods B and
+ * D) merges the records by start position chromosome by chromosome and codes them again, only the position deltas change.
+ *
+ */
+
+#ifndef _Merge_H_
+#define _Merge_H_
+
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <queue>
+#include <sstream>
+#include <iostream>
+#include <functional>
+#include <memory>
+#include "Archive.h"
+#include "bitfile.h"
+#include "utils.h"
+
+// Alignments sorted in memory at a time when sorting alignments that come in some other order
+const size_t SORT_RUN_READS = 1000000;
+
+/* Reads the records of an archive one at a time, decoding a block at a time. */
+template<class Record> class RecordReader {
+
+public:
+
+	/* decode(info, in, index, record, prevPos, repeats, distance) decodes the next record of the block, the index-th one,
+	 * prevPos starts at 0 in every block. Records repeating an earlier record of the block set repeats to their number
+	 * and distance to how many records back it is instead: runs of duplicates of the previous record (methods B and D,
+	 * distance is left at 1) or back-references (method A), which the decoder checks to stay within the records since
+	 * the last indexed one. */
+	typedef std::function<bool(const BlockInfo&, bit_file_c&, uint32_t, Record&, long&, long&, long&)> Decoder;
+
+	/* Reads the records of all blocks in archive order, also from an archive that isn't seekable. */
+	RecordReader(ArchiveReader& in_, Decoder decode_)
+		: in(in_), decode(decode_), all(true), block(0), left(0), prevPos(0), history(READ_INDEX_INTERVAL), repeats(0), distance(1), ended(false), failed(false) {}
+
+	/* Reads the records of the given blocks of a seekable archive. */
+	RecordReader(ArchiveReader& in_, const std::vector<BlockInfo>& blocks_, Decoder decode_)
+		: in(in_), decode(decode_), all(false), blocks(blocks_), block(0), left(0), prevPos(0), history(READ_INDEX_INTERVAL), repeats(0), distance(1), ended(false), failed(false) {}
+
+	/* Decodes the next record, returns false after the last one or on failure (good() tells which). */
+	bool next(Record& record) {
+
+		while(left == 0) {
+
+			bool read;
+
+			if(ended)
+				return false;
+			else if(all)
+				read = in.nextBlock(info, data);
+			else if(block == blocks.size())
+				return false;
+			else
+				read = in.readBlock(info = blocks[block++], data);
+
+			// The end of the blocks of the archive or a truncated block
+			if(!read) {
+				ended = true;
+				failed = !all || !in.good();
+				if(failed)
+					std::cerr << "The archive is truncated." << std::endl;
+				return false;
+			}
+
+			bits.reset(new bit_file_c());
+			stream.reset(new std::istringstream(data));
+			bits->Open(*stream);
+			left = info.header.reads;
+			prevPos = 0;
+			repeats = 0;
+		}
+
+		uint32_t index = info.header.reads - left;
+
+		if(repeats == 0)
+			distance = 1;
+
+		// A repeat refers back to a record of the block and a run can't run past it
+		if((repeats == 0 && !decode(info, *bits, index, record, prevPos, repeats, distance)) ||
+			(repeats > 0 && (distance < 1 || distance > index || distance >= (long)READ_INDEX_INTERVAL || repeats > left))) {
+			std::cerr << "Failure to decode a record." << std::endl;
+			failed = true;
+			return false;
+		}
+
+		if(repeats > 0) {
+			record = history[(index - distance) % READ_INDEX_INTERVAL];
+			--repeats;
+		}
+
+		history[index % READ_INDEX_INTERVAL] = record;
+
+		// The last record of a block ends in its last byte, a block coding more or fewer records is corrupted
+		if(--left == 0 && (bits->TellBit() + 7) / 8 != (std::streamoff)data.size()) {
+			std::cerr << "The records of the block at offset " << info.offset << " don't fill the block." << std::endl;
+			failed = true;
+			return false;
+		}
+
+		return true;
+	}
+
+	inline bool good() const {
+		return !failed;
+	}
+
+private:
+
+	ArchiveReader& in;
+	Decoder decode;
+	bool all;
+	std::vector<BlockInfo> blocks;
+	size_t block;
+	BlockInfo info;
+	std::string data;
+	std::unique_ptr<std::istringstream> stream;
+	std::unique_ptr<bit_file_c> bits;
+	uint32_t left;
+	long prevPos;
+	std::vector<Record> history;   // Records since the last indexed one, for the repeats
+	long repeats;
+	long distance;
+	bool ended;
+	bool failed;
+
+};
+
+/* Number of the records first..last-1 of a sorted block that repeat the record before them, if coding them as runs
+ * (see writeDuplicates) takes fewer bits than coding them in full, 0 otherwise. bits(record, prevPos) is the code
+ * length of the record without runs, start(record) the position the records are sorted by. */
+template<class Record> uint32_t duplicateRuns(const std::vector<Record>& records, size_t first, size_t last,
+	std::function<long(const Record&, long)> bits, std::function<long(const Record&)> start)
+{
+	uint32_t duplicates = 0;
+	long saving = 0, run = 0, prevPos = 0;
+
+	for(size_t i = first; i <= last; ++i)
+	{
+		if(i < last && i > first && sameAlignment(records[i], records[i - 1]))
+		{
+			saving += bits(records[i], prevPos);
+			duplicates++;
+			run++;
+			continue;
+		}
+
+		// A run takes a zero delta, a set bit and its length
+		if(run > 0)
+			saving -= 2 + gammaCodeLength(run - 1);
+		run = 0;
+
+		if(i == last)
+			break;
+
+		// Other records with a zero delta take a clear bit
+		if(start(records[i]) == prevPos)
+			saving -= 1;
+		prevPos = start(records[i]);
+	}
+
+	return saving > 0 ? duplicates : 0;
+}
+
+/* Merges the archives of the method (b or d) into the output. decode decodes the next record of a block (see RecordReader),
+ * encode(out, record, prevPos, coded) codes it into the block (with the coding parameters and duplicates of coded.header) and
+ * widens the reference range of the block, fit(records, header) sets the coding parameters of a block from its records (the
+ * modal read length and the insert size of pairs), bits(record, prevPos, header) is the code length of a record without runs
+ * of duplicates, start(record) is the position the records are sorted by and less(a, b) orders the records as compressing
+ * sorts them, so that duplicates from different inputs end up next to each other. Returns true on success. */
+template<class Record> bool mergeArchives(char method, const std::vector<std::string>& inputs, const std::string& output,
+	typename RecordReader<Record>::Decoder decode,
+	std::function<void(bit_file_c&, const Record&, long, CodedBlock&)> encode,
+	std::function<void(const std::vector<Record>&, BlockHeader&)> fit,
+	std::function<long(const Record&, long, const BlockHeader&)> bits,
+	std::function<long(const Record&)> start,
+	std::function<bool(const Record&, const Record&)> less)
+{
+	std::vector<std::unique_ptr<ArchiveReader> > readers;
+	std::set<int32_t> chromosomes;
+
+	for(size_t i = 0; i < inputs.size(); ++i)
+	{
+		readers.push_back(std::unique_ptr<ArchiveReader>(new ArchiveReader()));
+
+		if(!readers.back()->open(inputs[i]) || !readers.back()->seekable())
+		{
+			std::cerr << "Failure to open the archive " << inputs[i] << "." << std::endl;
+			return false;
+		}
+
+		const ArchiveHeader& header = readers.back()->getHeader();
+
+		if(header.method != method)
+		{
+			std::cerr << "Archive " << inputs[i] << " was compressed with method " << header.method << ", not " << method << "." << std::endl;
+			return false;
+		}
+
+		if(header.chromosome_checksum != readers[0]->getHeader().chromosome_checksum)
+		{
+			std::cerr << "Archive " << inputs[i] << " was compressed against another reference than " << inputs[0] << "." << std::endl;
+			return false;
+		}
+
+		const std::vector<BlockInfo>& blocks = readers.back()->getBlocks();
+
+		for(size_t b = 0; b < blocks.size(); ++b)
+			chromosomes.insert(blocks[b].header.chromosome);
+	}
+
+	ArchiveWriter out;
+	if(inputs.empty() || !out.open(output, readers[0]->getHeader()))
+		return false;
+
+	bool failed = false;
+
+	// Compressing sorts the blocks by chromosome name, which puts the unaligned reads ("*", the last code) first
+	// and the chromosomes in the order of their codes, the merged archive is sorted the same way
+	std::vector<int32_t> order(chromosomes.begin(), chromosomes.end());
+	int32_t unaligned = (int32_t)readers[0]->getHeader().chromosomes - 1;
+	if(!order.empty() && order.back() == unaligned)
+		std::rotate(order.begin(), order.end() - 1, order.end());
+
+	for(std::vector<int32_t>::const_iterator chromosome = order.begin(); chromosome != order.end() && !failed; ++chromosome)
+	{
+		// Next record of every input on the chromosome
+		std::vector<std::unique_ptr<RecordReader<Record> > > cursors;
+		std::vector<Record> records(readers.size());
+
+		// Inputs by their next record, the smallest first and ties in the order of the inputs
+		std::function<bool(size_t, size_t)> later = [&records, &less](size_t a, size_t b) {
+			if(less(records[b], records[a]))
+				return true;
+			if(less(records[a], records[b]))
+				return false;
+			return a > b;
+		};
+		std::priority_queue<size_t, std::vector<size_t>, std::function<bool(size_t, size_t)> > heads(later);
+
+		for(size_t i = 0; i < readers.size(); ++i)
+		{
+			std::vector<BlockInfo> blocks;
+			const std::vector<BlockInfo>& all = readers[i]->getBlocks();
+			for(size_t b = 0; b < all.size(); ++b)
+				if(all[b].header.chromosome == *chromosome)
+					blocks.push_back(all[b]);
+
+			cursors.push_back(std::unique_ptr<RecordReader<Record> >(new RecordReader<Record>(*readers[i], blocks, decode)));
+
+			if(cursors[i]->next(records[i]))
+				heads.push(i);
+			failed = failed || !cursors[i]->good();
+		}
+
+		// Records of the block are collected first for its coding parameters
+		std::vector<Record> block;
+
+		std::function<bool()> flush = [&]() {
+			CodedBlock coded;
+
+			std::ostringstream stream;
+			bit_file_c block_out;
+			block_out.Open(stream);
+
+			coded.first_position = start(block[0]);
+			coded.header.reads = block.size();
+			coded.header.chromosome = *chromosome;
+			fit(block, coded.header);
+			coded.header.duplicates = duplicateRuns<Record>(block, 0, block.size(),
+				[&](const Record& record, long prevPos) { return bits(record, prevPos, coded.header); }, start);
+
+			long prevPos = 0;
+			for(size_t i = 0; i < block.size(); ++i)
+			{
+				// Duplicates of the previous record are coded as one run
+				size_t run = i;
+				while(coded.header.duplicates > 0 && i > 0 && run < block.size() && sameAlignment(block[run], block[i - 1]))
+					++run;
+				if(run > i)
+				{
+					writeDuplicates(block_out, run - i);
+					i = run - 1;
+					continue;
+				}
+
+				encode(block_out, block[i], prevPos, coded);
+				prevPos = start(block[i]);
+			}
+
+			block_out.Close();
+			coded.data = stream.str();
+			coded.header.size = coded.data.size();
+			block.clear();
+			return out.writeBlock(coded);
+		};
+
+		while(!heads.empty() && !failed)
+		{
+			size_t next = heads.top();
+			heads.pop();
+
+			block.push_back(records[next]);
+
+			if(block.size() == BLOCK_READS && !flush())
+				failed = true;
+
+			if(cursors[next]->next(records[next]))
+				heads.push(next);
+			failed = failed || !cursors[next]->good();
+		}
+
+		if(!block.empty() && !failed && !flush())
+			failed = true;
+	}
+
+	return out.close() && !failed;
+}
+
+/* Checks every block of the archive on the pool: its checksum (see ArchiveReader) and that it decodes into its number
+ * of records using all of its data, without building the read sequences. Counts the records and blocks checked,
+ * returns true if all of them are intact. */
+template<class Record> bool verifyRecords(ArchiveReader& in, ThreadPool& pool, typename RecordReader<Record>::Decoder decode,
+	uint64_t& reads, uint64_t& blocks)
+{
+	reads = blocks = 0;
+
+	return readBlocks<uint32_t>(in, pool, [decode](const BlockInfo& info, const std::string& data, uint32_t& records) {
+		std::istringstream stream(data);
+		bit_file_c bits;
+		Record record;
+		long prevPos = 0, repeats = 0, distance = 1;
+
+		bits.Open(stream);
+
+		for(records = 0; records < info.header.reads; ++records)
+		{
+			if(repeats > 0)
+			{
+				--repeats;
+				continue;
+			}
+
+			distance = 1;
+
+			if(!decode(info, bits, records, record, prevPos, repeats, distance) ||
+				(repeats > 0 && (distance < 1 || distance > records || distance >= (long)READ_INDEX_INTERVAL || repeats > info.header.reads - records)))
+			{
+				std::cerr << "Failure to decode read " << info.first_read + records + 1 << " of the archive." << std::endl;
+				return false;
+			}
+
+			if(repeats > 0)
+				--repeats;
+		}
+
+		if((bits.TellBit() + 7) / 8 != (std::streamoff)data.size())
+		{
+			std::cerr << "The records of the block at offset " << info.offset << " don't fill the block." << std::endl;
+			return false;
+		}
+
+		return true;
+	}, [&reads, &blocks](const uint32_t& records) {
+		reads += records;
+		blocks++;
+		return true;
+	});
+}
+
+#endif // _Merge_H_
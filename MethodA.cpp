@@ -1,459 +1,636 @@
 #include "MethodA.h"
 #include "Alignment.h"
 #include "AlignmentReader.h"
+#include "Archive.h"
+#include "ThreadPool.h"
 #include "bitfile.h"
 #include "utils.h"
 
 #include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
 #include <cmath>
+#include <sstream>
 
 using namespace std;
 
-// Compresses given alignment file.
-// Returns true on success and false if there were any problems.
-bool MethodA::compress_A(std::string inputfile, string outputfile, string genomefile) {
+// Codes the read: chromosome code, strand, start, length (against the modal length of the block) and the edits.
+static bool encodeAlignment(bit_file_c& out, const Alignment& a, const map<string, int>& chromosome_codes, int bits, long modal) {
 
-	AlignmentReader* reader = new AlignmentReader(AlignmentReader::input_tabdelimited, inputfile);
+	map<string, int>::const_iterator code = chromosome_codes.find(a.getChromosome());
 
-	Alignment a;
+	if(code == chromosome_codes.end()) {
+		cerr << "Error: chromosome " << a.getChromosome() << " is not in the reference!" << endl;
+		return false;
+	}
 
-	bit_file_c out;
+	// Output code for chromosome
+	int chrom_code = code->second;
 
-    /* open bit file for writing */
-    try
-    {
-        out.Open(outputfile.c_str(), BF_WRITE);
-    }
-    catch (...)
-    {
-        return false;
-    }
+	if(out.PutBitsInt(&chrom_code, bits, sizeof(chrom_code)) == EOF) {
+		cerr << "Error: writing chromosome code!" << endl;
+		return false;
+	}
 
-	map<string, int> chromosome_codes = code_chromosomes(genomefile);
+	// Output code for strand
+	int value;
 
-	// Find out how many bits needed for fixed length
-	int bits = ceil(log2(chromosome_codes.size()));
+	if(a.getStrand() == 'R')
+		value = 0;
+	else
+		value = 1;
+
+	if(out.PutBit(value) == EOF) {
+		cerr << "Error: writing strand!" << endl;
+		return false;
+	}
+
+	writeGammaCode(out, a.getStart());
+	writeLength(out, a.getLength(), modal);
+
+	// Output codes for the edits (relative position with gamma code and the edits with fixed length)
+	// Output of readaligner codes mismatches with ACGT and insertions with acgt
+	const vector<pair<int,char> >& edits = a.getEdits();
+	int size = edits.size();
+
+	int previous = 0;
 
-	while(reader->next(a)) {
+	// Number of edits first that know how many to read back
+	writeGammaCode(out, size);
 
-		// Output code for chromosome
-		int chrom_code = chromosome_codes[a.getChromosome()];
+	for(int i = 0; i < size; i++) {
 
-		if(out.PutBitsInt(&chrom_code, bits, sizeof(chrom_code)) == EOF) {
-			cerr << "Error: writing chromosome code!" << endl;
+		int edit_value = getEditCode(edits.at(i).second);
+
+		if(edit_value == -1) {
+			cerr << "Error: writing edits!" << endl;
 			return false;
 		}
 
+		writeEditOp(out, edits.at(i).first-previous, edit_value);
+
+		previous = edits.at(i).first;
+	}
+
+	return true;
+}
 
-		// Output code for strand
-		int value;
+// Hash of the fields of the alignment that sameAlignment compares.
+static size_t alignmentHash(const Alignment& a) {
 
-		if(a.getStrand() == 'R')
-			value = 0;
-		else
-			value = 1;
+	size_t hash = std::hash<string>()(a.getChromosome());
+	hash = hash * 31 + a.getStart();
+	hash = hash * 31 + a.getStrand();
+	hash = hash * 31 + a.getLength();
 
-		if(out.PutBit(value) == EOF) {
-			cerr << "Error: writing strand!" << endl;
-			return false;
+	const vector<pair<int,char> >& edits = a.getEdits();
+	for(unsigned i = 0; i < edits.size(); i++)
+		hash = hash * 31 + edits[i].first * 256 + edits[i].second;
+
+	return hash;
+}
+
+// Finds the reads of the block that repeat a read since the last indexed one, references[i] being how many reads back
+// the copy of read i is (0 if it has none). Returns the number of them if coding them as back-references takes fewer
+// bits than coding them in full, 0 otherwise.
+static uint32_t backReferences(const vector<Alignment>& block, int bits, long modal, vector<uint32_t>& references) {
+
+	// Last read with each hash since the last indexed read
+	unordered_map<size_t, uint32_t> recent;
+	uint32_t count = 0;
+	long saving = 0;
+
+	references.assign(block.size(), 0);
+
+	for(uint32_t i = 0; i < block.size(); i++) {
+
+		// Back-references don't reach past the indexed reads, so that decoding can start at any of them
+		if(i % READ_INDEX_INTERVAL == 0)
+			recent.clear();
+
+		size_t hash = alignmentHash(block[i]);
+		unordered_map<size_t, uint32_t>::iterator found = recent.find(hash);
+
+		// Every read takes a bit telling whether it's a back-reference
+		saving -= 1;
+
+		if(found != recent.end() && sameAlignment(block[found->second], block[i])) {
+			references[i] = i - found->second;
+			saving += bits + alignmentCodeLength(block[i], 0, modal) - gammaCodeLength(references[i] - 1);
+			count++;
 		}
 
-		writeGammaCode(out, a.getStart());
-		writeGammaCode(out, a.getLength());
-
-		// Output codes for the edits (relative position with gamma code and the edits with fixed length)
-		// Output of readaligner codes mismatches with ACGT and insertions with acgt
-		vector<pair<int,char> > edits = a.getEdits();
-		int size = edits.size();
-
-		int previous = 0;
-
-		// Number of edits first that know how many to read back
-		writeGammaCode(out, size);
-
-		for(int i = 0; i < size; i++) {
-
-			writeGammaCode(out, edits.at(i).first-previous);
-
-			previous = edits.at(i).first;
-
-			int edit_value = 0;
-
-			switch(edits.at(i).second) {
-
-				case 'A':
-					edit_value = mismatch_A;
-					break;
-				case 'C':
-					edit_value = mismatch_C;
-					break;
-				case 'G':
-					edit_value = mismatch_G;
-					break;
-				case 'T':
-					edit_value = mismatch_T;
-					break;
-				case 'a':
-					edit_value = insertion_A;
-					break;
-				case 'c':
-					edit_value = insertion_C;
-					break;
-				case 'g':
-					edit_value = insertion_G;
-					break;
-				case 't':
-					edit_value = insertion_T;
-					break;
-				case 'D':
-					edit_value = deletion;
-					break;
-			}
+		recent[hash] = i;
+	}
 
-			if(out.PutBitsInt(&edit_value, 4, sizeof(edit_value)) == EOF) {
-				cerr << "Error: writing edits!" << endl;
-				return false;
-			}
+	return saving > 0 ? count : 0;
+}
+
+// Reads the back-reference flag of the next read of a block that has back-references.
+// Returns how many reads back its copy is, 0 if the read is coded in full or -1 on failure.
+static long readReference(bit_file_c& in) {
+
+	switch(in.GetBit()) {
+
+		case 0:
+			return 0;
+		case 1: {
+			long distance = readGammaCode(in) + 1;
+			return in.good() ? distance : -1;
 		}
+		default:
+			return -1;
+	}
+}
+
+// Decodes the alignment of the next read of the block without reconstructing the read.
+// Returns false if the block doesn't hold a valid read.
+static bool decodeAlignment(bit_file_c& in, const vector<string>& chromosome_names, int bits, long modal, Alignment& a) {
+
+	// Get the values
+	int chromosome_code = 0;
+
+	if((in.GetBitsInt(&chromosome_code, bits, sizeof(chromosome_code))) == EOF)
+		return false;
 
-		edits.clear();
+	if(chromosome_code < 0 || chromosome_code >= (int)chromosome_names.size()) {
+		cerr << "Failure to decompress chromosome." << endl;
+		return false;
+	}
+
+	char strand;
+
+	switch(in.GetBit()) {
 
+		case 0:
+			strand = 'R';
+			break;
+		case 1:
+			strand = 'F';
+			break;
+		default:
+			return false;
 	}
 
-	// Writes out the rest of byte to avoid complications
-	out.ByteAlign();
+	long start = readGammaCode(in);
+	long length = readLength(in, modal);
 
+	// Read how many edits there are
+	long edits_size = readGammaCode(in);
 
-	delete reader;
-	out.Close();
-	chromosome_codes.clear();
+	if(!in.good())
+		return false;
+
+	vector<pair<int, char> > edits;
+
+	long pos = 0;
+
+	// Read the edits
+	for(long i = 0; i < edits_size; i++) {
+
+		pair<long, int> edit = readEditOp(in);
+
+		if(!in.good() || getEditChar(edit.second) == 0) {
+			cerr << "Failure to decompress edits." << endl;
+			return false;
+		}
+
+		pos += edit.first;
+
+		edits.push_back(make_pair(pos, getEditChar(edit.second)));
+	}
+
+	a = Alignment("", strand, length, chromosome_names.at(chromosome_code), start, edits);
 
 	return true;
+}
 
+// Decodes the next read of the block to data.
+// Returns false if the block doesn't hold a valid read.
+static bool decodeRead(bit_file_c& in, const vector<string>& chromosome_names, const map<string, string>& chromosomes, int bits, long modal, string& data) {
+
+	Alignment a;
+
+	return decodeAlignment(in, chromosome_names, bits, modal, a) && alignedSequence(a, chromosomes, data);
 }
 
-// Decompresses given compressed file using given genome file.
-// Returns true on success and false if there were any problems.
-bool MethodA::decompress_A(std::string inputfile, std::string outputfile, std::string genomefile){
+// Decodes the next read of a block with back-references to recent, the reads since the last indexed one with the read
+// i % READ_INDEX_INTERVAL being decoded. Returns false if the block doesn't hold a valid read.
+static bool decodeRecent(bit_file_c& in, const vector<string>& chromosome_names, const map<string, string>& chromosomes, int bits,
+	const BlockInfo& info, uint32_t i, vector<string>& recent) {
 
-	ofstream out(outputfile.c_str());
-	bit_file_c in;
-	ifstream in_genome(genomefile.c_str());
+	long reference = info.header.duplicates > 0 ? readReference(in) : 0;
+	string& data = recent[i % READ_INDEX_INTERVAL];
 
-	try
-	{
-		in.Open(inputfile.c_str(), BF_READ);
-	}
-	catch (...)
-	{
-		cerr << "Failure to open the bitfile." << endl;
+	if(reference < 0 || reference > i % READ_INDEX_INTERVAL)
 		return false;
-	}
 
-	if(!out.is_open()){
-		cerr << "Failure to open the outputfile." << endl;
-		return false;
+	if(reference > 0) {
+		data = recent[(i - reference) % READ_INDEX_INTERVAL];
+		return true;
 	}
 
-	// Reconstruct the codes for chromosomes
-	map<string, int> chromosome_codes = code_chromosomes(genomefile);
+	return decodeRead(in, chromosome_names, chromosomes, bits, info.header.read_length, data);
+}
 
-	// Find out how many bits needed for fixed length
-	int bits = ceil(log2(chromosome_codes.size()));
+// Bits of the place of a read in a sorted block of the reads.
+static int placeBits(uint32_t reads) {
 
-	// Read chromosome content
-	string info = "";
-	string row;
+	int bits = 0;
+	while(bits < 32 && (1u << bits) < reads)
+		bits++;
 
-	map<string, string> chromosomes;
+	return bits;
+}
 
-	getline(in_genome, row);
+// Codes the reads of the block sorted by chromosome code and start. Every read has its place in the block, its
+// chromosome code as the difference to that of the read before it and its alignment as in method B, the start
+// against that of the read before it on the same chromosome.
+static bool encodeSortedBlock(bit_file_c& out, const vector<Alignment>& block, const map<string, int>& chromosome_codes, long modal) {
 
-	string id = row.substr(1, row.find_first_of(' ')-1);
+	vector<int> codes(block.size());
+	vector<uint32_t> order(block.size());
 
-	while(getline(in_genome, row)) {
+	for(uint32_t i = 0; i < block.size(); i++) {
 
-		if(row.at(0) == '>') {
-			chromosomes[id] = info;
-			id = row.substr(1, row.find_first_of(' ')-1);
-			info = "";
-		}
-		else {
-			info.append(row);
+		map<string, int>::const_iterator code = chromosome_codes.find(block[i].getChromosome());
+
+		if(code == chromosome_codes.end()) {
+			cerr << "Error: chromosome " << block[i].getChromosome() << " is not in the reference!" << endl;
+			return false;
 		}
 
+		codes[i] = code->second;
+		order[i] = i;
+	}
+
+	sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y) {
+		return codes[x] != codes[y] ? codes[x] < codes[y] : startPosComp(block[x], block[y]);
+	});
+
+	int bits = placeBits(block.size());
+	int chromosome = 0;
+	long prevPos = 0;
+
+	for(uint32_t i = 0; i < order.size(); i++) {
+
+		const Alignment& a = block[order[i]];
+
+		out.PutBitsInt(&order[i], bits, sizeof(order[i]));
+		writeGammaCode(out, codes[order[i]] - chromosome);
+
+		if(codes[order[i]] != chromosome)
+			prevPos = 0;
 
+		chromosome = codes[order[i]];
+		writeAlignment(out, a, prevPos, modal, false);
+		prevPos = a.getStart();
 	}
 
-	chromosomes[id] = info;
+	return true;
+}
 
-	while(true) {
+// Decodes the place in the block and the alignment of the next read of a sorted block, key being the chromosome code
+// (above the lowest 32 bits) and start of the read before it, 0 at the start of the block.
+// Returns false if the block doesn't hold a valid read.
+static bool decodeSortedAlignment(bit_file_c& in, const vector<string>& chromosome_names, const BlockInfo& info, long& key, uint32_t& place, Alignment& a) {
 
-		// Get the values	
-		int chromosome_code = 0;
+	place = 0;
 
-		if((in.GetBitsInt(&chromosome_code, bits, sizeof(chromosome_code))) == EOF) {
-			out.close();
-			in.Close();
-			chromosome_codes.clear();
-			chromosomes.clear();
-			return true;
-		}
+	if(in.GetBitsInt(&place, placeBits(info.header.reads), sizeof(place)) == EOF)
+		return false;
 
-		string chromosome = "";
+	long chromosome = (key >> 32) + readGammaCode(in);
+	long prevPos = (chromosome == key >> 32) ? (key & 0xffffffffL) : 0;
 
-		map<string, int>::iterator it;
+	if(!in.good() || place >= info.header.reads || chromosome >= (long)chromosome_names.size() ||
+		!readAlignment(in, a, chromosome_names[chromosome], info.header.read_length, prevPos) || a.getStart() > 0xffffffffL)
+		return false;
 
-		for(it = chromosome_codes.begin(); it != chromosome_codes.end(); it++) {
-			if((it->second) == chromosome_code) {
-				chromosome = it->first;
-				break;
-			}
-		}
+	key = (chromosome << 32) | a.getStart();
+	return true;
+}
+
+// Decodes the reads of a sorted block into their places in the block.
+// Returns false if the block doesn't hold a valid read for every place.
+static bool decodeSortedBlock(bit_file_c& in, const vector<string>& chromosome_names, const map<string, string>& chromosomes, const BlockInfo& info, vector<string>& reads) {
+
+	reads.assign(info.header.reads, "");
+	vector<bool> decoded(info.header.reads, false);
+
+	long key = 0;
+	uint32_t place;
+	Alignment a;
+
+	for(uint32_t i = 0; i < info.header.reads; i++) {
 
-		if(chromosome == "") {
-			cerr << "Failure to decompress chromosome." << endl;
-			in.Close();
+		if(!decodeSortedAlignment(in, chromosome_names, info, key, place, a) || decoded[place] || !alignedSequence(a, chromosomes, reads[place]))
 			return false;
-		}
 
-		char strand;
+		decoded[place] = true;
+	}
+
+	return true;
+}
+
+// Compresses given alignment file.
+// Returns true on success and false if there were any problems.
+bool MethodA::compress_A(std::string inputfile, string outputfile, string genomefile, AlignmentReader::input_format_t format, bool append, bool sort_blocks) {
+
+	AlignmentReader* reader = new AlignmentReader(format, inputfile, genomefile);
+
+	bool ok = compress_A([reader](Alignment& a) { return reader->next(a); }, outputfile, genomefile, append, sort_blocks);
+
+	delete reader;
+
+	return ok;
+}
 
-		int i;
+bool MethodA::compress_A(std::function<bool(Alignment&)> next, string outputfile, string genomefile, bool append, bool sort_blocks, std::function<bool()> good) {
 
-		switch(i = in.GetBit()) {
+	const Reference& reference = load_reference(genomefile);
+	const map<string, int>& chromosome_codes = reference.getCodes();
 
-			case 0:
-				strand = 'R';
-				break;
-			case 1:
-				strand = 'F';
-				break;
-			case EOF:
-				out.close();
-				in.Close();
-				chromosome_codes.clear();
-				chromosomes.clear();
+	ArchiveWriter out;
+	ArchiveHeader header = archiveHeader('a', reference);
+	header.codecs = sort_blocks ? CODEC_SORTED_BLOCKS : 0;
+
+	if(append ? !out.append(outputfile, header) : !out.open(outputfile, header))
+		return false;
+
+	// Appended reads are coded like the ones already in the archive
+	bool sorted = (out.getHeader().codecs & CODEC_SORTED_BLOCKS) != 0;
+
+	// Find out how many bits needed for fixed length
+	int bits = ceil(log2(chromosome_codes.size()));
+
+	ThreadPool& pool = ThreadPool::shared();
+
+	// Reads are parsed here and the blocks are coded on the pool
+	bool ok = writeBlocks<vector<Alignment> >(out, pool,
+		[&next](vector<Alignment>& block) {
+			Alignment a;
+			while(block.size() < BLOCK_READS && next(a))
+				block.push_back(a);
+			return !block.empty();
+		},
+		[&chromosome_codes, bits, sorted](const vector<Alignment>& block, CodedBlock& coded) {
+			ostringstream stream;
+			bit_file_c block_out;
+			block_out.Open(stream);
+
+			vector<long> lengths;
+			for(unsigned i = 0; i < block.size(); i++)
+				lengths.push_back(block[i].getLength());
+			coded.header.read_length = modalLength(lengths);
+
+			coded.header.reads = block.size();
+			coded.header.chromosome = -1;
+
+			// Sorted blocks have small start deltas but no indexed reads, the block is decoded whole
+			if(sorted) {
+
+				if(!encodeSortedBlock(block_out, block, chromosome_codes, coded.header.read_length))
+					return false;
+
+				block_out.Close();
+				coded.data = stream.str();
+				coded.header.size = coded.data.size();
 				return true;
+			}
 
-		}
+			// Reads repeating a recent read are coded as how many reads back it is
+			vector<uint32_t> references;
+			coded.header.duplicates = backReferences(block, bits, coded.header.read_length, references);
 
-		long start = readGammaCode(in);
+			for(unsigned i = 0; i < block.size(); i++) {
 
-		if(start == -1) {
-			out.close();
-			in.Close();
-			chromosome_codes.clear();
-			chromosomes.clear();
-			return true;
-		}
+				// Index for random access by read number
+				if(i % READ_INDEX_INTERVAL == 0)
+					coded.checkpoints.push_back(block_out.TellBit());
 
-		long length = readGammaCode(in);
+				if(coded.header.duplicates > 0) {
 
-		if(length == -1) {
-			out.close();
-			in.Close();
-			chromosome_codes.clear();
-			chromosomes.clear();
-			return true;
-		}
+					block_out.PutBit(references[i] > 0 ? 1 : 0);
 
+					if(references[i] > 0) {
+						writeGammaCode(block_out, references[i] - 1);
+						continue;
+					}
+				}
 
-		vector<pair<int, char> > edits;
+				if(!encodeAlignment(block_out, block.at(i), chromosome_codes, bits, coded.header.read_length))
+					return false;
+			}
 
-		// Read how many edits there are
-		int edits_size = readGammaCode(in);
+			// Writes out the rest of byte, the next block starts byte aligned
+			block_out.Close();
 
-		if(edits_size == -1) {
-			out.close();
-			in.Close();
-			chromosome_codes.clear();
-			chromosomes.clear();
+			coded.data = stream.str();
+			coded.header.size = coded.data.size();
 			return true;
-		}
+		});
 
-		int pos = 0;
+	ok = ok && (!good || good());
 
-		// Read the edits
-		for(int i = 0; i < edits_size; i++) {
+	return out.close(ok) && ok;
 
-			pos += readGammaCode(in);
+}
 
-			int edit_number = 0;
-			char edit;
+// Decompresses given compressed file using given genome file.
+// Returns true on success and false if there were any problems.
+bool MethodA::decompress_A(std::string inputfile, std::string outputfile, std::string genomefile){
 
-			if(in.GetBitsInt(&edit_number, 4, sizeof(edit_number)) == EOF) {
-				cerr << "Failure to decompress edits." << endl;
-				return false;
-			}
+	ofstream file;
+	ostream& out = open_output(outputfile, file);
+	ArchiveReader in;
 
-			// Returning the edits to form supported by Alignment object isn't necessary for reconstructing the sequence, 
-			// but it will come in handy if user wants the alignment returned too (future development?)
-			switch(edit_number) {
-
-				case mismatch_A:
-					edit = 'A';
-					break;
-				case mismatch_C:
-					edit = 'C';
-					break;
-				case mismatch_G:
-					edit = 'G';
-					break;
-				case mismatch_T:
-					edit = 'T';
-					break;
-				case insertion_A:
-					edit = 'a';
-					break;
-				case insertion_C:
-					edit = 'c';
-					break;
-				case insertion_G:
-					edit = 'g';
-					break;
-				case insertion_T:
-					edit = 't';
-					break;
-				case deletion:
-					edit = 'D';
-					break;
-			}
+	if(!in.open(inputfile)) {
+		cerr << "Failure to open the archive." << endl;
+		return false;
+	}
 
-			edits.push_back(make_pair(pos, edit));
+	if(!out){
+		cerr << "Failure to open the outputfile." << endl;
+		return false;
+	}
 
-		}
+	// Reconstruct the codes for chromosomes
+	const Reference& reference = load_reference(genomefile);
 
-		// Reconstruct the data
+	if(!checkArchive(in, reference, "a"))
+		return false;
 
-		string data = "";
+	const map<string, int>& chromosome_codes = reference.getCodes();
+	const vector<string>& names = reference.getNames();
 
-		if(chromosome != "*" && start != 0 && length != 0)
-			data = chromosomes[chromosome].substr(start-1, length);
+	// Find out how many bits needed for fixed length
+	int bits = ceil(log2(chromosome_codes.size()));
 
-		// There's possibility that trailing zeros cause "valid" looking alignment, check!
-		if(chromosome != "*" && ((start == 0) | (length == 0))) {
-			out.close();
-			in.Close();
-			chromosome_codes.clear();
-			chromosomes.clear();
-			return true;
-		}
+	// Read chromosome content
+	const map<string, string>& chromosomes = reference.getChromosomes();
 
-		// Indels can mess up the indexes. Offset keeps track of them.
-		int offset = 0;
-
-		for(int i = 0; i < edits.size(); i++) {
-
-			switch(edits.at(i).second) {
-
-				case 'A':
-					data[edits.at(i).first+offset] = 'A';	
-					break;
-				case 'C':
-					data[edits.at(i).first+offset] = 'C';
-					break;
-				case 'G':
-					data[edits.at(i).first+offset] = 'G';
-					break;
-				case 'T':
-					data[edits.at(i).first+offset] = 'T';
-					break;
-				case 'a':
-				{
-					if((data.length() > 0) && (edits.at(i).first != 0) && (edits.at(i).first < data.length())) {
-						data = data.substr(0,edits.at(i).first+offset) + "A" + data.substr(edits.at(i).first+offset, data.length());
-						offset++;
-					}
-					else if((data.length() > 0) && (edits.at(i).first == 0)) {
-						data = "A" + data.substr(edits.at(i).first+offset, data.length());
-						offset++;
-					}
-					else if((data.length() > 0) && (edits.at(i).first == data.length())) {
-						data = data.substr(0,edits.at(i).first+offset) + "A";
-						offset++;						
-					}
-					else {
-						data = "A";
-					}
-					break;
-				}
+	ThreadPool& pool = ThreadPool::shared();
+	bool sorted = (in.getHeader().codecs & CODEC_SORTED_BLOCKS) != 0;
 
-				case 'c':
-				{
-					if((data.length() > 0) && (edits.at(i).first != 0) && (edits.at(i).first < data.length())) {
-						data = data.substr(0,edits.at(i).first+offset) + "C" + data.substr(edits.at(i).first+offset, data.length());
-						offset++;
-					}
-					else if((data.length() > 0) && (edits.at(i).first == 0)) {
-						data = "C" + data.substr(edits.at(i).first+offset, data.length());
-						offset++;
-					}
-					else if((data.length() > 0) && (edits.at(i).first == data.length())) {
-						data = data.substr(0,edits.at(i).first+offset) + "C";
-						offset++;						
-					}
-					else {
-						data = "C";
-					}
-					break;
-				}
+	// Blocks are decoded on the pool into buffers of their own and written in order
+	bool ok = readBlocks<string>(in, pool,
+		[&names, &chromosomes, bits, sorted](const BlockInfo& info, const string& block, string& output) {
+			istringstream stream(block);
+			bit_file_c block_in;
+			block_in.Open(stream);
 
-				case 'g':
-				{
-					if((data.length() > 0) && (edits.at(i).first != 0) && (edits.at(i).first < data.length())) {
-						data = data.substr(0,edits.at(i).first+offset) + "G" + data.substr(edits.at(i).first+offset, data.length());
-						offset++;
-					}
-					else if((data.length() > 0) && (edits.at(i).first == 0)) {
-						data = "G" + data.substr(edits.at(i).first+offset, data.length());
-						offset++;
-					}
-					else if((data.length() > 0) && (edits.at(i).first == data.length())) {
-						data = data.substr(0,edits.at(i).first+offset) + "G";
-						offset++;						
-					}
-					else {
-						data = "G";
-					}
-					break;
+			// The reads of a sorted block are scattered back to their places
+			if(sorted) {
+
+				vector<string> reads;
+
+				if(!decodeSortedBlock(block_in, names, chromosomes, info, reads)) {
+					cerr << "Failure to decompress reads " << info.first_read + 1 << "-" << info.first_read + info.header.reads << "." << endl;
+					return false;
 				}
-				case 't':
-				{
-					if((data.length() > 0) && (edits.at(i).first != 0) && (edits.at(i).first < data.length())) {
-						data = data.substr(0,edits.at(i).first+offset) + "T" + data.substr(edits.at(i).first+offset, data.length());
-						offset++;
-					}
-					else if((data.length() > 0) && (edits.at(i).first == 0)) {
-						data = "T" + data.substr(edits.at(i).first+offset, data.length());
-						offset++;
-					}
-					else if((data.length() > 0) && (edits.at(i).first == data.length())) {
-						data = data.substr(0,edits.at(i).first+offset) + "T";
-						offset++;						
-					}
-					else {
-						data = "T";
-					}
-					break;
+
+				for(uint32_t i = 0; i < reads.size(); i++) {
+					output += reads[i];
+					output += '\n';
 				}
-				case 'D':
-				{
-					data = data.substr(0,edits.at(i).first+offset) + data.substr(edits.at(i).first+offset+1, data.length());
-					offset--;
-					break;
+
+				return true;
+			}
+
+			// Reads since the last indexed one, for the back-references
+			vector<string> recent(READ_INDEX_INTERVAL);
+
+			for(uint32_t i = 0; i < info.header.reads; i++) {
+
+				if(!decodeRecent(block_in, names, chromosomes, bits, info, i, recent)) {
+					cerr << "Failure to decompress read " << info.first_read + i + 1 << "." << endl;
+					return false;
 				}
+
+				output += recent[i % READ_INDEX_INTERVAL];
+				output += '\n';
 			}
-		}
 
-		if(strand == 'R') {
-			revstr(data);
-			complement(data);
-		}
+			return true;
+		},
+		[&out](const string& output) {
+			out.write(output.data(), output.size());
+			return out.good();
+		});
 
-		out << data << endl;
-		edits.clear();
+	out.flush();
+
+	if(!ok || !out) {
+		cerr << "Failure to decompress the archive." << endl;
+		return false;
 	}
 
 	return true;
 }
+
+// Decompresses reads first..last of given compressed file using given genome file.
+// Returns true on success and false if there were any problems.
+bool MethodA::extract_A(std::string inputfile, std::string outputfile, std::string genomefile, long first, long last){
+
+	ofstream file;
+	ostream& out = open_output(outputfile, file);
+	ArchiveReader in;
+
+	if(!in.open(inputfile)) {
+		cerr << "Failure to open the archive." << endl;
+		return false;
+	}
+
+	if(!in.seekable()) {
+		cerr << "Decompressing a range of reads needs the archive as a file." << endl;
+		return false;
+	}
+
+	if(!out){
+		cerr << "Failure to open the outputfile." << endl;
+		return false;
+	}
+
+	const Reference& reference = load_reference(genomefile);
+
+	if(!checkArchive(in, reference, "a"))
+		return false;
+
+	const map<string, int>& chromosome_codes = reference.getCodes();
+	const vector<string>& names = reference.getNames();
+	int bits = ceil(log2(chromosome_codes.size()));
+	const map<string, string>& chromosomes = reference.getChromosomes();
+	bool sorted = (in.getHeader().codecs & CODEC_SORTED_BLOCKS) != 0;
+
+	bool ok = readReadRange(in, first - 1, last - 1,
+		[&](const BlockInfo& info, bit_file_c& block_in, uint32_t skip, uint32_t count) {
+			// Sorted blocks are decoded whole, skip counts from the start of the block
+			if(sorted) {
+
+				vector<string> reads;
+
+				if(!decodeSortedBlock(block_in, names, chromosomes, info, reads))
+					return false;
+
+				for(uint32_t i = skip; i < skip + count; i++)
+					out << reads[i] << '\n';
+
+				return out.good();
+			}
+
+			// Decoding starts at an indexed read, which back-references don't reach past
+			vector<string> recent(READ_INDEX_INTERVAL);
+
+			for(uint32_t i = 0; i < skip + count; i++) {
+
+				if(!decodeRecent(block_in, names, chromosomes, bits, info, i, recent))
+					return false;
+
+				if(i >= skip)
+					out << recent[i % READ_INDEX_INTERVAL] << '\n';
+			}
+
+			return out.good();
+		});
+
+	out.flush();
+
+	if(!ok || !out) {
+		cerr << "Failure to decompress the archive." << endl;
+		return false;
+	}
+
+	return true;
+}
+
+RecordReader<Alignment>::Decoder MethodA::decoder_A(const vector<string>& names, uint32_t codecs) {
+
+	int bits = ceil(log2(names.size()));
+
+	// prevPos keeps the chromosome code and start of the previous read of a sorted block
+	if(codecs & CODEC_SORTED_BLOCKS) {
+		return [&names](const BlockInfo& info, bit_file_c& in, uint32_t, Alignment& a, long& prevPos, long&, long&) {
+			uint32_t place;
+			return decodeSortedAlignment(in, names, info, prevPos, place, a);
+		};
+	}
+
+	return [&names, bits](const BlockInfo& info, bit_file_c& in, uint32_t index, Alignment& a, long&, long& repeats, long& distance) {
+		long reference = info.header.duplicates > 0 ? readReference(in) : 0;
+
+		// Back-references reach back only to the last indexed read, as in decodeRecent
+		if(reference > (long)(index % READ_INDEX_INTERVAL))
+			return false;
+
+		// A back-reference is a repeat of the read it refers to
+		if(reference > 0) {
+			repeats = 1;
+			distance = reference;
+			return true;
+		}
+
+		return reference == 0 && decodeAlignment(in, names, bits, info.header.read_length, a);
+	};
+}
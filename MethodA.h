@@ -10,16 +10,32 @@
 #include <cstdlib>
 #include <string>
 #include <cstring>
+#include <functional>
 #include "AlignmentReader.h"
+#include "Merge.h"
 
 class MethodA {
 
 public:
 
-	static bool compress_A(std::string inputfile, std::string outputfile, std::string genomefile);
+	static bool compress_A(std::string inputfile, std::string outputfile, std::string genomefile, AlignmentReader::input_format_t format = AlignmentReader::input_tabdelimited, bool append = false, bool sort_blocks = false);
+
+	/* Compresses the alignments given by next(a), which returns false after the last one. With sort_blocks the reads
+	 * of every block are coded sorted by position with their places in the block (CODEC_SORTED_BLOCKS), appended
+	 * reads are coded the way the reads already in the archive are. After the last alignment good() tells if the input
+	 * was read whole, an archive appended to is left as it was if not. */
+	static bool compress_A(std::function<bool(Alignment&)> next, std::string outputfile, std::string genomefile, bool append = false, bool sort_blocks = false, std::function<bool()> good = std::function<bool()>());
+
+	/* Decoder of the records of the archive with the codecs into alignments without the reference sequences, names
+	 * are the names of the chromosome codes and need to outlive the decoder. The records of sorted blocks come in
+	 * their sorted order. */
+	static RecordReader<Alignment>::Decoder decoder_A(const std::vector<std::string>& names, uint32_t codecs);
 
 	static bool decompress_A(std::string inputfile, std::string outputfile, std::string genomefile);
 
+	/* Decompresses reads first..last (1-based) without decoding the blocks before them. */
+	static bool extract_A(std::string inputfile, std::string outputfile, std::string genomefile, long first, long last);
+
 };
 
 #endif //_MethodA_H_
@@ -3,85 +3,351 @@
 #include <cmath>
 #include "Alignment.h"
 #include "AlignmentReader.h"
+#include "Archive.h"
+#include "Merge.h"
+#include "ThreadPool.h"
 #include <algorithm>
 #include <vector>
+#include <map>
+#include <sstream>
 
 #include "utils.h"
 #include "MethodB.h"
 
 // @author Johannes Ylinen
 
-bool MethodB::compress(std::string infile, string outputfile, string genomefile) 
+// Sorts the alignments and compresses them into the archive
+static bool writeSorted(std::vector<Alignment>& alignments, string outputfile, string genomefile)
+{
+	std::sort(alignments.begin(), alignments.end(), startPosComp); // If pre-sorted wouldn't need so much memory
+
+	const Reference& reference = load_reference(genomefile);
+	const std::map<std::string, int>& chromosome_codes = reference.getCodes();
+
+	ArchiveWriter out;
+	if(!out.open(outputfile, archiveHeader('b', reference)))
+		return false;
+	ThreadPool& pool = ThreadPool::shared();
+
+	// Blocks are ranges of the sorted alignments, each on one chromosome
+	size_t next = 0;
+
+	bool ok = writeBlocks<std::pair<size_t, size_t> >(out, pool,
+		[&alignments, &next](std::pair<size_t, size_t>& block) {
+			block.first = next;
+			while(next < alignments.size() && next - block.first < BLOCK_READS &&
+				alignments[next].getChromosome() == alignments[block.first].getChromosome())
+				++next;
+			block.second = next;
+			return block.first < block.second;
+		},
+		[&alignments, &chromosome_codes](const std::pair<size_t, size_t>& block, CodedBlock& coded) {
+			std::map<std::string, int>::const_iterator code = chromosome_codes.find(alignments[block.first].getChromosome());
+			if(code == chromosome_codes.end()) {
+				std::cerr << "Error: chromosome " << alignments[block.first].getChromosome() << " is not in the reference!" << std::endl;
+				return false;
+			}
+
+			std::ostringstream stream;
+			bit_file_c block_out;
+			block_out.Open(stream);
+
+			// Reference range of the block for region queries
+			coded.first_position = alignments[block.first].getStart();
+
+			std::vector<long> lengths;
+			for(size_t i = block.first; i < block.second; ++i)
+				lengths.push_back(alignments[i].getLength());
+			coded.header.read_length = modalLength(lengths);
+			coded.header.duplicates = duplicateRuns<Alignment>(alignments, block.first, block.second,
+				[&coded](const Alignment& a, long prevPos) { return alignmentCodeLength(a, prevPos, coded.header.read_length); },
+				[](const Alignment& a) { return a.getStart(); });
+
+			long prevPos = 0;
+			for(size_t i = block.first; i < block.second; ++i)
+			{
+				// Duplicates of the previous read are coded as one run
+				size_t run = i;
+				while(coded.header.duplicates > 0 && i > block.first && run < block.second && sameAlignment(alignments[run], alignments[i - 1]))
+					++run;
+				if(run > i)
+				{
+					writeDuplicates(block_out, run - i);
+					i = run - 1;
+					continue;
+				}
+
+				writeAlignment(block_out, alignments[i], prevPos, coded.header.read_length, coded.header.duplicates > 0);
+				prevPos = alignments[i].getStart();
+				if(alignments[i].getStart() > 0)
+					coded.last_position = std::max<uint64_t>(coded.last_position, alignments[i].getStart() + alignments[i].getLength() - 1);
+			}
+
+			block_out.Close();
+
+			coded.data = stream.str();
+			coded.header.size = coded.data.size();
+			coded.header.reads = block.second - block.first;
+			coded.header.chromosome = code->second;
+			return true;
+		});
+
+	return out.close() && ok;
+}
+
+bool MethodB::compress(std::string infile, string outputfile, string genomefile, AlignmentReader::input_format_t format) 
 {
 	std::vector<Alignment> alignments;
 
-	readAllAlignments(alignments, infile);
-	std::cout << "Found " << alignments.size() << " alignments.\n";
-	std::sort(alignments.begin(), alignments.end(), startPosComp); // If pre-sorted wouldn't need so much memory
+	readAllAlignments(alignments, infile, format, genomefile);
+	std::cerr << "Found " << alignments.size() << " alignments.\n";
 
-	bit_file_c out;
-	/* open bit file for writing */
-	try { out.Open(outputfile.c_str(), BF_WRITE); }
-	catch (...) { return false; }
+	return writeSorted(alignments, outputfile, genomefile);
+}
 
-	long prevPos = 0;
-	for(size_t i = 0; i < alignments.size(); ++i)
+bool MethodB::compress(std::function<bool(Alignment&)> next, string outputfile, string genomefile)
+{
+	// Sorted runs of SORT_RUN_READS alignments are compressed to temporary archives and merged
+	std::string prefix = temporary_prefix();
+	std::vector<std::string> runs;
+	bool ok = true;
+
+	while(ok)
 	{
-		writeAlignment(out, alignments[i], prevPos);
-		prevPos = alignments[i].getStart();
+		std::vector<Alignment> alignments;
+		Alignment a;
+		while(alignments.size() < SORT_RUN_READS && next(a))
+			alignments.push_back(a);
+
+		// Everything fit in one run
+		if(runs.empty() && alignments.size() < SORT_RUN_READS)
+			return writeSorted(alignments, outputfile, genomefile);
+
+		if(alignments.empty())
+			break;
+
+		runs.push_back(prefix + ".run." + std::to_string(runs.size()));
+		ok = writeSorted(alignments, runs.back(), genomefile);
 	}
 
-	out.Close();
-	return true;
+	ok = ok && merge(runs, outputfile);
+
+	for(size_t i = 0; i < runs.size(); ++i)
+		std::remove(runs[i].c_str());
+
+	return ok;
+}
+
+RecordReader<Alignment>::Decoder MethodB::decoder(const std::vector<std::string>& names)
+{
+	return [&names](const BlockInfo& info, bit_file_c& in, uint32_t, Alignment& a, long& prevPos, long& repeats, long&) {
+		if(info.header.chromosome < 0 || info.header.chromosome >= (int)names.size() || !readAlignment(in, a, names[info.header.chromosome], info.header.read_length, prevPos, info.header.duplicates > 0 ? &repeats : NULL))
+			return false;
+		if(repeats == 0)
+			prevPos = a.getStart();
+		return true;
+	};
 }
 
 
 bool MethodB::decompress(std::string inputfile, std::string outputfile, std::string genomefile)
 {
-	ofstream out(outputfile.c_str());
-	bit_file_c in;
-	ifstream in_genome(genomefile.c_str());
+	ofstream file;
+	ostream& out = open_output(outputfile, file);
+	ArchiveReader in;
 
-	std::string refSeq;
+	const Reference& reference = load_reference(genomefile);
+	const std::vector<std::string>& names = reference.getNames();
+	const std::map<std::string, std::string>& chromosomes = reference.getChromosomes();
 
-	while(true)
+	if(!in.open(inputfile))
 	{
-		std::string temp;
-		getline(in_genome, temp);
-		if(!in_genome) break;
-		if(temp[0] != '>')
-			refSeq += temp;
+		cerr << "Failure to open the archive." << endl;
+		return false;
 	}
 
-	try
+	if(!checkArchive(in, reference, "b"))
+		return false;
+
+	if(!out){
+		cerr << "Failure to open the outputfile." << endl;
+		return false;
+	}
+
+	ThreadPool& pool = ThreadPool::shared();
+
+	// Blocks are decoded on the pool into buffers of their own and written in order
+	bool ok = readBlocks<std::string >(in, pool,
+		[&names, &chromosomes](const BlockInfo& info, const std::string& block, std::string& output) {
+			if(info.header.chromosome < 0 || info.header.chromosome >= (int)names.size())
+			{
+				cerr << "Failure to decompress chromosome." << endl;
+				return false;
+			}
+
+			// Unaligned reads have no reference
+			static const std::string none;
+			std::map<std::string, std::string>::const_iterator chromosome = chromosomes.find(names[info.header.chromosome]);
+			const std::string& refSeq = (chromosome != chromosomes.end()) ? chromosome->second : none;
+
+			std::istringstream stream(block);
+			bit_file_c block_in;
+			block_in.Open(stream);
+
+			long prevPos = 0, repeats = 0;
+			std::string read;
+			for(uint32_t i = 0; i < info.header.reads; ++i)
+			{
+				// Duplicates repeat the read decoded last
+				if(repeats == 0)
+					prevPos = getRead(block_in, refSeq, read, info.header.read_length, prevPos, NULL, info.header.duplicates > 0 ? &repeats : NULL);
+				if(prevPos < 0 || (repeats > 0 && i == 0))
+				{
+					cerr << "Failure to decompress read." << endl;
+					return false;
+				}
+				if(repeats > 0)
+					--repeats;
+				// Numbering continues from the previous blocks
+				output += ">Read_" + std::to_string(info.first_read + i + 1) + '\n';
+				output += read + '\n';
+			}
+
+			return true;
+		},
+		[&out](const std::string& output) {
+			out.write(output.data(), output.size());
+			return out.good();
+		});
+
+	out.flush();
+
+	if(!ok || !out)
+	{
+		cerr << "Failure to decompress the archive." << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool MethodB::extract(std::string inputfile, std::string outputfile, std::string genomefile, std::string chromosome, long from, long to)
+{
+	ofstream file;
+	ostream& out = open_output(outputfile, file);
+	ArchiveReader in;
+
+	const Reference& reference = load_reference(genomefile);
+	const std::map<std::string, int>& chromosome_codes = reference.getCodes();
+	std::map<std::string, int>::const_iterator code = chromosome_codes.find(chromosome);
+
+	if(code == chromosome_codes.end())
+	{
+		cerr << "Chromosome " << chromosome << " is not in the reference." << endl;
+		return false;
+	}
+
+	if(!in.open(inputfile))
 	{
-		in.Open(inputfile.c_str(), BF_READ);
+		cerr << "Failure to open the archive." << endl;
+		return false;
 	}
-	catch (...)
+
+	if(!checkArchive(in, reference, "b"))
+		return false;
+
+	if(!in.seekable())
 	{
-		cerr << "Failure to open the bitfile." << endl;
+		cerr << "Decompressing a region needs the archive as a file." << endl;
 		return false;
 	}
 
-	if(!out.is_open()){
+	if(!out){
 		cerr << "Failure to open the outputfile." << endl;
 		return false;
 	}
 
-	long prevPos = 0;
-	long readNumber = 1;
-	while(true)
+	// Unaligned reads have no positions, all of them are in the region of "*"
+	bool unaligned = (chromosome == "*");
+	std::vector<BlockInfo> blocks = unaligned ? regionBlocks(in, code->second, 0, 0) : regionBlocks(in, code->second, from, to);
+
+	// The sequences are only read if there are aligned reads to decode
+	static const std::string none;
+	std::map<std::string, std::string>::const_iterator sequence;
+	bool found = !unaligned && !blocks.empty() && (sequence = reference.getChromosomes().find(chromosome)) != reference.getChromosomes().end();
+	const std::string& refSeq = found ? sequence->second : none;
+
+	for(size_t b = 0; b < blocks.size(); ++b)
 	{
+		std::string block;
+		if(!in.readBlock(blocks[b], block))
+		{
+			cerr << "The archive is truncated." << endl;
+			return false;
+		}
+
+		std::istringstream stream(block);
+		bit_file_c block_in;
+		block_in.Open(stream);
+
+		long prevPos = 0, span = 0, repeats = 0;
 		std::string read;
-		prevPos = getRead(in, refSeq, read, prevPos);
-		if(prevPos < 0)
-			break;
-		if(read.length() > 0)
+		for(uint32_t i = 0; i < blocks[b].header.reads; ++i)
 		{
-			out << ">Read_" << readNumber++ << '\n';
-			out << read << '\n';
+			// Duplicates repeat the read decoded last
+			if(repeats == 0)
+				prevPos = getRead(block_in, refSeq, read, blocks[b].header.read_length, prevPos, &span, blocks[b].header.duplicates > 0 ? &repeats : NULL);
+			if(prevPos < 0 || (repeats > 0 && i == 0))
+			{
+				cerr << "Failure to decompress read." << endl;
+				return false;
+			}
+			if(repeats > 0)
+				--repeats;
+
+			// Reads are sorted by start, the rest of the block is past the region
+			if(!unaligned && prevPos > to)
+				break;
+
+			if(unaligned || prevPos + span - 1 >= from)
+			{
+				out << ">Read_" << blocks[b].first_read + i + 1 << '\n';
+				out << read << '\n';
+			}
 		}
 	}
 
-	return true;
+	out.flush();
+
+	return out.good();
+}
+
+bool MethodB::merge(const std::vector<std::string>& inputfiles, std::string outputfile)
+{
+	return mergeArchives<Alignment>('b', inputfiles, outputfile,
+		[](const BlockInfo& info, bit_file_c& in, uint32_t, Alignment& a, long& prevPos, long& repeats, long&) {
+			if(!readAlignment(in, a, "", info.header.read_length, prevPos, info.header.duplicates > 0 ? &repeats : NULL))
+				return false;
+			if(repeats == 0)
+				prevPos = a.getStart();
+			return true;
+		},
+		[](bit_file_c& out, const Alignment& a, long prevPos, CodedBlock& coded) {
+			writeAlignment(out, a, prevPos, coded.header.read_length, coded.header.duplicates > 0);
+			if(a.getStart() > 0)
+				coded.last_position = std::max<uint64_t>(coded.last_position, a.getStart() + a.getLength() - 1);
+		},
+		[](const std::vector<Alignment>& block, BlockHeader& header) {
+			std::vector<long> lengths;
+			for(size_t i = 0; i < block.size(); ++i)
+				lengths.push_back(block[i].getLength());
+			header.read_length = modalLength(lengths);
+		},
+		[](const Alignment& a, long prevPos, const BlockHeader& header) {
+			return alignmentCodeLength(a, prevPos, header.read_length);
+		},
+		[](const Alignment& a) {
+			return a.getStart();
+		},
+		startPosComp);
 }
@@ -1,7 +1,18 @@
 #pragma once
 
+#include "Merge.h"
+
 namespace MethodB
 {
-	bool compress(std::string infile, string outputfile, std::string genomefile);
+	bool compress(std::string infile, string outputfile, std::string genomefile, AlignmentReader::input_format_t format = AlignmentReader::input_tabdelimited);
+	/* Compresses the alignments given by next(a), which returns false after the last one. They are sorted in runs
+	 * of SORT_RUN_READS alignments that are merged, so that they don't all need to fit in memory. */
+	bool compress(std::function<bool(Alignment&)> next, std::string outputfile, std::string genomefile);
 	bool decompress(std::string inputfile, std::string outputfile, std::string genomefile);
+	bool extract(std::string inputfile, std::string outputfile, std::string genomefile, std::string chromosome, long from, long to);
+	/* Decoder of the records of the archive into alignments without the reference sequences, names are the names of
+	 * the chromosome codes and need to outlive the decoder. */
+	RecordReader<Alignment>::Decoder decoder(const std::vector<std::string>& names);
+	/* Merges sorted archives of the method into one without the reference, see Merge.h. */
+	bool merge(const std::vector<std::string>& inputfiles, std::string outputfile);
 }
@@ -1,529 +1,498 @@
 #include "MethodC.h"
 #include "Alignment.h"
 #include "AlignmentReader.h"
+#include "Archive.h"
+#include "ThreadPool.h"
 #include "bitfile.h"
 #include "utils.h"
 
 #include <map>
 #include <cmath>
+#include <sstream>
 
 using namespace std;
 
-// Compresses given alignment files.
-// Returns true on success and false if there were any problems.
-bool MethodC::compress_C(string first_inputfile, string second_inputfile, string outputfile, string genomefile) {
+// Codes the pair: chromosome code, then strand, start, length and edits of both mates. The strand and start of the second
+// mate are coded relative to the first, as the orientation of the pair against the orientations of the block (see
+// writeMateOrientation) and the distance against the insert size of the block (see writeMateDistance). The lengths
+// are coded against the modal length of the block.
+static bool encodePair(bit_file_c& out, const Alignment& a_1, const Alignment& a_2, const map<string, int>& chromosome_codes, int bits, const BlockHeader& header) {
 
-	AlignmentReader* first_reader = new AlignmentReader(AlignmentReader::input_tabdelimited, first_inputfile);
-	AlignmentReader* second_reader = new AlignmentReader(AlignmentReader::input_tabdelimited, second_inputfile);
+	map<string, int>::const_iterator code = chromosome_codes.find(a_1.getChromosome());
 
-	Alignment a_1;
-	Alignment a_2;
+	if(code == chromosome_codes.end()) {
+		cerr << "Error: chromosome " << a_1.getChromosome() << " is not in the reference!" << endl;
+		return false;
+	}
 
-	bit_file_c out;
+	// Output code for chromosome
+	int chrom_code = code->second;
 
-    /* open bit file for writing */
-    try
-    {
-        out.Open(outputfile.c_str(), BF_WRITE);
-    }
-    catch (...)
-    {
-        return false;
-    }
+	if(out.PutBitsInt(&chrom_code, bits, sizeof(chrom_code)) == EOF) {
+		cerr << "Error: writing chromosome code!" << endl;
+		return false;
+	}
 
-	map<string, int> chromosome_codes = code_chromosomes(genomefile);
+	for(int mate = 1; mate <= 2; mate++) {
 
-	// Find out how many bits needed for fixed length
-	int bits = ceil(log2(chromosome_codes.size()));
+		const Alignment& a = (mate == 1) ? a_1 : a_2;
 
-	while(first_reader->next(a_1)) {
+		if(mate == 1) {
 
-		if(!(second_reader->next(a_2))) {
+			// Output code for strand
+			int value;
 
-			cerr << "Second inputfile ended before the first, error in syncronizing the alignments." << endl;
-			return false;
+			if(a.getStrand() == 'R')
+				value = 0;
+			else
+				value = 1;
 
+			if(out.PutBit(value) == EOF) {
+				cerr << "Error: writing strand!" << endl;
+				return false;
+			}
+
+			writeGammaCode(out, a_1.getStart());
 		}
+		else {
+			writeMateOrientation(out, a_1, a_2, header.orientations);
 
-		// Sanity check that pairs have been aligned correctly
-		if((a_1.getChromosome() != a_2.getChromosome()) && (a_2.getStart() > a_1.getStart())) {
+			// Unaligned pairs have both mates at 0, without a distance
+			if(a_1.getStart() > 0)
+				writeMateDistance(out, a_2.getStart() - a_1.getStart(), header.insert_size, header.insert_rice);
+		}
 
-			cerr << "Mates have different chromosome, please check the alignment for read " << a_1.getName() << "." << endl;
-			return false;
+		writeLength(out, a.getLength(), header.read_length);
 
-		}
+		// Output codes for the edits (position with gamma code and the edits with fixed length)
+		// Output of readaligner codes mismatches with ACGT and insertions with acgt
+		const vector<pair<int,char> >& edits = a.getEdits();
 
-		// Output code for chromosome
-		int chrom_code = chromosome_codes[a_1.getChromosome()];
+		int size = edits.size();
 
-		if(out.PutBitsInt(&chrom_code, bits, sizeof(chrom_code)) == EOF) {
-			cerr << "Error: writing chromosome code!" << endl;
-			return false;
-		}
+		int previous = 0;
 
-		for(int mate = 1; mate <= 2; mate++) {
+		// Number of edits first that know how many to read back
+		writeGammaCode(out, size);
 
-			// Output code for strand
-			int value;
+		for(int i = 0; i < size; i++) {
 
-			if(mate == 1) {
-				if(a_1.getStrand() == 'R')
-					value = 0;
-				else
-					value = 1;
-			}
-			else {
-				if(a_2.getStrand() == 'R')
-					value = 0;
-				else
-					value = 1;
-			}
-			if(out.PutBit(value) == EOF) {
-				cerr << "Error: writing strand!" << endl;
+			int edit_value = getEditCode(edits.at(i).second);
+
+			if(edit_value == -1) {
+				cerr << "Error: writing edits!" << endl;
 				return false;
 			}
 
-			vector<pair<int,char> > edits;
+			writeEditOp(out, edits.at(i).first-previous, edit_value);
 
+			previous = edits.at(i).first;
+		}
+	}
 
-			if(mate == 1) {
-				writeGammaCode(out, a_1.getStart());
-				writeGammaCode(out, a_1.getLength());
-			}
-			else {
-				writeGammaCode(out, a_2.getStart() - a_1.getStart());
-				writeGammaCode(out, a_2.getLength());
-			}
+	return true;
+}
 
-			// Output codes for the edits (position with gamma code and the edits with fixed length)
-			// Output of readaligner codes mismatches with ACGT and insertions with acgt
-			if(mate == 1)
-				edits = a_1.getEdits();
-			else
-				edits = a_2.getEdits();
-
-			int size = edits.size();
-
-			int previous = 0;
-
-			// Number of edits first that know how many to read back
-			writeGammaCode(out, size);
-
-			for(int i = 0; i < size; i++) {
-
-				writeGammaCode(out, edits.at(i).first-previous);
-
-				previous = edits.at(i).first;
-
-				int edit_value = 0;
-
-				switch(edits.at(i).second) {
-
-					case 'A':
-						edit_value = mismatch_A;
-						break;
-					case 'C':
-						edit_value = mismatch_C;
-						break;
-					case 'G':
-						edit_value = mismatch_G;
-						break;
-					case 'T':
-						edit_value = mismatch_T;
-						break;
-					case 'a':
-						edit_value = insertion_A;
-						break;
-					case 'c':
-						edit_value = insertion_C;
-						break;
-					case 'g':
-						edit_value = insertion_G;
-						break;
-					case 't':
-						edit_value = insertion_T;
-						break;
-					case 'D':
-						edit_value = deletion;
-						break;
-				}
+// Decodes the alignments of the next pair of the block without reconstructing the reads.
+// Returns false if the block doesn't hold a valid pair.
+static bool decodeAlignments(bit_file_c& in, const vector<string>& chromosome_names, int bits, const BlockHeader& header, Alignment& a_1, Alignment& a_2) {
 
-				if(out.PutBitsInt(&edit_value, 4, sizeof(edit_value)) == EOF) {
-					cerr << "Error: writing edits!" << endl;
-					return false;
-				}
+	// Get the values
+	int chromosome_code = 0;
+
+	if((in.GetBitsInt(&chromosome_code, bits, sizeof(chromosome_code))) == EOF)
+		return false;
+
+	if(chromosome_code < 0 || chromosome_code >= (int)chromosome_names.size()) {
+		cerr << "Failure to decompress chromosome." << endl;
+		return false;
+	}
+
+	const string& chromosome = chromosome_names.at(chromosome_code);
+
+	long start = 0;
+	char strand = 0;
+
+	for(int mate = 1; mate <= 2; mate++) {
+
+		// For first mate, strand and start are coded
+		if(mate == 1) {
+
+			switch(in.GetBit()) {
 
+				case 0:
+					strand = 'R';
+					break;
+				case 1:
+					strand = 'F';
+					break;
+				default:
+					return false;
 			}
 
-			edits.clear();
+			start = readGammaCode(in);
+		}
+		// For second, they're relative to the first mate
+		else {
+			long direction, distance = 0;
+
+			if(!readMateOrientation(in, header.orientations, strand, start, strand, direction) ||
+				(start > 0 && !readMateDistance(in, header.insert_size, header.insert_rice, distance)) || start + direction * distance < 0)
+				return false;
 
+			start += direction * distance;
 		}
 
-	}
+		long length = readLength(in, header.read_length);
 
-	// Check that there's nothing left in second inputfile
-	if(second_reader->next(a_2)) {
+		// Read how many edits there are
+		long edits_size = readGammaCode(in);
 
-		cerr << "First input file ended before the second, error in syncronizing the alignments." << endl;
-		return false;
+		if(!in.good())
+			return false;
 
-	}
+		vector<pair<int, char> > edits;
 
-	delete first_reader;
-	delete second_reader;
-	out.Close();
+		long pos = 0;
 
-	return true;
+		// Read the edits
+		for(long i = 0; i < edits_size; i++) {
 
-}
+			pair<long, int> edit = readEditOp(in);
 
-// Decompresses given compressed file using given genome file.
-// Returns true on success and false if there were any problems.
-bool MethodC::decompress_C(std::string inputfile, std::string first_outputfile, std::string second_outputfile, std::string genomefile){
+			if(!in.good() || getEditChar(edit.second) == 0) {
+				cerr << "Failure to decompress edits." << endl;
+				return false;
+			}
 
-	ofstream out_1(first_outputfile.c_str());
-	ofstream out_2(second_outputfile.c_str());
-	bit_file_c in;
-	ifstream in_genome(genomefile.c_str());
+			pos += edit.first;
 
-	try
-	{
-		in.Open(inputfile.c_str(), BF_READ);
-	}
-	catch (...)
-	{
-		cerr << "Failure to open the bitfile." << endl;
-		return false;
-	}
+			edits.push_back(make_pair(pos, getEditChar(edit.second)));
+		}
 
-	if(!out_1.is_open() | !out_2.is_open()){
-		cerr << "Failure to open the outputfile(s)." << endl;
-		return false;
+		((mate == 1) ? a_1 : a_2) = Alignment("", strand, length, chromosome, start, edits);
 	}
 
-	// Reconstruct the codes for chromosomes
-	map<string, int> chromosome_codes = code_chromosomes(genomefile);
+	return true;
+}
 
-	// Find out how many bits needed for fixed length
-	int bits = ceil(log2(chromosome_codes.size()));
+// Decodes the next pair of the block to data_1 and data_2.
+// Returns false if the block doesn't hold a valid pair.
+static bool decodePair(bit_file_c& in, const vector<string>& chromosome_names, const map<string, string>& chromosomes, int bits,
+	const BlockHeader& header, string& data_1, string& data_2) {
 
-	// Read chromosome content
-	string info = "";
-	string row;
+	Alignment a_1, a_2;
 
-	map<string, string> chromosomes;
+	return decodeAlignments(in, chromosome_names, bits, header, a_1, a_2) && alignedSequence(a_1, chromosomes, data_1) &&
+		alignedSequence(a_2, chromosomes, data_2);
+}
 
-	getline(in_genome, row);
+// Compresses given alignment files.
+// Returns true on success and false if there were any problems.
+bool MethodC::compress_C(string first_inputfile, string second_inputfile, string outputfile, string genomefile, AlignmentReader::input_format_t format, bool append) {
 
-	string id = row.substr(1, row.find_first_of(' ')-1);
+	// For SAM input both mates come from the same file
+	bool sam = (format == AlignmentReader::input_sam);
+	AlignmentReader* first_reader = new AlignmentReader(format, first_inputfile, genomefile);
+	AlignmentReader* second_reader = sam ? NULL : new AlignmentReader(format, second_inputfile, genomefile);
 
-	while(getline(in_genome, row)) {
+	long unpaired = 0;
+	bool failed = false;
 
-		if(row.at(0) == '>') {
-			chromosomes[id] = info;
-			id = row.substr(1, row.find_first_of(' ')-1);
-			info = "";
-		}
-		else {
-			info.append(row);
-		}
+	bool ok = compress_C(
+		[&](Alignment& a_1, Alignment& a_2) {
 
+			if(sam) {
 
-	}
+				if(!first_reader->nextPair(a_1, a_2)) {
+					failed = !first_reader->good();
+					return false;
+				}
+
+				// Mates aligned by another aligner can be on different chromosomes,
+				// the pair can't be coded as such and is stored unaligned instead.
+				if(a_1.getChromosome() != a_2.getChromosome()) {
 
-	chromosomes[id] = info;
+					a_1 = unalignedAlignment(a_1.getName(), first_reader->getSequence());
+					a_2 = unalignedAlignment(a_2.getName(), first_reader->getMateSequence());
+					unpaired++;
+				}
 
-	while(true) {
+				return true;
+			}
 
-		// Get the values	
-		int chromosome_code = 0;
+			if(!first_reader->next(a_1))
+				return false;
+
+			if(!(second_reader->next(a_2))) {
+
+				cerr << "Second inputfile ended before the first, error in syncronizing the alignments." << endl;
+				failed = true;
+				return false;
+			}
 
-		// If this returns EOF, the file has been completely read, it's not an error.
-		if((in.GetBitsInt(&chromosome_code, bits, sizeof(chromosome_code))) == EOF) {
-			out_1.close();
-			out_2.close();
-			in.Close();
-			chromosome_codes.clear();
-			chromosomes.clear();
 			return true;
-		}
+		}, outputfile, genomefile, append,
+		[&]() {
 
-		string chromosome = "";
+			// Check that there's nothing left in second inputfile
+			Alignment a_2;
 
-		map<string, int>::iterator it;
+			if(!failed && !sam && second_reader->next(a_2)) {
 
-		for(it = chromosome_codes.begin(); it != chromosome_codes.end(); it++) {
-			if((it->second) == chromosome_code) {
-				chromosome = it->first;
-				break;
+				cerr << "First input file ended before the second, error in syncronizing the alignments." << endl;
+				failed = true;
 			}
-		}
 
-		if(chromosome == "") {
-			cerr << "Failure to decompress chromosome." << endl;
-			in.Close();
-			return false;
-		}
+			return !failed;
+		});
 
-		char strand;
+	if(unpaired > 0)
+		cerr << unpaired << " pairs could not be coded as pairs and were stored unaligned." << endl;
 
-		int i;
+	delete first_reader;
+	delete second_reader;
 
-		long start = 0;
-		long length = 0;
+	return ok && !failed;
 
-		for(int mate = 1; mate <= 2; mate++) {
+}
 
-			switch(i = in.GetBit()) {
+bool MethodC::compress_C(std::function<bool(Alignment&, Alignment&)> next, string outputfile, string genomefile, bool append, std::function<bool()> good) {
 
-				case 0:
-					strand = 'R';
-					break;
-				case 1:
-					strand = 'F';
+	const Reference& reference = load_reference(genomefile);
+	const map<string, int>& chromosome_codes = reference.getCodes();
+
+	ArchiveWriter out;
+	ArchiveHeader header = archiveHeader('c', reference);
+
+	if(append ? !out.append(outputfile, header) : !out.open(outputfile, header))
+		return false;
+
+	// Find out how many bits needed for fixed length
+	int bits = ceil(log2(chromosome_codes.size()));
+
+	bool failed = false;
+
+	ThreadPool& pool = ThreadPool::shared();
+
+	// Pairs are read and checked here and the blocks are coded on the pool
+	bool ok = writeBlocks<vector<pair<Alignment, Alignment> > >(out, pool,
+		[&](vector<pair<Alignment, Alignment> >& block) {
+
+			Alignment a_1;
+			Alignment a_2;
+
+			while(!failed && block.size() < BLOCK_READS && next(a_1, a_2)) {
+
+				// Sanity check that pairs have been aligned correctly
+				if(a_1.getChromosome() != a_2.getChromosome()) {
+
+					cerr << "Mates have different chromosome, please check the alignment for read " << a_1.getName() << "." << endl;
+					failed = true;
 					break;
-				case EOF:
-					out_1.close();
-					out_2.close();
-					in.Close();
-					chromosome_codes.clear();
-					chromosomes.clear();
-					return true;
+				}
 
+				block.push_back(make_pair(a_1, a_2));
 			}
 
-			// For first mate, start is coded
-			if(mate == 1)
-				start = readGammaCode(in);
-			// For second, it's the difference compared to first mate
-			else {
-				start += readGammaCode(in);
-			}				
-
-			if(start == EOF) {
-
-				out_1.close();
-				out_2.close();
-				in.Close();
-				chromosome_codes.clear();
-				chromosomes.clear();
-				return true;
+			return !failed && !block.empty();
+		},
+		[&chromosome_codes, bits](const vector<pair<Alignment, Alignment> >& block, CodedBlock& coded) {
+			ostringstream stream;
+			bit_file_c block_out;
+			block_out.Open(stream);
+
+			// Both mates count for the modal read length, aligned pairs for the insert size and the orientations
+			vector<long> lengths, distances;
+			vector<int> orientations;
+			for(unsigned i = 0; i < block.size(); i++) {
+				lengths.push_back(block[i].first.getLength());
+				lengths.push_back(block[i].second.getLength());
+				if(block[i].first.getStart() > 0) {
+					distances.push_back(block[i].second.getStart() - block[i].first.getStart());
+					orientations.push_back(mateOrientation(block[i].first, block[i].second));
+				}
 			}
+			coded.header.read_length = modalLength(lengths);
+			insertSizeModel(distances, coded.header.insert_size, coded.header.insert_rice);
+			coded.header.orientations = mateOrientationModel(orientations);
 
+			for(unsigned i = 0; i < block.size(); i++) {
 
-			length = readGammaCode(in);
+				// Index for random access by read number
+				if(i % READ_INDEX_INTERVAL == 0)
+					coded.checkpoints.push_back(block_out.TellBit());
 
-			if(length == EOF) {
-
-				out_1.close();
-				out_2.close();
-				in.Close();
-				chromosome_codes.clear();
-				chromosomes.clear();
-				return true;
+				if(!encodePair(block_out, block.at(i).first, block.at(i).second, chromosome_codes, bits, coded.header))
+					return false;
 			}
 
+			// Writes out the rest of byte, the next block starts byte aligned
+			block_out.Close();
 
-			vector<pair<int, char> > edits;
+			coded.data = stream.str();
+			coded.header.size = coded.data.size();
+			coded.header.reads = block.size();
+			coded.header.chromosome = -1;
+			return true;
+		});
 
-			// Read how many edits there are
-			int edits_size = readGammaCode(in);
+	ok = ok && !failed && (!good || good());
 
-			if(edits_size == -1) {
+	return out.close(ok) && ok;
 
-				out_1.close();
-				out_2.close();
-				in.Close();
-				chromosome_codes.clear();
-				chromosomes.clear();
-				return true;
-			}
+}
+
+// Decompresses given compressed file using given genome file.
+// Returns true on success and false if there were any problems.
+bool MethodC::decompress_C(std::string inputfile, std::string first_outputfile, std::string second_outputfile, std::string genomefile){
 
-			int pos = 0;
+	ofstream file_1, file_2;
+	ostream& out_1 = open_output(first_outputfile, file_1);
+	ostream& out_2 = open_output(second_outputfile, file_2);
+	ArchiveReader in;
 
-			// Read the edits
-			for(int i = 0; i < edits_size; i++) {
+	if(!in.open(inputfile)) {
+		cerr << "Failure to open the archive." << endl;
+		return false;
+	}
 
-				pos += readGammaCode(in);
+	if(!out_1 || !out_2){
+		cerr << "Failure to open the outputfile(s)." << endl;
+		return false;
+	}
 
-				int edit_number = 0;
-				char edit;
+	// Reconstruct the codes for chromosomes
+	const Reference& reference = load_reference(genomefile);
 
-				if(in.GetBitsInt(&edit_number, 4, sizeof(edit_number)) == EOF) {
-					cerr << "Failure to decompress edits." << endl;
+	if(!checkArchive(in, reference, "c"))
+		return false;
+
+	const map<string, int>& chromosome_codes = reference.getCodes();
+	const vector<string>& names = reference.getNames();
+
+	// Find out how many bits needed for fixed length
+	int bits = ceil(log2(chromosome_codes.size()));
+
+	// Read chromosome content
+	const map<string, string>& chromosomes = reference.getChromosomes();
+
+	// Both mates to the same stream (standard output) are interleaved
+	bool interleaved = (&out_1 == &out_2);
+
+	ThreadPool& pool = ThreadPool::shared();
+
+	// Blocks are decoded on the pool into buffers of their own and written in order
+	bool ok = readBlocks<pair<string, string> >(in, pool,
+		[&names, &chromosomes, bits, interleaved](const BlockInfo& info, const string& block, pair<string, string>& output) {
+			istringstream stream(block);
+			bit_file_c block_in;
+			block_in.Open(stream);
+
+			string data_1, data_2;
+
+			for(uint32_t i = 0; i < info.header.reads; i++) {
+
+				if(!decodePair(block_in, names, chromosomes, bits, info.header, data_1, data_2)) {
+					cerr << "Failure to decompress pair " << info.first_read + i + 1 << "." << endl;
 					return false;
 				}
 
-				// Returning the edits to form supported by Alignment object isn't necessary for reconstructing the sequence, 
-				// but it will come in handy if user wants the alignment returned too (future development?)
-				switch(edit_number) {
-
-					case mismatch_A:
-						edit = 'A';
-						break;
-					case mismatch_C:
-						edit = 'C';
-						break;
-					case mismatch_G:
-						edit = 'G';
-						break;
-					case mismatch_T:
-						edit = 'T';
-						break;
-					case insertion_A:
-						edit = 'a';
-						break;
-					case insertion_C:
-						edit = 'c';
-						break;
-					case insertion_G:
-						edit = 'g';
-						break;
-					case insertion_T:
-						edit = 't';
-						break;
-					case deletion:
-						edit = 'D';
-						break;
-				}
+				output.first += data_1;
+				output.first += '\n';
 
-				edits.push_back(make_pair(pos, edit));
+				string& second = (interleaved ? output.first : output.second);
+				second += data_2;
+				second += '\n';
 			}
 
-			// Reconstruct the data
+			return true;
+		},
+		[&out_1, &out_2](const pair<string, string>& output) {
+			out_1.write(output.first.data(), output.first.size());
+			out_2.write(output.second.data(), output.second.size());
+			return out_1.good() && out_2.good();
+		});
+
+	out_1.flush();
+	out_2.flush();
+
+	if(!ok || !out_1 || !out_2) {
+		cerr << "Failure to decompress the archive." << endl;
+		return false;
+	}
+
+	return true;
+}
 
-			string data = "";
+// Decompresses pairs first..last of given compressed file using given genome file.
+// Returns true on success and false if there were any problems.
+bool MethodC::extract_C(std::string inputfile, std::string first_outputfile, std::string second_outputfile, std::string genomefile, long first, long last){
 
-			if(chromosome != "*" && start != 0 && length != 0)
-				data = chromosomes[chromosome].substr(start-1, length);
+	ofstream file_1, file_2;
+	ostream& out_1 = open_output(first_outputfile, file_1);
+	ostream& out_2 = open_output(second_outputfile, file_2);
+	ArchiveReader in;
 
-			// There's possibility that trailing zeros cause "valid" looking alignment, check!
-			if(chromosome != "*" && (length == 0)) {
-				out_1.close();
-				out_2.close();
-				in.Close();
-				chromosome_codes.clear();
-				chromosomes.clear();
-				return true;
-			}
+	if(!in.open(inputfile)) {
+		cerr << "Failure to open the archive." << endl;
+		return false;
+	}
 
-			// Indels can mess up the indexes. Offset keeps track of them.
-			int offset = 0;
-
-			for(int i = 0; i < edits.size(); i++) {
-
-				switch(edits.at(i).second) {
-
-					case 'A':
-						data[edits.at(i).first+offset] = 'A';	
-						break;
-					case 'C':
-						data[edits.at(i).first+offset] = 'C';
-						break;
-					case 'G':
-						data[edits.at(i).first+offset] = 'G';
-						break;
-					case 'T':
-						data[edits.at(i).first+offset] = 'T';
-						break;
-					case 'a':
-					{
-						if((data.length() > 0) && (edits.at(i).first != 0) && (edits.at(i).first < data.length())) {
-							data = data.substr(0,edits.at(i).first+offset) + "A" + data.substr(edits.at(i).first+offset, data.length());
-							offset++;
-						}
-						else if((data.length() > 0) && (edits.at(i).first == 0)) {
-							data = "A" + data.substr(edits.at(i).first+offset, data.length());
-							offset++;
-						}
-						else if((data.length() > 0) && (edits.at(i).first == data.length())) {
-							data = data.substr(0,edits.at(i).first+offset) + "A";
-							offset++;						
-						}
-						else {
-							data = "A";
-						}
-						break;
-					}
-
-					case 'c':
-					{
-						if((data.length() > 0) && (edits.at(i).first != 0) && (edits.at(i).first < data.length())) {
-							data = data.substr(0,edits.at(i).first+offset) + "C" + data.substr(edits.at(i).first+offset, data.length());
-							offset++;
-						}
-						else if((data.length() > 0) && (edits.at(i).first == 0)) {
-							data = "C" + data.substr(edits.at(i).first+offset, data.length());
-							offset++;
-						}
-						else if((data.length() > 0) && (edits.at(i).first == data.length())) {
-							data = data.substr(0,edits.at(i).first+offset) + "C";
-							offset++;						
-						}
-						else {
-							data = "C";
-						}
-						break;
-					}
-
-					case 'g':
-					{
-						if((data.length() > 0) && (edits.at(i).first != 0) && (edits.at(i).first < data.length())) {
-							data = data.substr(0,edits.at(i).first+offset) + "G" + data.substr(edits.at(i).first+offset, data.length());
-							offset++;
-						}
-						else if((data.length() > 0) && (edits.at(i).first == 0)) {
-							data = "G" + data.substr(edits.at(i).first+offset, data.length());
-							offset++;
-						}
-						else if((data.length() > 0) && (edits.at(i).first == data.length())) {
-							data = data.substr(0,edits.at(i).first+offset) + "G";
-							offset++;						
-						}
-						else {
-							data = "G";
-						}
-						break;
-					}
-					case 't':
-					{
-						if((data.length() > 0) && (edits.at(i).first != 0) && (edits.at(i).first < data.length())) {
-							data = data.substr(0,edits.at(i).first+offset) + "T" + data.substr(edits.at(i).first+offset, data.length());
-							offset++;
-						}
-						else if((data.length() > 0) && (edits.at(i).first == 0)) {
-							data = "T" + data.substr(edits.at(i).first+offset, data.length());
-							offset++;
-						}
-						else if((data.length() > 0) && (edits.at(i).first == data.length())) {
-							data = data.substr(0,edits.at(i).first+offset) + "T";
-							offset++;						
-						}
-						else {
-							data = "T";
-						}
-						break;
-					}
-					case 'D':
-					{
-						data = data.substr(0,edits.at(i).first+offset) + data.substr(edits.at(i).first+offset+1, data.length());
-						offset--;
-						break;
-					}
+	if(!in.seekable()) {
+		cerr << "Decompressing a range of pairs needs the archive as a file." << endl;
+		return false;
+	}
+
+	if(!out_1 || !out_2){
+		cerr << "Failure to open the outputfile(s)." << endl;
+		return false;
+	}
+
+	const Reference& reference = load_reference(genomefile);
+
+	if(!checkArchive(in, reference, "c"))
+		return false;
+
+	const map<string, int>& chromosome_codes = reference.getCodes();
+	const vector<string>& names = reference.getNames();
+	int bits = ceil(log2(chromosome_codes.size()));
+	const map<string, string>& chromosomes = reference.getChromosomes();
+
+	bool ok = readReadRange(in, first - 1, last - 1,
+		[&](const BlockInfo& info, bit_file_c& block_in, uint32_t skip, uint32_t count) {
+			string data_1, data_2;
+
+			for(uint32_t i = 0; i < skip + count; i++) {
+
+				if(!decodePair(block_in, names, chromosomes, bits, info.header, data_1, data_2))
+					return false;
+
+				if(i >= skip) {
+					out_1 << data_1 << '\n';
+					out_2 << data_2 << '\n';
 				}
 			}
 
-			if(strand == 'R') {
-				revstr(data);
-				complement(data);
-			}
+			return out_1.good() && out_2.good();
+		});
 
-			if(mate == 1)
-				out_1 << data << endl;
-			else
-				out_2 << data << endl;
+	out_1.flush();
+	out_2.flush();
 
-		}
+	if(!ok || !out_1 || !out_2) {
+		cerr << "Failure to decompress the archive." << endl;
+		return false;
 	}
+
 	return true;
 }
+
+RecordReader<pair<Alignment, Alignment> >::Decoder MethodC::decoder_C(const vector<string>& names) {
+
+	int bits = ceil(log2(names.size()));
+
+	return [&names, bits](const BlockInfo& info, bit_file_c& in, uint32_t, pair<Alignment, Alignment>& pair, long&, long&, long&) {
+		return decodeAlignments(in, names, bits, info.header, pair.first, pair.second);
+	};
+}
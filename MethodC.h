@@ -10,16 +10,29 @@
 #include <cstdlib>
 #include <string>
 #include <cstring>
+#include <functional>
 #include "AlignmentReader.h"
+#include "Merge.h"
 
 class MethodC {
 
 public:
 
-	static bool compress_C(std::string first_inputfile, std::string second_inputfile, std::string outputfile, std::string genomefile);
+	static bool compress_C(std::string first_inputfile, std::string second_inputfile, std::string outputfile, std::string genomefile, AlignmentReader::input_format_t format = AlignmentReader::input_tabdelimited, bool append = false);
+
+	/* Compresses the pairs of alignments given by next(a_1, a_2), which returns false after the last pair. After the
+	 * last pair good() tells if the input was read whole, an archive appended to is left as it was if not. */
+	static bool compress_C(std::function<bool(Alignment&, Alignment&)> next, std::string outputfile, std::string genomefile, bool append = false, std::function<bool()> good = std::function<bool()>());
+
+	/* Decoder of the records of the archive into pairs of alignments without the reference sequences, names are the
+	 * names of the chromosome codes and need to outlive the decoder. */
+	static RecordReader<std::pair<Alignment, Alignment> >::Decoder decoder_C(const std::vector<std::string>& names);
 
 	static bool decompress_C(std::string inputfile, std::string first_outputfile, std::string second_outputfile, std::string genomefile);
 
+	/* Decompresses pairs first..last (1-based) without decoding the blocks before them. */
+	static bool extract_C(std::string inputfile, std::string first_outputfile, std::string second_outputfile, std::string genomefile, long first, long last);
+
 };
 
 #endif //_MethodC_H_
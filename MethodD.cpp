@@ -3,68 +3,322 @@
 #include <cmath>
 #include "Alignment.h"
 #include "AlignmentReader.h"
+#include "Archive.h"
+#include "Merge.h"
+#include "ThreadPool.h"
 #include <algorithm>
 #include <vector>
+#include <map>
+#include <sstream>
 
 #include "utils.h"
 #include "MethodD.h"
 
 // @author Johannes Ylinen
 
-bool MethodD::compress(std::string inputfile, std::string inputfile2, std::string outputfile, std::string genomefile)
+// Bits the pair takes in a block without runs of duplicates: the first mate, the orientation and the distance of the mates
+// and the rest of the second mate (without its strand)
+static long pairRecordLength(const std::pair<Alignment, Alignment>& pair, long prevPos, const BlockHeader& header)
 {
-	std::vector<std::pair<Alignment, Alignment> > alignments;
+	return alignmentCodeLength(pair.first, prevPos, header.read_length) +
+		mateOrientationCodeLength(pair.first, pair.second, header.orientations) +
+		(pair.first.getStart() > 0 ? mateDistanceCodeLength(pair.second.getStart() - pair.first.getStart(), header.insert_size, header.insert_rice) : 0) +
+		alignmentCodeLength(pair.second, pair.second.getStart(), header.read_length) - gammaCodeLength(0) - 1;
+}
+
+// Sets the modal read length, the insert size and the orientations of the block from the pairs first..last-1
+static void pairParameters(const std::vector<std::pair<Alignment, Alignment> >& pairs, size_t first, size_t last, BlockHeader& header)
+{
+	// Both mates count for the modal read length, aligned pairs for the insert size and the orientations
+	std::vector<long> lengths, distances;
+	std::vector<int> orientations;
+	for(size_t i = first; i < last; ++i)
+	{
+		lengths.push_back(pairs[i].first.getLength());
+		lengths.push_back(pairs[i].second.getLength());
+		if(pairs[i].first.getStart() > 0)
+		{
+			distances.push_back(pairs[i].second.getStart() - pairs[i].first.getStart());
+			orientations.push_back(mateOrientation(pairs[i].first, pairs[i].second));
+		}
+	}
+	header.read_length = modalLength(lengths);
+	insertSizeModel(distances, header.insert_size, header.insert_rice);
+	header.orientations = mateOrientationModel(orientations);
+}
 
-	readAllPairAlignments(alignments, inputfile, inputfile2);
-	std::cout << "Found " << alignments.size() << " alignments.\n";
+// Sorts the pairs by the first mates and compresses them into the archive
+static bool writeSorted(std::vector<std::pair<Alignment, Alignment> >& alignments, std::string outputfile, std::string genomefile)
+{
 	std::sort(alignments.begin(), alignments.end(), startPosPairComp); // If pre-sorted wouldn't need so much memory
 
-	bit_file_c out;
-	/* open bit file for writing */
-	try { out.Open(outputfile.c_str(), BF_WRITE); }
-	catch (...) { return false; }
+	const Reference& reference = load_reference(genomefile);
+	const std::map<std::string, int>& chromosome_codes = reference.getCodes();
+
+	ArchiveWriter out;
+	if(!out.open(outputfile, archiveHeader('d', reference)))
+		return false;
+	ThreadPool& pool = ThreadPool::shared();
+
+	// Blocks are ranges of the sorted pairs, each on one chromosome
+	size_t next = 0;
+
+	bool ok = writeBlocks<std::pair<size_t, size_t> >(out, pool,
+		[&alignments, &next](std::pair<size_t, size_t>& block) {
+			block.first = next;
+			while(next < alignments.size() && next - block.first < BLOCK_READS &&
+				alignments[next].first.getChromosome() == alignments[block.first].first.getChromosome())
+				++next;
+			block.second = next;
+			return block.first < block.second;
+		},
+		[&alignments, &chromosome_codes](const std::pair<size_t, size_t>& block, CodedBlock& coded) {
+			std::map<std::string, int>::const_iterator code = chromosome_codes.find(alignments[block.first].first.getChromosome());
+			if(code == chromosome_codes.end()) {
+				std::cerr << "Error: chromosome " << alignments[block.first].first.getChromosome() << " is not in the reference!" << std::endl;
+				return false;
+			}
+
+			std::ostringstream stream;
+			bit_file_c block_out;
+			block_out.Open(stream);
+
+			// Reference range of the block for region queries, mates can start before the first mates of the block
+			coded.first_position = alignments[block.first].first.getStart();
+
+			pairParameters(alignments, block.first, block.second, coded.header);
+			coded.header.duplicates = duplicateRuns<std::pair<Alignment, Alignment> >(alignments, block.first, block.second,
+				[&coded](const std::pair<Alignment, Alignment>& pair, long prevPos) { return pairRecordLength(pair, prevPos, coded.header); },
+				[](const std::pair<Alignment, Alignment>& pair) { return pair.first.getStart(); });
+
+			long prevPos = 0;
+			for(size_t i = block.first; i < block.second; ++i)
+			{
+				// Duplicates of the previous pair are coded as one run
+				size_t run = i;
+				while(coded.header.duplicates > 0 && i > block.first && run < block.second && sameAlignment(alignments[run], alignments[i - 1]))
+					++run;
+				if(run > i)
+				{
+					writeDuplicates(block_out, run - i);
+					i = run - 1;
+					continue;
+				}
+
+				const Alignment& a_1 = alignments[i].first;
+				const Alignment& a_2 = alignments[i].second;
+				if(a_1.getStart() > 0) {
+					coded.first_position = std::min<uint64_t>(coded.first_position, a_2.getStart());
+					coded.last_position = std::max<uint64_t>(coded.last_position, std::max(a_1.getStart() + a_1.getLength(), a_2.getStart() + a_2.getLength()) - 1);
+				}
+
+				writeAlignment(block_out, a_1, prevPos, coded.header.read_length, coded.header.duplicates > 0);
+				writeMate(block_out, a_2, a_1, coded.header.read_length, coded.header.insert_size, coded.header.insert_rice, coded.header.orientations);
+				prevPos = a_1.getStart();
+			}
+
+			block_out.Close();
+
+			coded.data = stream.str();
+			coded.header.size = coded.data.size();
+			coded.header.reads = block.second - block.first;
+			coded.header.chromosome = code->second;
+			return true;
+		});
+
+	return out.close() && ok;
+}
 
-	long prevPos = 0;
-	for(size_t i = 0; i < alignments.size(); ++i)
+bool MethodD::compress(std::string inputfile, std::string inputfile2, std::string outputfile, std::string genomefile, AlignmentReader::input_format_t format)
+{
+	std::vector<std::pair<Alignment, Alignment> > alignments;
+
+	if(!readAllPairAlignments(alignments, inputfile, inputfile2, format, genomefile))
+		return false;
+
+	std::cerr << "Found " << alignments.size() << " alignments.\n";
+
+	return writeSorted(alignments, outputfile, genomefile);
+}
+
+bool MethodD::compress(std::function<bool(Alignment&, Alignment&)> next, std::string outputfile, std::string genomefile)
+{
+	// Sorted runs of SORT_RUN_READS pairs are compressed to temporary archives and merged
+	std::string prefix = temporary_prefix();
+	std::vector<std::string> runs;
+	bool ok = true;
+
+	while(ok)
 	{
-		writeAlignment(out, alignments[i].first, prevPos);
-		prevPos = alignments[i].first.getStart();
-		if(alignments[i].second.getStart() < prevPos)
-			out.PutBit(1);
-		else
-			out.PutBit(0);
-		writeAlignment(out, alignments[i].second, prevPos);
+		std::vector<std::pair<Alignment, Alignment> > alignments;
+		Alignment a_1, a_2;
+		while(alignments.size() < SORT_RUN_READS && next(a_1, a_2))
+			alignments.push_back(std::make_pair(a_1, a_2));
+
+		// Everything fit in one run
+		if(runs.empty() && alignments.size() < SORT_RUN_READS)
+			return writeSorted(alignments, outputfile, genomefile);
+
+		if(alignments.empty())
+			break;
+
+		runs.push_back(prefix + ".run." + std::to_string(runs.size()));
+		ok = writeSorted(alignments, runs.back(), genomefile);
 	}
 
-	out.Close();
-	return true;
+	ok = ok && merge(runs, outputfile);
+
+	for(size_t i = 0; i < runs.size(); ++i)
+		std::remove(runs[i].c_str());
+
+	return ok;
+}
+
+RecordReader<std::pair<Alignment, Alignment> >::Decoder MethodD::decoder(const std::vector<std::string>& names)
+{
+	return [&names](const BlockInfo& info, bit_file_c& in, uint32_t, std::pair<Alignment, Alignment>& pair, long& prevPos, long& repeats, long&) {
+		if(info.header.chromosome < 0 || info.header.chromosome >= (int)names.size())
+			return false;
+		const std::string& chromosome = names[info.header.chromosome];
+		if(!readAlignment(in, pair.first, chromosome, info.header.read_length, prevPos, info.header.duplicates > 0 ? &repeats : NULL))
+			return false;
+		if(repeats > 0)
+			return true;
+		prevPos = pair.first.getStart();
+		return readMate(in, pair.second, chromosome, info.header.read_length, pair.first, info.header.insert_size, info.header.insert_rice,
+			info.header.orientations);
+	};
 }
 
 bool MethodD::decompress(std::string inputfile, std::string first_outputfile, std::string second_outputfile, std::string genomefile)
 {
-	ofstream out1(first_outputfile.c_str());
-	ofstream out2(second_outputfile.c_str());
-	bit_file_c in;
-	ifstream in_genome(genomefile.c_str());
+	ofstream file1, file2;
+	ostream& out1 = open_output(first_outputfile, file1);
+	ostream& out2 = open_output(second_outputfile, file2);
+	ArchiveReader in;
 
-	std::string refSeq;
+	const Reference& reference = load_reference(genomefile);
+	const std::vector<std::string>& names = reference.getNames();
+	const std::map<std::string, std::string>& chromosomes = reference.getChromosomes();
 
-	while(true)
+	if(!in.open(inputfile))
 	{
-		std::string temp;
-		getline(in_genome, temp);
-		if(!in_genome) break;
-		if(temp[0] != '>')
-			refSeq += temp;
+		cerr << "Failure to open the archive." << endl;
+		return false;
 	}
 
-	try
+	if(!checkArchive(in, reference, "d"))
+		return false;
+
+	if(!out1 || !out2){
+		cerr << "Failure to open the outputfile." << endl;
+		return false;
+	}
+
+	// Both mates to the same stream (standard output) are interleaved
+	bool interleaved = (&out1 == &out2);
+
+	ThreadPool& pool = ThreadPool::shared();
+
+	// Blocks are decoded on the pool into buffers of their own and written in order
+	bool ok = readBlocks<std::pair<std::string, std::string> >(in, pool,
+		[&names, &chromosomes, interleaved](const BlockInfo& info, const std::string& block, std::pair<std::string, std::string>& output) {
+			if(info.header.chromosome < 0 || info.header.chromosome >= (int)names.size())
+			{
+				cerr << "Failure to decompress chromosome." << endl;
+				return false;
+			}
+
+			// Unaligned reads have no reference
+			static const std::string none;
+			std::map<std::string, std::string>::const_iterator chromosome = chromosomes.find(names[info.header.chromosome]);
+			const std::string& refSeq = (chromosome != chromosomes.end()) ? chromosome->second : none;
+
+			std::istringstream stream(block);
+			bit_file_c block_in;
+			block_in.Open(stream);
+
+			long prevPos = 0, repeats = 0;
+			char strand = 0;
+			std::string read_1, read_2;
+			for(uint32_t i = 0; i < info.header.reads; ++i)
+			{
+				// Numbering continues from the previous blocks
+				std::string name = ">Read_" + std::to_string(info.first_read + i + 1) + '\n';
+
+				// Duplicates repeat the pair decoded last
+				if(repeats == 0)
+				{
+					prevPos = getRead(block_in, refSeq, read_1, info.header.read_length, prevPos, NULL, info.header.duplicates > 0 ? &repeats : NULL, &strand);
+					if(prevPos >= 0 && repeats == 0 && getMate(block_in, refSeq, read_2, info.header.read_length, prevPos, strand,
+						info.header.insert_size, info.header.insert_rice, info.header.orientations) < 0)
+						prevPos = -1;
+				}
+				if(prevPos < 0 || (repeats > 0 && i == 0))
+				{
+					cerr << "Failure to decompress read." << endl;
+					return false;
+				}
+				if(repeats > 0)
+					--repeats;
+
+				output.first += name;
+				output.first += read_1 + '\n';
+
+				std::string& second = (interleaved ? output.first : output.second);
+				second += name;
+				second += read_2 + '\n';
+			}
+
+			return true;
+		},
+		[&out1, &out2](const std::pair<std::string, std::string>& output) {
+			out1.write(output.first.data(), output.first.size());
+			out2.write(output.second.data(), output.second.size());
+			return out1.good() && out2.good();
+		});
+
+	out1.flush();
+	out2.flush();
+
+	if(!ok || !out1 || !out2)
+	{
+		cerr << "Failure to decompress the archive." << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool MethodD::extract(std::string inputfile, std::string first_outputfile, std::string second_outputfile, std::string genomefile, std::string chromosome, long from, long to)
+{
+	ofstream file1, file2;
+	ostream& out1 = open_output(first_outputfile, file1);
+	ostream& out2 = open_output(second_outputfile, file2);
+	ArchiveReader in;
+
+	const Reference& reference = load_reference(genomefile);
+	const std::map<std::string, int>& chromosome_codes = reference.getCodes();
+	std::map<std::string, int>::const_iterator code = chromosome_codes.find(chromosome);
+
+	if(code == chromosome_codes.end())
+	{
+		cerr << "Chromosome " << chromosome << " is not in the reference." << endl;
+		return false;
+	}
+
+	if(!in.open(inputfile))
 	{
-		in.Open(inputfile.c_str(), BF_READ);
+		cerr << "Failure to open the archive." << endl;
+		return false;
 	}
-	catch (...)
+
+	if(!checkArchive(in, reference, "d"))
+		return false;
+
+	if(!in.seekable())
 	{
-		cerr << "Failure to open the bitfile." << endl;
+		cerr << "Decompressing a region needs the archive as a file." << endl;
 		return false;
 	}
 
@@ -73,32 +327,99 @@ bool MethodD::decompress(std::string inputfile, std::string first_outputfile, st
 		return false;
 	}
 
-	long prevPos = 0;
-	long readNumber = 1;
-	while(true)
+	// Unaligned reads have no positions, all of them are in the region of "*"
+	bool unaligned = (chromosome == "*");
+	std::vector<BlockInfo> blocks = unaligned ? regionBlocks(in, code->second, 0, 0) : regionBlocks(in, code->second, from, to);
+
+	// The sequences are only read if there are aligned reads to decode
+	static const std::string none;
+	std::map<std::string, std::string>::const_iterator sequence;
+	bool found = !unaligned && !blocks.empty() && (sequence = reference.getChromosomes().find(chromosome)) != reference.getChromosomes().end();
+	const std::string& refSeq = found ? sequence->second : none;
+
+	for(size_t b = 0; b < blocks.size(); ++b)
 	{
-		std::string read;
-		prevPos = getRead(in, refSeq, read, prevPos);
-		if(prevPos < 0)
-			break;
-		if(read.length() > 0)
+		std::string block;
+		if(!in.readBlock(blocks[b], block))
 		{
-			out1 << ">Read_" << readNumber << '\n';
-			out1 << read << '\n';
+			cerr << "The archive is truncated." << endl;
+			return false;
 		}
 
-		if(in.GetBit())
-			getRead(in, refSeq, read, prevPos, true);
-		else
-			getRead(in, refSeq, read, prevPos, false);
+		std::istringstream stream(block);
+		bit_file_c block_in;
+		block_in.Open(stream);
 
-		if(read.length() > 0)
+		long prevPos = 0, start_2 = 0, span_1 = 0, span_2 = 0, repeats = 0;
+		char strand = 0;
+		std::string read_1, read_2;
+		for(uint32_t i = 0; i < blocks[b].header.reads; ++i)
 		{
-			out2 << ">Read_" << readNumber++ << '\n';
-			out2 << read << '\n';
-		}
+			// Duplicates repeat the pair decoded last
+			if(repeats == 0)
+			{
+				prevPos = getRead(block_in, refSeq, read_1, blocks[b].header.read_length, prevPos, &span_1, blocks[b].header.duplicates > 0 ? &repeats : NULL, &strand);
+				if(prevPos >= 0 && repeats == 0)
+					start_2 = getMate(block_in, refSeq, read_2, blocks[b].header.read_length, prevPos, strand, blocks[b].header.insert_size,
+						blocks[b].header.insert_rice, blocks[b].header.orientations, &span_2);
+			}
+			if(prevPos < 0 || start_2 < 0 || (repeats > 0 && i == 0))
+			{
+				cerr << "Failure to decompress read." << endl;
+				return false;
+			}
+			if(repeats > 0)
+				--repeats;
 
+			// Pairs with either mate in the region
+			if(unaligned || (prevPos <= to && prevPos + span_1 - 1 >= from) || (start_2 <= to && start_2 + span_2 - 1 >= from))
+			{
+				out1 << ">Read_" << blocks[b].first_read + i + 1 << '\n';
+				out1 << read_1 << '\n';
+				out2 << ">Read_" << blocks[b].first_read + i + 1 << '\n';
+				out2 << read_2 << '\n';
+			}
+		}
 	}
 
-	return true;
+	out1.flush();
+	out2.flush();
+
+	return out1.good() && out2.good();
+}
+
+bool MethodD::merge(const std::vector<std::string>& inputfiles, std::string outputfile)
+{
+	typedef std::pair<Alignment, Alignment> Pair;
+
+	// Second mates are coded against the first ones, only the deltas of the first mates and the mate models change
+	return mergeArchives<Pair>('d', inputfiles, outputfile,
+		[](const BlockInfo& info, bit_file_c& in, uint32_t, Pair& pair, long& prevPos, long& repeats, long&) {
+			if(!readAlignment(in, pair.first, "", info.header.read_length, prevPos, info.header.duplicates > 0 ? &repeats : NULL))
+				return false;
+			if(repeats > 0)
+				return true;
+			prevPos = pair.first.getStart();
+			return readMate(in, pair.second, "", info.header.read_length, pair.first, info.header.insert_size, info.header.insert_rice,
+				info.header.orientations);
+		},
+		[](bit_file_c& out, const Pair& pair, long prevPos, CodedBlock& coded) {
+			const Alignment& a_1 = pair.first;
+			const Alignment& a_2 = pair.second;
+			if(a_1.getStart() > 0) {
+				coded.first_position = std::min<uint64_t>(coded.first_position, a_2.getStart());
+				coded.last_position = std::max<uint64_t>(coded.last_position, std::max(a_1.getStart() + a_1.getLength(), a_2.getStart() + a_2.getLength()) - 1);
+			}
+
+			writeAlignment(out, a_1, prevPos, coded.header.read_length, coded.header.duplicates > 0);
+			writeMate(out, a_2, a_1, coded.header.read_length, coded.header.insert_size, coded.header.insert_rice, coded.header.orientations);
+		},
+		[](const std::vector<Pair>& block, BlockHeader& header) {
+			pairParameters(block, 0, block.size(), header);
+		},
+		pairRecordLength,
+		[](const Pair& pair) {
+			return pair.first.getStart();
+		},
+		startPosPairComp);
 }
@@ -1,7 +1,18 @@
 #pragma once
 
+#include "Merge.h"
+
 namespace MethodD
 {
-	bool compress(std::string inputfile, std::string inputfile2, std::string outputfile, std::string genomefile);
+	bool compress(std::string inputfile, std::string inputfile2, std::string outputfile, std::string genomefile, AlignmentReader::input_format_t format = AlignmentReader::input_tabdelimited);
+	/* Compresses the pairs of alignments given by next(a_1, a_2), which returns false after the last pair. They are
+	 * sorted in runs of SORT_RUN_READS pairs that are merged, so that they don't all need to fit in memory. */
+	bool compress(std::function<bool(Alignment&, Alignment&)> next, std::string outputfile, std::string genomefile);
 	bool decompress(std::string inputfile, std::string inputfile2, std::string outputfile, std::string genomefile);
+	bool extract(std::string inputfile, std::string first_outputfile, std::string second_outputfile, std::string genomefile, std::string chromosome, long from, long to);
+	/* Decoder of the records of the archive into pairs of alignments without the reference sequences, names are the
+	 * names of the chromosome codes and need to outlive the decoder. */
+	RecordReader<std::pair<Alignment, Alignment> >::Decoder decoder(const std::vector<std::string>& names);
+	/* Merges sorted archives of the method into one without the reference, see Merge.h. */
+	bool merge(const std::vector<std::string>& inputfiles, std::string outputfile);
 }
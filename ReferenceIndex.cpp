@@ -0,0 +1,559 @@
+#include "ReferenceIndex.h"
+#include "Checksum.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <deque>
+#include <cstring>
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Minimizers of canonical k-mers over windows of w k-mers
+static const uint32_t INDEX_K = 15;
+static const uint32_t INDEX_W = 10;
+
+// Minimizers occurring more often than this are repeats and skipped when searching the whole genome
+static const uint32_t MAX_OCCURRENCES = 64;
+
+static const char INDEX_MAGIC[4] = {'R', 'Z', 'I', 'X'};
+static const uint32_t INDEX_VERSION = 2;
+
+struct ReferenceIndex::Header {
+	char magic[4];
+	uint32_t version;
+	uint32_t k;
+	uint32_t w;
+	uint32_t chromosome_count;
+	uint32_t bucket_bits;
+	uint64_t genome_length;
+	uint64_t exception_count;
+	uint64_t position_count;
+
+	// Byte offsets of the sections from the start of the file
+	uint64_t chromosomes;
+	uint64_t names;
+	uint64_t packed;
+	uint64_t exceptions;
+	uint64_t buckets;
+	uint64_t positions;
+	uint64_t filter;
+	uint64_t filter_size;
+
+	// Genome file the index was built from, an index of another file (or of an edited one) is built again
+	uint64_t genome_size;
+	int64_t genome_mtime;
+	uint32_t genome_checksum;
+	uint32_t reserved;
+};
+
+struct ReferenceIndex::Chromosome {
+	uint64_t start;
+	uint64_t length;
+	uint64_t name_offset;
+	uint64_t name_length;
+};
+
+static inline uint64_t mix(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+static inline int baseCode(char c)
+{
+	switch(c) {
+		case 'A': return 0;
+		case 'C': return 1;
+		case 'G': return 2;
+		case 'T': return 3;
+		default: return -1;
+	}
+}
+
+// Calls emit(hash, position) for the minimizers of the sequence of given length, code(i) gives the 2-bit code of
+// base i or -1 for other characters. Sequences shorter than a full window get the minimizer of the k-mers they have.
+template<class C, class E> static void forMinimizers(uint64_t length, C code, E emit)
+{
+	const uint64_t kmer_mask = (1ULL << (2 * INDEX_K)) - 1;
+	std::deque<std::pair<uint64_t, uint64_t> > window;
+	uint64_t forward = 0, reverse = 0;
+	uint64_t valid = 0;
+	uint64_t last = ~0ULL;
+
+	for(uint64_t i = 0; i <= length; i++) {
+
+		int c = (i < length) ? code(i) : -1;
+
+		if(c < 0) {
+			// Short stretch without a full window
+			if(valid >= INDEX_K && valid < INDEX_K + INDEX_W - 1 && last == ~0ULL)
+				emit(window.front().first, window.front().second);
+			window.clear();
+			valid = 0;
+			last = ~0ULL;
+			continue;
+		}
+
+		forward = ((forward << 2) | c) & kmer_mask;
+		reverse = (reverse >> 2) | ((uint64_t)(3 - c) << (2 * (INDEX_K - 1)));
+
+		if(++valid < INDEX_K)
+			continue;
+
+		uint64_t kmer_pos = i + 1 - INDEX_K;
+		uint64_t hash = mix(forward < reverse ? forward : reverse);
+
+		while(!window.empty() && window.back().first >= hash)
+			window.pop_back();
+		window.push_back(std::make_pair(hash, kmer_pos));
+
+		while(window.front().second + INDEX_W <= kmer_pos)
+			window.pop_front();
+
+		if(valid >= INDEX_K + INDEX_W - 1 && window.front().second != last) {
+			last = window.front().second;
+			emit(window.front().first, last);
+		}
+	}
+}
+
+// CRC32C of the contents of the file, returns false if it can't be read.
+static bool fileChecksum(const std::string& file, uint32_t& checksum)
+{
+	std::ifstream in(file.c_str(), std::ios::in | std::ios::binary);
+	std::vector<char> buffer(1 << 20);
+
+	checksum = 0;
+
+	while(in.read(buffer.data(), buffer.size()) || in.gcount() > 0)
+		checksum = crc32c(checksum, buffer.data(), in.gcount());
+
+	return in.eof() && !in.bad();
+}
+
+static void pad(std::ofstream& out)
+{
+	while(out.tellp() % 8 != 0)
+		out.put(0);
+}
+
+bool ReferenceIndex::build(std::string genomefile, std::string indexfile)
+{
+	std::ifstream in(genomefile.c_str());
+
+	if(!in.is_open()) {
+		std::cerr << "Failure to build the reference index, file could not be opened." << std::endl;
+		return false;
+	}
+
+	struct stat genome;
+	uint32_t genome_checksum;
+
+	if(stat(genomefile.c_str(), &genome) != 0 || !fileChecksum(genomefile, genome_checksum)) {
+		std::cerr << "Failure to build the reference index, file could not be read." << std::endl;
+		return false;
+	}
+
+	uint64_t file_size = genome.st_size;
+
+	std::vector<Chromosome> chromosome_table;
+	std::string name_blob;
+	std::vector<uint64_t> packed_bases;
+	std::vector<uint64_t> exception_runs;
+	BloomFilter bloom(20, file_size);
+
+	uint64_t length = 0;
+	std::string row, sequence;
+	bool more = true;
+
+	// Chromosomes are stored in file order, global positions are offsets in their concatenation
+	while(more) {
+
+		more = (bool)getline(in, row);
+
+		if(!more || (!row.empty() && row.at(0) == '>')) {
+
+			if(!chromosome_table.empty()) {
+
+				chromosome_table.back().length = sequence.length();
+				bloom.addSequence(sequence);
+
+				for(uint64_t i = 0; i < sequence.length(); i++, length++) {
+
+					if((length & 31) == 0)
+						packed_bases.push_back(0);
+
+					int c = baseCode(sequence[i]);
+
+					if(c < 0) {
+						// Runs of N (and soft masked bases) are exceptions to the packed sequence
+						if(!exception_runs.empty() && exception_runs[exception_runs.size() - 2] + exception_runs.back() == length)
+							exception_runs.back()++;
+						else {
+							exception_runs.push_back(length);
+							exception_runs.push_back(1);
+						}
+						c = 0;
+					}
+
+					packed_bases.back() |= (uint64_t)c << ((length & 31) << 1);
+				}
+			}
+
+			if(more) {
+				Chromosome chromosome;
+				std::string name = row.substr(1, row.find_first_of(' ')-1);
+				chromosome.start = length;
+				chromosome.length = 0;
+				chromosome.name_offset = name_blob.length();
+				chromosome.name_length = name.length();
+				name_blob += name;
+				chromosome_table.push_back(chromosome);
+				sequence.clear();
+			}
+		}
+		else
+			sequence.append(row);
+	}
+
+	if(length >= (1ULL << 32)) {
+		std::cerr << "Failure to build the reference index, the genome is too long." << std::endl;
+		return false;
+	}
+
+	// Positions are bucketed by the top bits of the minimizer hash, about one minimizer per bucket
+	uint32_t bucket_bits = 1;
+	while((1ULL << bucket_bits) < 2 * length / (INDEX_W + 1) && bucket_bits < 31)
+		bucket_bits++;
+
+	std::vector<uint32_t> bucket_offsets((1ULL << bucket_bits) + 1, 0);
+	size_t next_exception = 0;
+
+	// Exceptions are passed in order, so the 2-bit code lookup can walk them along
+	for(int pass = 0; pass < 2; pass++) {
+
+		std::vector<uint32_t> fill;
+		std::vector<uint32_t> entries;
+
+		if(pass == 1) {
+			for(size_t b = 1; b < bucket_offsets.size(); b++)
+				bucket_offsets[b] += bucket_offsets[b - 1];
+			fill.assign(bucket_offsets.begin(), bucket_offsets.end() - 1);
+			entries.resize(bucket_offsets.back());
+		}
+
+		for(size_t c = 0; c < chromosome_table.size(); c++) {
+
+			uint64_t start = chromosome_table[c].start;
+			next_exception = 0;
+
+			forMinimizers(chromosome_table[c].length,
+				[&](uint64_t i) -> int {
+					uint64_t pos = start + i;
+					while(next_exception < exception_runs.size() && exception_runs[next_exception] + exception_runs[next_exception + 1] <= pos)
+						next_exception += 2;
+					if(next_exception < exception_runs.size() && exception_runs[next_exception] <= pos)
+						return -1;
+					return (packed_bases[pos >> 5] >> ((pos & 31) << 1)) & 3;
+				},
+				[&](uint64_t hash, uint64_t pos) {
+					uint64_t bucket = hash >> (64 - bucket_bits);
+					if(pass == 0)
+						bucket_offsets[bucket + 1]++;
+					else
+						entries[fill[bucket]++] = start + pos;
+				});
+		}
+
+		if(pass == 1) {
+			// Sorted positions in every bucket allow searching a window of the genome
+			for(size_t b = 0; b + 1 < bucket_offsets.size(); b++)
+				std::sort(entries.begin() + bucket_offsets[b], entries.begin() + bucket_offsets[b + 1]);
+
+			// The index is written to a temporary file and renamed in place, so a process that has the old index mapped
+			// keeps it and no process maps a half written one
+			std::string tempfile = indexfile + "." + std::to_string(getpid()) + ".tmp";
+			std::ofstream out(tempfile.c_str(), std::ios::out | std::ios::binary);
+
+			if(!out.is_open()) {
+				std::cerr << "Failure to write the reference index " << indexfile << "." << std::endl;
+				return false;
+			}
+
+			Header h;
+			memset(&h, 0, sizeof(h));
+			memcpy(h.magic, INDEX_MAGIC, 4);
+			h.version = INDEX_VERSION;
+			h.k = INDEX_K;
+			h.w = INDEX_W;
+			h.chromosome_count = chromosome_table.size();
+			h.bucket_bits = bucket_bits;
+			h.genome_length = length;
+			h.exception_count = exception_runs.size() / 2;
+			h.position_count = entries.size();
+			h.genome_size = genome.st_size;
+			h.genome_mtime = genome.st_mtime;
+			h.genome_checksum = genome_checksum;
+
+			// Header is rewritten with the offsets at the end
+			out.write((const char*)&h, sizeof(h));
+			pad(out);
+
+			h.chromosomes = out.tellp();
+			out.write((const char*)chromosome_table.data(), chromosome_table.size() * sizeof(Chromosome));
+			h.names = out.tellp();
+			out.write(name_blob.data(), name_blob.length());
+			pad(out);
+			h.packed = out.tellp();
+			out.write((const char*)packed_bases.data(), packed_bases.size() * sizeof(uint64_t));
+			h.exceptions = out.tellp();
+			out.write((const char*)exception_runs.data(), exception_runs.size() * sizeof(uint64_t));
+			h.buckets = out.tellp();
+			out.write((const char*)bucket_offsets.data(), bucket_offsets.size() * sizeof(uint32_t));
+			pad(out);
+			h.positions = out.tellp();
+			out.write((const char*)entries.data(), entries.size() * sizeof(uint32_t));
+			pad(out);
+			h.filter = out.tellp();
+			bloom.write(out);
+			h.filter_size = (uint64_t)out.tellp() - h.filter;
+
+			out.seekp(0);
+			out.write((const char*)&h, sizeof(h));
+			out.close();
+
+			if(out.fail() || std::rename(tempfile.c_str(), indexfile.c_str()) != 0) {
+				std::cerr << "Failure to write the reference index " << indexfile << "." << std::endl;
+				std::remove(tempfile.c_str());
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+ReferenceIndex::ReferenceIndex()
+	: header(NULL), chromosomes(NULL), names(NULL), packed(NULL), exceptions(NULL), buckets(NULL), positions(NULL),
+	  mapping(NULL), mapping_size(0) {}
+
+ReferenceIndex::~ReferenceIndex()
+{
+	if(mapping != NULL)
+		munmap(mapping, mapping_size);
+}
+
+bool ReferenceIndex::open(std::string indexfile, std::string genomefile)
+{
+	int fd = ::open(indexfile.c_str(), O_RDONLY);
+
+	if(fd < 0)
+		return false;
+
+	struct stat st;
+
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)) {
+		close(fd);
+		return false;
+	}
+
+	void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if(data == MAP_FAILED)
+		return false;
+
+	const Header* h = (const Header*)data;
+	const char* base_address = (const char*)data;
+	uint64_t file_size = st.st_size;
+
+	// True if count items of the width starting at the offset are within the file
+	auto fits = [file_size](uint64_t offset, uint64_t count, uint64_t width) {
+		return count <= file_size / width && offset <= file_size - count * width;
+	};
+
+	bool valid = memcmp(h->magic, INDEX_MAGIC, 4) == 0 && h->version == INDEX_VERSION && h->k == INDEX_K && h->w == INDEX_W
+		&& h->bucket_bits < 32 && h->names <= h->packed
+		&& fits(h->chromosomes, h->chromosome_count, sizeof(Chromosome))
+		&& fits(h->packed, (h->genome_length + 31) / 32, sizeof(uint64_t))
+		&& fits(h->exceptions, h->exception_count, 2 * sizeof(uint64_t))
+		&& fits(h->buckets, (1ULL << h->bucket_bits) + 1, sizeof(uint32_t))
+		&& fits(h->positions, h->position_count, sizeof(uint32_t))
+		&& fits(h->filter, h->filter_size, 1);
+
+	for(uint32_t i = 0; valid && i < h->chromosome_count; i++) {
+		const Chromosome& c = ((const Chromosome*)(base_address + h->chromosomes))[i];
+		valid = c.start <= h->genome_length && c.length <= h->genome_length - c.start
+			&& c.name_offset <= h->packed - h->names && c.name_length <= h->packed - h->names - c.name_offset;
+	}
+
+	valid = valid && ((const uint32_t*)(base_address + h->buckets))[1ULL << h->bucket_bits] <= h->position_count;
+
+	// An index of another version of the genome file is stale. A copied or touched genome file only has to have the same contents.
+	struct stat genome;
+	uint32_t genome_checksum;
+
+	valid = valid && stat(genomefile.c_str(), &genome) == 0 && (uint64_t)genome.st_size == h->genome_size
+		&& (genome.st_mtime == h->genome_mtime || (fileChecksum(genomefile, genome_checksum) && genome_checksum == h->genome_checksum));
+
+	if(!valid || !filter.attach(base_address + h->filter, h->filter_size)) {
+		munmap(data, st.st_size);
+		return false;
+	}
+
+	mapping = data;
+	mapping_size = st.st_size;
+	header = h;
+	chromosomes = (const Chromosome*)(base_address + h->chromosomes);
+	names = base_address + h->names;
+	packed = (const uint64_t*)(base_address + h->packed);
+	exceptions = (const uint64_t*)(base_address + h->exceptions);
+	buckets = (const uint32_t*)(base_address + h->buckets);
+	positions = (const uint32_t*)(base_address + h->positions);
+
+	return true;
+}
+
+std::string ReferenceIndex::chromosomeName(unsigned i) const
+{
+	return std::string(names + chromosomes[i].name_offset, chromosomes[i].name_length);
+}
+
+unsigned ReferenceIndex::chromosomeAt(uint64_t pos) const
+{
+	unsigned low = 0, high = header->chromosome_count;
+
+	while(high - low > 1) {
+		unsigned middle = (low + high) / 2;
+		if(chromosomes[middle].start <= pos)
+			low = middle;
+		else
+			high = middle;
+	}
+
+	return low;
+}
+
+bool ReferenceIndex::plainRange(uint64_t from, uint64_t to) const
+{
+	// First exception run ending after from
+	uint64_t low = 0, high = header->exception_count;
+
+	while(low < high) {
+		uint64_t middle = (low + high) / 2;
+		if(exceptions[2 * middle] + exceptions[2 * middle + 1] <= from)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return low == header->exception_count || exceptions[2 * low] >= to;
+}
+
+unsigned ReferenceIndex::countMismatches(const std::string& read, uint64_t pos, unsigned limit) const
+{
+	static const char bases[4] = {'A', 'C', 'G', 'T'};
+	unsigned mismatches = 0;
+
+	for(size_t i = 0; i < read.length() && mismatches <= limit; i++)
+		if(bases[base(pos + i)] != read[i])
+			mismatches++;
+
+	return mismatches;
+}
+
+void ReferenceIndex::alignUngapped(const std::string& name, const std::string& read, unsigned maxMismatches, std::vector<Alignment>& alignments,
+	const std::string& chromosome, long from, long to) const
+{
+	if(!isOpen() || read.length() < INDEX_K)
+		return;
+
+	// Edits can only describe A, C, G, T and N
+	for(size_t i = 0; i < read.length(); i++)
+		if(baseCode(read[i]) < 0 && read[i] != 'N')
+			return;
+
+	std::string reverse_read = read;
+	std::reverse(reverse_read.begin(), reverse_read.end());
+	for(size_t i = 0; i < reverse_read.length(); i++)
+		reverse_read[i] = (baseCode(reverse_read[i]) < 0) ? 'N' : "TGCA"[baseCode(reverse_read[i])];
+
+	// Window of global start positions
+	uint64_t window_from = 0, window_to = header->genome_length;
+
+	if(chromosome != "") {
+		unsigned c = 0;
+		while(c < header->chromosome_count && chromosomeName(c) != chromosome)
+			c++;
+		if(c == header->chromosome_count)
+			return;
+		window_from = chromosomes[c].start + (from > 1 ? from - 1 : 0);
+		window_to = chromosomes[c].start + (to > 0 ? std::min((uint64_t)to, chromosomes[c].length) : 0);
+	}
+
+	// Candidate global starts, forward (false) or reverse (true) strand
+	std::vector<std::pair<uint64_t, bool> > candidates;
+
+	forMinimizers(read.length(),
+		[&](uint64_t i) -> int { return baseCode(read[i]); },
+		[&](uint64_t hash, uint64_t q) {
+			uint64_t bucket = hash >> (64 - header->bucket_bits);
+			const uint32_t* first = positions + buckets[bucket];
+			const uint32_t* last = positions + buckets[bucket + 1];
+
+			if(chromosome == "" && last - first > MAX_OCCURRENCES)
+				return;
+
+			// Occurrences that would put the read in the window
+			if(chromosome != "") {
+				uint64_t margin = read.length();
+				first = std::lower_bound(first, last, (uint32_t)(window_from > margin ? window_from - margin : 0));
+				last = std::upper_bound(first, last, (uint32_t)std::min(window_to + margin, header->genome_length));
+			}
+
+			for(; first != last; ++first) {
+				uint64_t r = *first;
+				if(r >= q)
+					candidates.push_back(std::make_pair(r - q, false));
+				if(r + q + INDEX_K >= read.length())
+					candidates.push_back(std::make_pair(r + q + INDEX_K - read.length(), true));
+			}
+		});
+
+	std::sort(candidates.begin(), candidates.end());
+	candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+	for(size_t i = 0; i < candidates.size(); i++) {
+
+		uint64_t pos = candidates[i].first;
+		bool reverse = candidates[i].second;
+
+		if(pos < window_from || pos >= window_to || pos + read.length() > header->genome_length)
+			continue;
+
+		unsigned c = chromosomeAt(pos);
+
+		if(pos + read.length() > chromosomes[c].start + chromosomes[c].length || !plainRange(pos, pos + read.length()))
+			continue;
+
+		// Edits are described on the forward strand, like the aligner does
+		const std::string& aligned = reverse ? reverse_read : read;
+
+		if(countMismatches(aligned, pos, maxMismatches) > maxMismatches)
+			continue;
+
+		std::vector<std::pair<int, char> > edits;
+
+		for(size_t j = 0; j < aligned.length(); j++)
+			if("ACGT"[base(pos + j)] != aligned[j])
+				edits.push_back(std::make_pair((int)j, aligned[j]));
+
+		alignments.push_back(Alignment(name, reverse ? 'R' : 'F', aligned.length(), chromosomeName(c), pos - chromosomes[c].start + 1, edits));
+	}
+}
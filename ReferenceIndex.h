@@ -0,0 +1,77 @@
+/*
+ * Readzip's own index of the reference: 2-bit packed chromosomes, a minimizer table and the k-mer filter for
+ * pre-screening. The index file is mapped to memory as is, so opening it takes no time regardless of the genome size.
+ *
+ */
+
+#ifndef _ReferenceIndex_H_
+#define _ReferenceIndex_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "Alignment.h"
+#include "BloomFilter.h"
+
+class ReferenceIndex {
+
+public:
+
+	ReferenceIndex();
+	~ReferenceIndex();
+
+	/* Builds the index of the genome file, the index is replaced atomically if it exists. */
+	static bool build(std::string genomefile, std::string indexfile);
+
+	/* Maps the index file to memory, returns false if it's missing, damaged, of another version or built from
+	 * another genome file (the size and modification time, or the checksum of the contents, differ). */
+	bool open(std::string indexfile, std::string genomefile);
+
+	inline bool isOpen() const {
+		return header != NULL;
+	}
+
+	inline const BloomFilter& getFilter() const {
+		return filter;
+	}
+
+	/* Finds the alignments of the read without indels that have at most maxMismatches mismatches.
+	 * If chromosome is given, only alignments starting between from and to (1-based) on it are looked for. */
+	void alignUngapped(const std::string& name, const std::string& read, unsigned maxMismatches, std::vector<Alignment>& alignments,
+		const std::string& chromosome = "", long from = 0, long to = 0) const;
+
+private:
+
+	struct Header;
+	struct Chromosome;
+
+	const Header* header;
+	const Chromosome* chromosomes;
+	const char* names;
+	const uint64_t* packed;
+	const uint64_t* exceptions;
+	const uint32_t* buckets;
+	const uint32_t* positions;
+	BloomFilter filter;
+
+	void* mapping;
+	size_t mapping_size;
+
+	inline int base(uint64_t pos) const {
+		return (packed[pos >> 5] >> ((pos & 31) << 1)) & 3;
+	}
+
+	/* Returns the chromosome containing the global position. */
+	unsigned chromosomeAt(uint64_t pos) const;
+
+	/* True if the range of global positions has only A, C, G and T in the reference. */
+	bool plainRange(uint64_t from, uint64_t to) const;
+
+	/* Counts the mismatches of the read against the reference at the global position, stops after limit. */
+	unsigned countMismatches(const std::string& read, uint64_t pos, unsigned limit) const;
+
+	std::string chromosomeName(unsigned i) const;
+
+};
+
+#endif // _ReferenceIndex_H_
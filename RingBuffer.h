@@ -0,0 +1,86 @@
+/*
+ * Bounded single-producer/single-consumer queue, used for connecting the stages of the compression pipeline
+ * without locks.
+ *
+ */
+
+#ifndef _RingBuffer_H_
+#define _RingBuffer_H_
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstddef>
+#include <utility>
+
+template<class T> class RingBuffer {
+
+public:
+
+	/* Queue for at most capacity items. */
+	explicit RingBuffer(size_t capacity)
+		: slots(capacity + 1), head(0), tail(0) {}
+
+	/* Moves the item to the queue, returns false (leaving the item as is) if the queue is full. Only called by the producer. */
+	bool push(T& item) {
+
+		size_t t = tail.load(std::memory_order_relaxed);
+		size_t next = (t + 1) % slots.size();
+
+		if(next == head.load(std::memory_order_acquire))
+			return false;
+
+		slots[t] = std::move(item);
+		tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	/* Takes the oldest item, returns false if the queue is empty. Only called by the consumer. */
+	bool pop(T& item) {
+
+		size_t h = head.load(std::memory_order_relaxed);
+
+		if(h == tail.load(std::memory_order_acquire))
+			return false;
+
+		item = std::move(slots[h]);
+		slots[h] = T();
+		head.store((h + 1) % slots.size(), std::memory_order_release);
+		return true;
+	}
+
+	/* Adds the item, waiting while the queue is full. */
+	void pushWait(T item) {
+
+		for(unsigned tries = 0; !push(item); tries++)
+			wait(tries);
+	}
+
+	/* Takes the oldest item, waiting while the queue is empty. */
+	void popWait(T& item) {
+
+		for(unsigned tries = 0; !pop(item); tries++)
+			wait(tries);
+	}
+
+private:
+
+	std::vector<T> slots;
+
+	// Apart so that the producer and the consumer don't share a cache line
+	alignas(64) std::atomic<size_t> head;
+	alignas(64) std::atomic<size_t> tail;
+
+	// Gives the other side the core for a while, then sleeps so that waiting stages don't take the cores of busy ones
+	static void wait(unsigned tries) {
+
+		if(tries < 64)
+			std::this_thread::yield();
+		else
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+	}
+
+};
+
+#endif // _RingBuffer_H_
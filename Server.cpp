@@ -0,0 +1,346 @@
+#include "Server.h"
+
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <cstdlib>
+#include <csignal>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "Job.h"
+#include "utils.h"
+
+// Requests are the working directory of the client and the arguments of the job separated by tabs, one line each.
+// The reply is one line starting with OK or ERROR.
+
+// Jobs run at the same time, further connections wait in the backlog of the socket
+const long MAX_RUNNING_JOBS = 16;
+
+// Latencies of the jobs run by the server
+struct latency_stats_t {
+	std::mutex lock;
+	long jobs;
+	long failed;
+	double total;
+	double longest;
+
+	latency_stats_t() : jobs(0), failed(0), total(0), longest(0) {}
+};
+
+static bool open_socket(const std::string& socket_path, int& fd, sockaddr_un& address) {
+
+	if(socket_path.size() >= sizeof(address.sun_path)) {
+		std::cerr << "Socket path " << socket_path << " is too long." << std::endl;
+		return false;
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socket_path.c_str());
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if(fd < 0) {
+		std::cerr << "Failure to create a socket: " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+static bool send_all(int fd, const std::string& data) {
+
+	for(size_t sent = 0; sent < data.size(); ) {
+
+		ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+
+		if(n <= 0)
+			return false;
+
+		sent += n;
+	}
+
+	return true;
+}
+
+static std::string receive_all(int fd) {
+
+	std::string data;
+	char buffer[4096];
+	ssize_t n;
+
+	while((n = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+		data.append(buffer, n);
+
+	return data;
+}
+
+// Absolute path of the file given relative to the directory, "" stays as it is
+static std::string resolve(const std::string& directory, const std::string& file) {
+
+	if(file.empty() || file[0] == '/')
+		return file;
+
+	return directory + "/" + file;
+}
+
+// Canonical path of the reference, so that a reference is loaded once however it's named
+static std::string canonical(const std::string& file) {
+
+	char path[PATH_MAX];
+
+	if(realpath(file.c_str(), path) == NULL)
+		return file;
+
+	return path;
+}
+
+static std::string run_request(const std::string& request, latency_stats_t& stats) {
+
+	std::istringstream lines(request);
+	std::string directory, row;
+
+	if(!getline(lines, directory) || !getline(lines, row))
+		return "ERROR Malformed request.";
+
+	std::vector<std::string> args(1, "readzip");
+	std::istringstream fields(row);
+	std::string field;
+
+	while(getline(fields, field, '\t'))
+		args.push_back(field);
+
+	if(args.size() == 2 && args[1] == "stats") {
+
+		std::unique_lock<std::mutex> guard(stats.lock);
+		std::ostringstream reply;
+
+		reply << "OK " << stats.jobs << " jobs, " << stats.failed << " failed, mean latency "
+			<< (stats.jobs > 0 ? stats.total / stats.jobs : 0) << " ms, longest " << stats.longest << " ms";
+
+		return reply.str();
+	}
+
+	job_t job;
+	run_options_t options;
+
+	std::string problem = parse_args(args, job, options);
+
+	if(problem == "" && (options.manifest != "" || options.help || options.threads != 0 || options.pin_threads))
+		problem = "The server only takes single jobs, the options of the run are given when starting it.";
+
+	job.genome_file = canonical(resolve(directory, job.genome_file));
+
+	for(unsigned i = 0; i < job.files.size(); i++) {
+
+		if(job.files[i] == "-")
+			problem = "The server can't use the standard input or output of the client.";
+
+		job.files[i] = resolve(directory, job.files[i]);
+	}
+
+	if(problem == "")
+		problem = detect_mode(job);
+
+	if(problem == "")
+		problem = check_job(job);
+
+	if(problem != "")
+		return "ERROR " + problem;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool ok = run_job(job);
+	double latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	{
+		std::unique_lock<std::mutex> guard(stats.lock);
+		stats.jobs++;
+		stats.failed += ok ? 0 : 1;
+		stats.total += latency;
+		stats.longest = std::max(stats.longest, latency);
+	}
+
+	std::ostringstream reply;
+	reply << (ok ? "OK " : "ERROR Job failed after ") << latency << " ms";
+
+	std::replace(row.begin(), row.end(), '\t', ' ');
+	std::cerr << "Job " << row << ": " << (ok ? "done" : "failed") << " in " << latency << " ms." << std::endl;
+
+	return reply.str();
+}
+
+int serve(const std::string& socket_path, const std::vector<std::string>& references) {
+
+	// SIGTERM and SIGINT are blocked before any threads start (the threads inherit the mask) and taken by a thread
+	// of their own, which stops the server between jobs
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGTERM);
+	sigaddset(&signals, SIGINT);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+	// Loaded before taking jobs, the first job of a reference doesn't wait for it
+	for(unsigned i = 0; i < references.size(); i++) {
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		load_reference(canonical(references[i])).getChromosomes();
+
+		std::cerr << "Loaded " << references[i] << " in "
+			<< std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms." << std::endl;
+	}
+
+	int fd;
+	sockaddr_un address;
+
+	if(!open_socket(socket_path, fd, address))
+		return 1;
+
+	// A socket left by a server that didn't stop cleanly
+	unlink(socket_path.c_str());
+
+	// Only the user running the server can send it jobs, they read and write files as that user
+	if(bind(fd, (sockaddr*)&address, sizeof(address)) < 0 || chmod(socket_path.c_str(), 0600) < 0 || listen(fd, 64) < 0) {
+		std::cerr << "Failure to listen on " << socket_path << ": " << strerror(errno) << std::endl;
+		close(fd);
+		return 1;
+	}
+
+	std::cerr << "Serving on " << socket_path << "." << std::endl;
+
+	std::atomic<bool> stopping(false);
+
+	// Shutting the socket down wakes up accept
+	std::thread signal_handler([&]() {
+		int signal = 0;
+		sigwait(&signals, &signal);
+		stopping = true;
+		shutdown(fd, SHUT_RDWR);
+	});
+
+	latency_stats_t stats;
+
+	// Jobs still running, they use the stats
+	std::mutex running_lock;
+	std::condition_variable finished;
+	long running = 0;
+
+	while(true) {
+
+		{
+			std::unique_lock<std::mutex> guard(running_lock);
+			finished.wait(guard, [&running]() { return running < MAX_RUNNING_JOBS; });
+		}
+
+		int client = accept(fd, NULL, NULL);
+
+		if(client < 0) {
+
+			if(errno == EINTR && !stopping)
+				continue;
+
+			if(!stopping)
+				std::cerr << "Failure to accept a connection: " << strerror(errno) << std::endl;
+			break;
+		}
+
+		{
+			std::unique_lock<std::mutex> guard(running_lock);
+			running++;
+		}
+
+		// Jobs run concurrently, their blocks share the pool of the process
+		std::thread([client, &stats, &running_lock, &finished, &running]() {
+			std::string reply = run_request(receive_all(client), stats);
+			send_all(client, reply + "\n");
+			close(client);
+
+			std::unique_lock<std::mutex> guard(running_lock);
+			running--;
+			finished.notify_all();
+		}).detach();
+	}
+
+	// Wakes up the signal handler if the server stopped for another reason
+	bool failed = !stopping;
+
+	if(failed)
+		pthread_kill(signal_handler.native_handle(), SIGTERM);
+
+	signal_handler.join();
+
+	close(fd);
+	unlink(socket_path.c_str());
+
+	std::unique_lock<std::mutex> guard(running_lock);
+
+	if(running > 0)
+		std::cerr << "Stopping, waiting for " << running << " jobs to finish." << std::endl;
+
+	finished.wait(guard, [&running]() { return running == 0; });
+
+	std::cerr << "Stopped after " << stats.jobs << " jobs." << std::endl;
+
+	return failed ? 1 : 0;
+}
+
+int submit(const std::string& socket_path, const std::vector<std::string>& args) {
+
+	int fd;
+	sockaddr_un address;
+
+	if(!open_socket(socket_path, fd, address))
+		return 1;
+
+	if(connect(fd, (sockaddr*)&address, sizeof(address)) < 0) {
+		std::cerr << "Failure to connect to the server at " << socket_path << ": " << strerror(errno) << std::endl;
+		close(fd);
+		return 1;
+	}
+
+	char directory[PATH_MAX];
+
+	if(getcwd(directory, sizeof(directory)) == NULL) {
+		std::cerr << "Failure to find the working directory." << std::endl;
+		close(fd);
+		return 1;
+	}
+
+	std::string request = std::string(directory) + "\n";
+
+	for(unsigned i = 0; i < args.size(); i++)
+		request += (i > 0 ? "\t" : "") + args[i];
+
+	request += "\n";
+
+	// The server reads the request until the end of the stream
+	if(!send_all(fd, request) || shutdown(fd, SHUT_WR) < 0) {
+		std::cerr << "Failure to send the job to the server." << std::endl;
+		close(fd);
+		return 1;
+	}
+
+	std::string reply = receive_all(fd);
+	close(fd);
+
+	if(!reply.empty() && reply[reply.size() - 1] == '\n')
+		reply.erase(reply.size() - 1);
+
+	if(reply.compare(0, 3, "OK ") != 0) {
+		std::cerr << "readzip: " << (reply.empty() ? "The server closed the connection." : reply) << std::endl;
+		return 1;
+	}
+
+	std::cerr << reply.substr(3) << std::endl;
+	return 0;
+}
@@ -0,0 +1,21 @@
+/*
+ * Server keeping references in memory between jobs: readzip serve listens on a Unix domain socket and runs the
+ * compression/decompression jobs that readzip client sends it, so that a job doesn't wait for its reference to load.
+ *
+ */
+
+#ifndef _Server_H_
+#define _Server_H_
+
+#include <string>
+#include <vector>
+
+/* Loads the references and runs the jobs sent to the socket until SIGTERM or SIGINT, which stop it taking jobs,
+ * wait for the running ones and remove the socket. Returns the exit status. */
+int serve(const std::string& socket_path, const std::vector<std::string>& references);
+
+/* Sends the job (command line arguments after the program) to the server and waits for it to finish.
+ * "stats" instead of a job gets the latencies of the jobs run so far. Returns the exit status. */
+int submit(const std::string& socket_path, const std::vector<std::string>& args);
+
+#endif // _Server_H_
@@ -0,0 +1,156 @@
+#include "ThreadPool.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+unsigned ThreadPool::default_threads = 0;
+bool ThreadPool::pin_threads = false;
+
+// Pool and queue of the worker running on this thread, for keeping tasks submitted by a task on its own queue
+static thread_local const ThreadPool* current_pool = NULL;
+static thread_local unsigned current_queue = 0;
+
+void ThreadPool::configure(unsigned threads, bool pin)
+{
+	default_threads = threads;
+	pin_threads = pin;
+}
+
+ThreadPool& ThreadPool::shared()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+ThreadPool::ThreadPool(unsigned threads)
+	: pending(0), dealt(0), stopping(false) {
+
+	if(threads == 0)
+		threads = default_threads;
+
+	if(threads == 0)
+		threads = std::thread::hardware_concurrency();
+
+	if(threads == 0)
+		threads = 1;
+
+	for(unsigned i = 0; i < threads; i++)
+		queues.push_back(std::unique_ptr<Queue>(new Queue()));
+
+	for(unsigned i = 0; i < threads; i++) {
+		workers.push_back(std::thread(&ThreadPool::work, this, i));
+
+#ifdef __linux__
+		unsigned cores = std::thread::hardware_concurrency();
+
+		if(pin_threads && cores > 0) {
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(i % cores, &set);
+			pthread_setaffinity_np(workers.back().native_handle(), sizeof(set), &set);
+		}
+#endif
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::unique_lock<std::mutex> guard(sleeping);
+		stopping = true;
+	}
+
+	available.notify_all();
+
+	for(unsigned i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+void ThreadPool::enqueue(std::function<void()> task)
+{
+	// Tasks of a worker stay on its queue, the others are dealt in turn
+	unsigned index = (current_pool == this) ? current_queue : dealt++ % queues.size();
+
+	// Counted before it's queued, so that taking it never finds the count at zero
+	{
+		std::unique_lock<std::mutex> guard(sleeping);
+		pending++;
+	}
+
+	{
+		std::unique_lock<std::mutex> guard(queues[index]->lock);
+		queues[index]->tasks.push_back(task);
+	}
+
+	available.notify_one();
+}
+
+bool ThreadPool::take(unsigned index, std::function<void()>& task)
+{
+	std::unique_lock<std::mutex> guard(queues[index]->lock);
+
+	if(queues[index]->tasks.empty())
+		return false;
+
+	task = queues[index]->tasks.front();
+	queues[index]->tasks.pop_front();
+	pending--;
+
+	return true;
+}
+
+bool ThreadPool::steal(unsigned index)
+{
+	for(unsigned i = 1; i < queues.size(); i++) {
+
+		Queue& victim = *queues[(index + i) % queues.size()];
+		std::deque<std::function<void()> > stolen;
+
+		{
+			std::unique_lock<std::mutex> guard(victim.lock);
+
+			// The newer half, the owner keeps on with the older tasks
+			size_t half = (victim.tasks.size() + 1) / 2;
+
+			for(size_t n = 0; n < half; n++) {
+				stolen.push_front(victim.tasks.back());
+				victim.tasks.pop_back();
+			}
+		}
+
+		if(!stolen.empty()) {
+			std::unique_lock<std::mutex> guard(queues[index]->lock);
+			queues[index]->tasks.insert(queues[index]->tasks.end(), stolen.begin(), stolen.end());
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ThreadPool::work(unsigned index)
+{
+	current_pool = this;
+	current_queue = index;
+
+	while(true) {
+
+		std::function<void()> task;
+
+		if(take(index, task) || (steal(index) && take(index, task))) {
+			task();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(sleeping);
+
+		// Tasks submitted before stopping are still run
+		if(pending == 0 && stopping)
+			return;
+
+		if(pending == 0)
+			available.wait(guard);
+	}
+}
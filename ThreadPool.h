@@ -0,0 +1,80 @@
+/*
+ * Work-stealing pool of worker threads running submitted tasks, used for coding the blocks of an archive concurrently.
+ * Every worker has a queue of its own: tasks submitted from outside the pool are dealt to the queues in turn, and a
+ * worker whose queue runs empty steals half of the tasks of another one, so that slow blocks don't leave cores idle.
+ *
+ */
+
+#ifndef _ThreadPool_H_
+#define _ThreadPool_H_
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+
+class ThreadPool {
+
+public:
+
+	/* Starts the given number of threads, or the configured number (one per core by default) if it's 0. */
+	explicit ThreadPool(unsigned threads = 0);
+
+	/* Waits for the submitted tasks to finish. */
+	~ThreadPool();
+
+	/* Sets the number of threads of the pools started without one, and whether their threads are pinned to cores. */
+	static void configure(unsigned threads, bool pin);
+
+	/* Pool shared by everything in the process, started with the configured number of threads on first use. */
+	static ThreadPool& shared();
+
+	inline unsigned size() const {
+		return workers.size();
+	}
+
+	/* Runs the task on one of the threads, the future gives its result. */
+	template<class T> std::future<T> submit(std::function<T()> task) {
+
+		std::shared_ptr<std::packaged_task<T()> > packaged(new std::packaged_task<T()>(task));
+		std::future<T> result = packaged->get_future();
+
+		enqueue([packaged]() { (*packaged)(); });
+
+		return result;
+	}
+
+private:
+
+	struct Queue {
+		std::mutex lock;
+		std::deque<std::function<void()> > tasks;
+	};
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<Queue> > queues;
+
+	// Tasks queued but not yet taken, the workers sleep while there are none
+	std::atomic<size_t> pending;
+	std::atomic<unsigned> dealt;
+	std::mutex sleeping;
+	std::condition_variable available;
+	bool stopping;
+
+	static unsigned default_threads;
+	static bool pin_threads;
+
+	void enqueue(std::function<void()> task);
+	void work(unsigned index);
+
+	bool take(unsigned index, std::function<void()>& task);
+	bool steal(unsigned index);
+
+};
+
+#endif // _ThreadPool_H_
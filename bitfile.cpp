@@ -116,6 +116,7 @@ bit_file_c::bit_file_c(void)
 {
     m_InStream = NULL;
     m_OutStream = NULL;
+    m_OwnsStream = false;
     m_BitBuffer = 0;
     m_BitCount = 0;
     m_Mode = BF_NO_MODE;
@@ -159,6 +160,7 @@ bit_file_c::bit_file_c(const char *fileName, const BF_MODES mode)
 {
     m_InStream = NULL;
     m_OutStream = NULL;
+    m_OwnsStream = false;
     m_BitBuffer = 0;
     m_BitCount = 0;
 
@@ -175,6 +177,7 @@ bit_file_c::bit_file_c(const char *fileName, const BF_MODES mode)
             else
             {
                 m_Mode = mode;
+                m_OwnsStream = true;
             }
             break;
 
@@ -189,6 +192,7 @@ bit_file_c::bit_file_c(const char *fileName, const BF_MODES mode)
             else
             {
                 m_Mode = mode;
+                m_OwnsStream = true;
             }
             break;
 
@@ -204,6 +208,7 @@ bit_file_c::bit_file_c(const char *fileName, const BF_MODES mode)
             else
             {
                 m_Mode = mode;
+                m_OwnsStream = true;
             }
             break;
 
@@ -252,8 +257,10 @@ bit_file_c::~bit_file_c(void)
 {
     if (m_InStream != NULL)
     {
-        m_InStream->close();
-        delete m_InStream;
+        if (m_OwnsStream)
+        {
+            delete m_InStream;
+        }
     }
 
     if (m_OutStream != NULL)
@@ -265,8 +272,14 @@ bit_file_c::~bit_file_c(void)
             m_OutStream->put(m_BitBuffer);
         }
 
-        m_OutStream->close();
-        delete m_OutStream;
+        if (m_OwnsStream)
+        {
+            delete m_OutStream;
+        }
+        else
+        {
+            m_OutStream->flush();
+        }
     }
 }
 
@@ -304,6 +317,7 @@ void bit_file_c::Open(const char *fileName, const BF_MODES mode)
             else
             {
                 m_Mode = mode;
+                m_OwnsStream = true;
             }
 
             m_BitBuffer = 0;
@@ -321,6 +335,7 @@ void bit_file_c::Open(const char *fileName, const BF_MODES mode)
             else
             {
                 m_Mode = mode;
+                m_OwnsStream = true;
             }
 
             m_BitBuffer = 0;
@@ -339,6 +354,7 @@ void bit_file_c::Open(const char *fileName, const BF_MODES mode)
             else
             {
                 m_Mode = mode;
+                m_OwnsStream = true;
             }
 
             m_BitBuffer = 0;
@@ -357,6 +373,45 @@ void bit_file_c::Open(const char *fileName, const BF_MODES mode)
     }
 }
 
+/***************************************************************************
+*   Method     : Open
+*   Description: These methods attach the bit file to an already open
+*                input or output stream (e.g. a string stream holding a
+*                block in memory).  The stream is not closed or freed by
+*                the bit file.  An exception will be thrown on error.
+*   Parameters : stream - The stream to read from or write to
+*   Effects    : Attaches the stream and initializes the bit buffer.
+*   Returned   : None
+*   Exception  : "Error: File Already Open" - if object has an open file
+***************************************************************************/
+void bit_file_c::Open(std::istream &stream)
+{
+    if ((m_InStream != NULL) || (m_OutStream != NULL))
+    {
+        throw("Error: File Already Open");
+    }
+
+    m_InStream = &stream;
+    m_OwnsStream = false;
+    m_Mode = BF_READ;
+    m_BitBuffer = 0;
+    m_BitCount = 0;
+}
+
+void bit_file_c::Open(std::ostream &stream)
+{
+    if ((m_InStream != NULL) || (m_OutStream != NULL))
+    {
+        throw("Error: File Already Open");
+    }
+
+    m_OutStream = &stream;
+    m_OwnsStream = false;
+    m_Mode = BF_WRITE;
+    m_BitBuffer = 0;
+    m_BitCount = 0;
+}
+
 /***************************************************************************
 *   Method     : Close
 *   Description: This method closes and frees any open file streams.  The
@@ -371,8 +426,10 @@ void bit_file_c::Close(void)
 {
     if (m_InStream != NULL)
     {
-        m_InStream->close();
-        delete m_InStream;
+        if (m_OwnsStream)
+        {
+            delete m_InStream;
+        }
 
         m_InStream = NULL;
         m_BitBuffer = 0;
@@ -389,8 +446,14 @@ void bit_file_c::Close(void)
             m_OutStream->put(m_BitBuffer);
         }
 
-        m_OutStream->close();
-        delete m_OutStream;
+        if (m_OwnsStream)
+        {
+            delete m_OutStream;
+        }
+        else
+        {
+            m_OutStream->flush();
+        }
 
         m_OutStream = NULL;
         m_BitBuffer = 0;
@@ -399,6 +462,29 @@ void bit_file_c::Close(void)
     }
 }
 
+/***************************************************************************
+*   Method     : TellBit
+*   Description: This method returns the position of the next bit to be
+*                written or read, counting from the start of the stream.
+*   Parameters : None
+*   Effects    : None
+*   Returned   : Position in bits, or -1 if no stream is open.
+***************************************************************************/
+std::streamoff bit_file_c::TellBit(void)
+{
+    if (m_OutStream != NULL)
+    {
+        return (std::streamoff)m_OutStream->tellp() * 8 + m_BitCount;
+    }
+
+    if (m_InStream != NULL)
+    {
+        return (std::streamoff)m_InStream->tellg() * 8 - m_BitCount;
+    }
+
+    return -1;
+}
+
 /***************************************************************************
 *   Method     : ByteAlign
 *   Description: This method aligns the bitfile to the nearest byte.  For
@@ -94,6 +94,8 @@ class bit_file_c
 
         /* open/close bit file */
         void Open(const char *fileName, const BF_MODES mode);
+        void Open(std::istream &stream);
+        void Open(std::ostream &stream);
         void Close(void);
 
         /* toss spare bits and byte align file */
@@ -121,14 +123,18 @@ class bit_file_c
         int PutBitsInt(void *bits, const unsigned int count,
             const size_t size);
 
+        /* number of bits written or read so far */
+        std::streamoff TellBit(void);
+
         /* status */
         bool eof(void);
         bool good(void);
         bool bad(void);
 
     private:
-        std::ifstream *m_InStream;      /* input file stream pointer */
-        std::ofstream *m_OutStream;     /* output file stream pointer */
+        std::istream *m_InStream;       /* input stream pointer */
+        std::ostream *m_OutStream;      /* output stream pointer */
+        bool m_OwnsStream;              /* stream was opened by the bit file */
         endian_t m_endian;              /* endianess of architecture */
         char m_BitBuffer;               /* bits waiting to be read/written */
         unsigned char m_BitCount;       /* number of bits in bitBuffer */
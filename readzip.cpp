@@ -1,10 +1,10 @@
-#include <getopt.h>
+#include <cstdio>
+#include <climits>
 #include <map>
-#include "AlignmentReader.h"
-#include "MethodA.h"
-#include "MethodB.h"
-#include "MethodC.h"
-#include "MethodD.h"
+#include "Job.h"
+#include "ReferenceIndex.h"
+#include "Server.h"
+#include "ThreadPool.h"
 #include "utils.h"
 
 void print_help() {
@@ -17,312 +17,171 @@ void print_help() {
 			<< " -a                    Compress single-end reads, maintain order." << std::endl
 			<< " -b                    Compress single-end reads, do not maintain order." << std::endl
 			<< " -c                    Compress paired-end reads, maintain order." << std::endl
-			<< " -d                    Compress paired-end reads, do not maintain order." << std::endl << std::endl
-			<< " Input formats:" << std::endl
+			<< " -d                    Compress paired-end reads, do not maintain order." << std::endl
+			<< "                       Decompressing, the method is read from the archive unless it's streamed." << std::endl << std::endl
+			<< " Input formats (compression only):" << std::endl
 			<< " -f                    Fasta format." << std::endl
-			<< " -q                    Fastq format." << std::endl << std::endl;
+			<< " -q                    Fastq format." << std::endl
+			<< " -s                    SAM/BAM alignments, compressed without realigning." << std::endl
+			<< "                       Paired methods take both mates from the one file." << std::endl << std::endl
+			<< " Threading options:" << std::endl
+			<< " -t N, --threads N     Code the blocks on N threads (default: one per core)." << std::endl
+			<< " --affinity            Pin the threads to cores." << std::endl << std::endl
+			<< " Compression options:" << std::endl
+			<< " --append              Add the reads after the ones in the existing archive (methods a and c)." << std::endl
+			<< " --sort-blocks         Code the reads of every block sorted by position, smaller but --reads" << std::endl
+			<< "                       decodes whole blocks (method a)." << std::endl << std::endl
+			<< " Decompression options:" << std::endl
+			<< " --reads FROM-TO       Decompress only reads (pairs) FROM to TO, counting from 1 (methods a and c)." << std::endl
+			<< " --region CHR:FROM-TO  Decompress only reads (pairs) overlapping the region (methods b and d)." << std::endl
+			<< "                       CHR alone gives the whole chromosome, * gives the unaligned reads." << std::endl << std::endl
+			<< " Streaming:" << std::endl
+			<< " -                     Any input or output file given as - is the standard input or output." << std::endl
+			<< "                       Methods a and c compress from the standard input in constant memory; for" << std::endl
+			<< "                       method c two - inputs (or outputs) interleave the mates. Methods b and d" << std::endl
+			<< "                       decompress from the standard input but compress from files only." << std::endl << std::endl
+			<< " Batch mode:" << std::endl
+			<< " --batch FILE          Run a job for every line of the manifest FILE, the line giving the input and" << std::endl
+			<< "                       output files of the job. The reference is loaded once for all of them." << std::endl
+			<< " --jobs N              Run N jobs of the batch at a time (default: one per thread)." << std::endl << std::endl
+			<< " Indexing:" << std::endl
+			<< " readzip index ref     Build the aligner index and the readzip index (ref.rzi) of the reference." << std::endl << std::endl
+			<< " Merging:" << std::endl
+			<< " readzip merge out in1 in2 ..." << std::endl
+			<< "                       Merge sorted archives of method b or d into one without decompressing the reads." << std::endl << std::endl
+			<< " Transcoding:" << std::endl
+			<< " readzip transcode -a|-b|-c|-d ref in out" << std::endl
+			<< "                       Transcode the archive into one of the method (a and b, c and d)" << std::endl
+			<< "                       without realigning the reads." << std::endl << std::endl
+			<< " Verifying:" << std::endl
+			<< " readzip verify archive ..." << std::endl
+			<< "                       Check the checksums and records of archives without the reference." << std::endl << std::endl
+			<< " Server:" << std::endl
+			<< " readzip serve SOCKET [ref ...]" << std::endl
+			<< "                       Keep the references loaded and run the jobs sent to the Unix socket." << std::endl
+			<< " readzip client SOCKET options ref files" << std::endl
+			<< "                       Run the job on the server, \"readzip client SOCKET stats\" gives the job latencies." << std::endl << std::endl;
 }
 
+// Builds the readaligner index and readzip's own index of the reference.
+int build_index(const std::string& genome_file) {
 
-enum packing_mode_t {packing_mode_undef, packing_mode_a, packing_mode_b, packing_mode_c, packing_mode_d };
-enum pack_unpack_mode_t {mode_undef, zip_mode, unzip_mode };
-
-int main(int argc, char **argv) 
-{
-
-	packing_mode_t mode = packing_mode_undef;
-	pack_unpack_mode_t xc_mode = mode_undef;
-	read_mode_t read_mode = read_mode_undef;
-
-	// Parse command line parameters
-	int option_index = 0;
-	int c;
-	while((c = getopt(argc, argv, "abcdxofqh")) != -1)
-
-	{
-
-	switch(c)
-		{
-		case 'a':
+	if(!run_program({"./readaligner/builder", genome_file})) {
+		std::cerr << "Error! Failure in building the aligner index." << std::endl;
+		return 1;
+	}
 
-			if(mode != packing_mode_undef) {
-				std::cerr << "readzip: Conflicting mode parameters." << std::endl;
-				exit(1);
+	if(!ReferenceIndex::build(genome_file, genome_file + ".rzi")) {
+		std::cerr << "Error! Failure in building the readzip index." << std::endl;
+		return 1;
+	}
 
-			}
+	std::cerr << "Done indexing." << std::endl;
+	return 0;
+}
 
-			mode = packing_mode_a; break;
-		case 'b':
-			if(mode != packing_mode_undef) {
-				std::cerr << "readzip: Conflicting mode parameters." << std::endl;
-				exit(1);
+int main(int argc, char **argv) 
+{
 
-			}
+	if(argc > 1 && string(argv[1]) == "index") {
+		if(argc != 3) {
+			cerr << "readzip: usage: readzip index reference.fasta" << endl;
+			return 1;
+		}
+		return build_index(argv[2]);
+	}
 
-			mode = packing_mode_b; break;
-		case 'c':
-			if(mode != packing_mode_undef) {
-				std::cerr << "readzip: Conflicting mode parameters." << std::endl;
-				exit(1);
+	if(argc > 1 && string(argv[1]) == "merge") {
+		if(argc < 4) {
+			cerr << "readzip: usage: readzip merge merged.rz archive.rz ..." << endl;
+			return 1;
+		}
+		return merge(argv[2], std::vector<std::string>(argv + 3, argv + argc)) ? 0 : 1;
+	}
 
-			}
+	if(argc > 1 && string(argv[1]) == "verify") {
+		if(argc < 3) {
+			cerr << "readzip: usage: readzip verify archive.rz ..." << endl;
+			return 1;
+		}
+		return verify(std::vector<std::string>(argv + 2, argv + argc)) ? 0 : 1;
+	}
 
-			mode = packing_mode_c; break;
-		case 'd':
-			if(mode != packing_mode_undef) {
-				std::cerr << "readzip: Conflicting mode parameters." << std::endl;
-				exit(1);
+	if(argc > 1 && string(argv[1]) == "transcode") {
+		std::map<std::string, packing_mode_t> modes = {{"-a", packing_mode_a}, {"-b", packing_mode_b}, {"-c", packing_mode_c}, {"-d", packing_mode_d}};
+		if(argc != 6 || !modes.count(argv[2])) {
+			cerr << "readzip: usage: readzip transcode -a|-b|-c|-d reference.fasta archive.rz transcoded.rz" << endl;
+			return 1;
+		}
+		return transcode(modes[argv[2]], argv[3], argv[4], argv[5]) ? 0 : 1;
+	}
 
-			}
+	if(argc > 1 && string(argv[1]) == "serve") {
+		if(argc < 3) {
+			cerr << "readzip: usage: readzip serve socket [reference.fasta ...]" << endl;
+			return 1;
+		}
+		return serve(argv[2], std::vector<std::string>(argv + 3, argv + argc));
+	}
 
-			mode = packing_mode_d; break;
-		case 'x':
-			if(xc_mode != mode_undef) {
-				std::cerr << "readzip: Conflicting mode parameters." << std::endl;
-				exit(1);
+	if(argc > 1 && string(argv[1]) == "client") {
+		if(argc < 4) {
+			cerr << "readzip: usage: readzip client socket options reference files | readzip client socket stats" << endl;
+			return 1;
+		}
+		return submit(argv[2], std::vector<std::string>(argv + 3, argv + argc));
+	}
 
-			}
-			xc_mode = unzip_mode; break;
-		case 'o':
-			if(xc_mode != mode_undef) {
-				std::cerr << "readzip: Conflicting mode parameters." << std::endl;
-				exit(1);
+	job_t job;
+	run_options_t options;
 
-			}
-			xc_mode = zip_mode; break;
-		case 'f':
-			if(read_mode != read_mode_undef) {
-				std::cerr << "readzip: Conflicting mode parameters." << std::endl;
-				exit(1);
+	std::string problem = parse_args(std::vector<std::string>(argv, argv + argc), job, options);
 
-			}			
-			read_mode = read_mode_fasta;
-			break;
-		case 'q':
-			if(read_mode != read_mode_undef) {
-				std::cerr << "readzip: Conflicting mode parameters." << std::endl;
-				exit(1);
+	if(problem != "") {
+		cerr << "readzip: " << problem << endl;
+		return 1;
+	}
 
-			}			
-			read_mode = read_mode_fastq;
-			break;
-		case 'h':
-			print_help();
-			exit(0);
-		}
+	if(options.help) {
+		print_help();
+		return 0;
 	}
 
-	if (argc - optind == 0)
+	if(job.genome_file == "")
 	{
 		cerr << "readzip: for help on usage, use option -h." << endl;
 		return 1;
 	}
 
+	ThreadPool::configure(options.threads, options.pin_threads);
 
-	// Sanity checks
-	if(read_mode == read_mode_undef) {
-		cerr << "readzip: Please specify either fasta or fastq format." << endl;
-		exit(1);
-	}
-	if(xc_mode == mode_undef) {
-		cerr << "readzip: Please specify either compression or decompression mode." << endl;
-		exit(1);
-	}
-	if(mode == packing_mode_undef) {
-		cerr << "readzip: Please specify method a, b, c or d." << endl;
-		exit(1);
-	}
-
-	string genome_file, output_file, input_file;
-
-	// TODO Calling each mode (fill up as modes are implemented)
-	switch(mode) {
-
-		case packing_mode_a:
-		{
-
-			// Parse filenames
-			if (argc - optind < 3)
-			{
-				cerr << "readzip: missing input files!" << endl;
-				return 1;
-			}
-
-			genome_file = string(argv[optind++]); 
-
-			input_file = string(argv[optind++]);
-
-			output_file = string(argv[optind++]);
-
-
-			if(xc_mode == zip_mode) {
+	if(options.manifest != "") {
 
-				string alignment_file = input_file + ".tab";
+		// The files come from the manifest, checked there. Decompressing, the method can come from each archive.
+		job.files.assign(job_files(job), "");
+		problem = (job.xc_mode == unzip_mode && job.mode == packing_mode_undef) ? "" : check_job(job);
 
-				std::string index = genome_file;
-
-				// Call to align
-				if(!(align_single(input_file, index, alignment_file, read_mode))) {
-					std::cerr << "Error! Failure in aligning the reads." << std::endl;
-					exit(1);
-				}
-
-				if(MethodA::compress_A(alignment_file, output_file, genome_file)) {
-					std::cerr << "Done compressing." << std::endl;
-				}
-				else
-					std::cerr << "Error! Something went wrong with the compression!" << std::endl;
-
-				system(("rm " + alignment_file).c_str());
-
-			}
-			else {
-
-				if(MethodA::decompress_A(input_file, output_file, genome_file)) {
-					std::cerr << "Done decompressing." << std::endl;
-				}
-				else
-					std::cerr << "Error! Something went wrong with the decompression!" << std::endl;
-			}
-
-			break;
-		}			
-		case packing_mode_b:
-
-			genome_file = string(argv[optind++]); 
-			input_file = string(argv[optind++]);
-			output_file = string(argv[optind++]);
-
-			if(xc_mode == zip_mode) {
-				string alignment_file = input_file + ".tab";
-				std::string index = genome_file;
-
-				// Call to align
-				if(!(align_single(input_file, index, alignment_file, read_mode, false))) {
-					std::cerr << "Error! Failure in aligning the reads." << std::endl;
-					exit(1);
-				}
-
-				if(MethodB::compress(alignment_file, output_file, genome_file)) {
-					std::cerr << "Done compressing." << std::endl;
-				}
-				else
-					std::cerr << "Error! Something went wrong with the compression!" << std::endl;
-				system(("rm " + alignment_file).c_str());
-			}
-			else {
-				if(MethodB::decompress(input_file, output_file, genome_file)) {
-					std::cerr << "Done decompressing." << std::endl;
-				}
-				else
-					std::cerr << "Error! Something went wrong with the compression!" << std::endl;
-			}
-			break;
-
-		case packing_mode_c:
-
-		{
-
-			// Parse filenames
-			if (argc - optind < 4)
-			{
-				cerr << "readzip: missing input files!" << endl;
-				return 1;
-			}
-
-			string genome_file = string(argv[optind++]); 
-
-			if(xc_mode == zip_mode) {
-
-				string input_file_1 = string(argv[optind++]);
-
-				string input_file_2 = string(argv[optind++]);
-
-				string output_file = string(argv[optind++]);
-
-				string alignment_file_1 = input_file_1 + ".tab";
-				string alignment_file_2 = input_file_2 + ".tab";
-
-				std::string index = genome_file;
-
-				// Call to align
-				if(!(align_pair(input_file_1, input_file_2, index, alignment_file_1, alignment_file_2, read_mode))) {
-					std::cerr << "Error! Failure in aligning the reads." << std::endl;
-					exit(1);
-				}
-
-				if(MethodC::compress_C(alignment_file_1, alignment_file_2, output_file, genome_file)) {
-					std::cerr << "Done compressing." << std::endl;
-				}
-				else
-					std::cerr << "Error! Something went wrong with the compression!" << std::endl;
-
-				system(("rm " + alignment_file_1).c_str());
-				system(("rm " + alignment_file_2).c_str());
-
-			}
-			else {
-
-				string input_file = string(argv[optind++]);
-
-				string output_file_1 = string(argv[optind++]);
-				string output_file_2 = string(argv[optind++]);
-
-				if(MethodC::decompress_C(input_file, output_file_1, output_file_2, genome_file)) {
-					std::cerr << "Done decompressing." << std::endl;
-				}
-				else
-					std::cerr << "Error! Something went wrong with the decompression!" << std::endl;
-			}
-
-			break;
-		}			
-
-		case packing_mode_d:
-
-			string genome_file = string(argv[optind++]); 
-
-			if(xc_mode == zip_mode) {
-				string input_file_1 = string(argv[optind++]);
-
-				string input_file_2 = string(argv[optind++]);
-
-				string output_file = string(argv[optind++]);
-
-				string alignment_file_1 = input_file_1 + ".tab";
-				string alignment_file_2 = input_file_2 + ".tab";
-
-				std::string index = genome_file;
-
-				// Call to align
-				if(!(align_pair(input_file_1, input_file_2, index, alignment_file_1, alignment_file_2, read_mode, false))) {
-					std::cerr << "Error! Failure in aligning the reads." << std::endl;
-					exit(1);
-				}
-
-				if(MethodD::compress(alignment_file_1, alignment_file_2, output_file, genome_file)) {
-					std::cerr << "Done compressing." << std::endl;
-				}
-				else
-					std::cerr << "Error! Something went wrong with the compression!" << std::endl;
-//				system(("rm " + alignment_file_1).c_str());
-//				system(("rm " + alignment_file_2).c_str());
+		if(problem != "") {
+			cerr << "readzip: " << problem << endl;
+			return 1;
+		}
 
-			}
-			else {
-				string input_file = string(argv[optind++]);
+		return run_batch(job, options.manifest, options.jobs) ? 0 : 1;
+	}
 
-				string output_file_1 = string(argv[optind++]);
-				string output_file_2 = string(argv[optind++]);
+	problem = detect_mode(job);
 
-				if(MethodD::decompress(input_file, output_file_1, output_file_2, genome_file)) {
-					std::cerr << "Done decompressing." << std::endl;
-				}
-				else
-					std::cerr << "Error! Something went wrong with the decompression!" << std::endl;
-			}
-			break;
+	if(problem == "")
+		problem = check_job(job);
 
+	if(problem != "") {
+		cerr << "readzip: " << problem << endl;
+		return 1;
 	}
 
+	// Reads and archives can be streamed through the standard input and output. Only a single job uses them,
+	// the streams are left synchronized for the concurrent jobs of a batch.
+	std::ios::sync_with_stdio(false);
+
+	return run_job(job) ? 0 : 1;
 }
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Compares the size of pairs of the three library orientations (fr, rf and ff, see simulate.awk) compressed with
+# methods c and d, all aligned and with 30% of the pairs unaligned: sh tests/bench_orientation.sh [pairs] from the
+# top directory, 20000 pairs of each by default. A block of one orientation codes the strand of the second mate in no
+# bits and unaligned pairs code no orientation, so the sizes should be about the same for the three orientations.
+
+n=${1:-20000}
+
+RZ_DATA=$(mktemp -d "${TMPDIR:-/tmp}/readzip-bench.XXXXXX") || exit 1
+trap 'rm -rf "$RZ_DATA"' EXIT
+trap 'exit 1' INT TERM
+
+awk -f tests/simulate.awk -v what=reference > "$RZ_DATA/ref.fa" &&
+	./readzip index "$RZ_DATA/ref.fa" > "$RZ_DATA/index.log" 2>&1 || {
+		echo "Failure in building the index:"
+		cat "$RZ_DATA/index.log"
+		exit 1
+	}
+
+printf "%-12s %10s %8s %12s %12s\n" orientation unaligned pairs "c bytes/pair" "d bytes/pair"
+
+for unaligned in 0 300; do
+	for orientation in fr rf ff; do
+
+		pairs="$RZ_DATA/$orientation.$unaligned"
+		awk -f tests/simulate.awk -v what=pairs -v n=$n -v orientation=$orientation -v unaligned=$unaligned -v out="$pairs" "$RZ_DATA/ref.fa"
+
+		for method in c d; do
+			./readzip -${method}of "$RZ_DATA/ref.fa" "${pairs}_1.fa" "${pairs}_2.fa" "$pairs.$method" > "$pairs.$method.log" 2>&1 || {
+				echo "Failure in compressing the $orientation pairs with method $method:"
+				tail -n 30 "$pairs.$method.log"
+				exit 1
+			}
+		done
+
+		awk -v o=$orientation -v u=$((unaligned / 10))% -v n=$n -v c=$(wc -c < "$pairs.c") -v d=$(wc -c < "$pairs.d") \
+			'BEGIN { printf "%-12s %10s %8d %12.2f %12.2f\n", o, u, n, c / n, d / n }'
+	done
+done
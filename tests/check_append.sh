@@ -0,0 +1,50 @@
+# --append adds the reads of another lane to an archive of method a or c as new blocks after the old ones, written
+# over the old table in place. A failed append puts the old table back.
+
+. tests/common.sh
+
+# Two lanes of the reads, the first ending within a block
+head -n 80000 "$MANY" > "$W/lane1.fa"
+tail -n +80001 "$MANY" > "$W/lane2.fa"
+
+rz -aof "$REF" "$W/lane1.fa" "$W/a.rz"
+rz -aof --append "$REF" "$W/lane2.fa" "$W/a.rz"
+rz -axf "$REF" "$W/a.rz" "$W/a.out"
+same_reads "$MANY" "$W/a.out"
+
+# Read numbers go on from the old reads
+rz -axf --reads 39990-40010 "$REF" "$W/a.rz" "$W/a.range"
+reads "$MANY" | sed -n 39990,40010p | cmp -s - "$W/a.range" || fail "reads 39990-40010 differ"
+
+# A third lane
+rz -aof --append "$REF" "$READS" "$W/a.rz"
+rz -axf "$REF" "$W/a.rz" "$W/a3.out"
+cat "$MANY" "$READS" > "$W/lanes.fa"
+same_reads "$W/lanes.fa" "$W/a3.out"
+rz verify "$W/a.rz"
+
+head -n 1600 "$PAIRS_1" > "$W/lane1_1.fa"
+head -n 1600 "$PAIRS_2" > "$W/lane1_2.fa"
+tail -n +1601 "$PAIRS_1" > "$W/lane2_1.fa"
+tail -n +1601 "$PAIRS_2" > "$W/lane2_2.fa"
+
+rz -cof "$REF" "$W/lane1_1.fa" "$W/lane1_2.fa" "$W/c.rz"
+rz -cof --append "$REF" "$W/lane2_1.fa" "$W/lane2_2.fa" "$W/c.rz"
+rz -cxf "$REF" "$W/c.rz" "$W/c_1" "$W/c_2"
+same_pairs "$PAIRS_1" "$PAIRS_2" "$W/c_1" "$W/c_2"
+
+# The archive is appended to in place, not rewritten
+inode=$(ls -i "$W/c.rz" | cut -d ' ' -f 1)
+rz -cof --append "$REF" "$W/lane2_1.fa" "$W/lane2_2.fa" "$W/c.rz"
+[ "$(ls -i "$W/c.rz" | cut -d ' ' -f 1)" = "$inode" ] || fail "the archive was rewritten to append to it"
+
+# Failed appends leave the archive as it was: a missing input, another method, and a SAM file ending with a lone
+# mate, found after more than a block of new pairs has been written over the old table
+cp "$W/c.rz" "$W/c.before"
+rz_fails -cof --append "$REF" "$W/missing_1.fa" "$W/missing_2.fa" "$W/c.rz"
+rz_fails -aof --append "$REF" "$READS" "$W/c.rz"
+simulate what=sam -v n=70000 -v len=36 > "$W/lone.sam"
+printf 'lone\t77\t*\t0\t0\t*\t*\t0\t0\tACGT\t*\n' >> "$W/lone.sam"
+rz_fails -cos --append "$REF" "$W/lone.sam" "$W/c.rz"
+cmp -s "$W/c.rz" "$W/c.before" || fail "a failed append changed the archive"
+rz verify "$W/c.rz"
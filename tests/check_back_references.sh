@@ -0,0 +1,33 @@
+# Method a codes a read repeating one of the last reads since the indexed one before it as how many reads back the
+# copy is. The indexed reads (every 1024th) are where decoding a range starts, no back-reference reaches past them.
+
+. tests/common.sh
+
+# 100 reads over and over, except for a read x at 1024 and 1025 (the indexed read, where it can't refer back to
+# 1024), at 2048 (1023 reads back to 1025, the furthest a back-reference reaches) and at 2049 and 2050 (the next
+# indexed read and a copy right after it)
+reads "$MANY" | head -n 101 | awk '
+	NR <= 100 { read[NR] = $0 }
+	NR == 101 { x = $0 }
+	END {
+		for(i = 1; i <= 3000; i++) {
+			print ">r" i
+			print (i == 1024 || i == 1025 || i == 2048 || i == 2049 || i == 2050) ? x : read[(i - 1) % 100 + 1]
+		}
+	}' > "$W/copies.fa"
+
+rz -aof "$REF" "$W/copies.fa" "$W/a.rz"
+rz -axf "$REF" "$W/a.rz" "$W/a.out"
+same_reads "$W/copies.fa" "$W/a.out"
+rz verify "$W/a.rz"
+
+for r in 1024-1024 1025-1025 1025-1030 2048-2048 2049-2050 2040-2060; do
+	rz -axf --reads $r "$REF" "$W/a.rz" "$W/a.$r"
+	same_range "$W/copies.fa" ${r%-*} ${r#*-} "$W/a.$r"
+done
+
+# The copies cost little next to as many different reads
+head -n 6000 "$MANY" > "$W/different.fa"
+rz -aof "$REF" "$W/different.fa" "$W/different.rz"
+echo "$(wc -c < "$W/a.rz") bytes with the copies, $(wc -c < "$W/different.rz") without"
+[ "$(wc -c < "$W/a.rz")" -lt $(( $(wc -c < "$W/different.rz") / 2 )) ] || fail "copies of recent reads aren't coded short"
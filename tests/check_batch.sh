@@ -0,0 +1,61 @@
+# --batch runs the jobs of a manifest against one loaded reference, several at a time. Jobs reading the same input
+# don't share temporary files, and a missing index is built once before the jobs start.
+
+. tests/common.sh
+
+cp "$REF" "$REF.fmi" "$REF.reverse.fmi" "$W/"
+mkdir -p "$W/tmp"
+TMPDIR=$W/tmp
+export TMPDIR
+awk -f tests/simulate.awk -v what=reads -v n=500 -v seed=38 "$REF" > "$W/other.fa"
+
+# Three jobs compress the same reads
+cat > "$W/compress.txt" <<MANIFEST
+# reads archive
+$READS $W/1.rz
+$W/other.fa $W/2.rz
+
+$READS $W/3.rz
+$READS $W/4.rz
+MANIFEST
+
+rz -aof --batch "$W/compress.txt" --jobs 4 "$W/ref.fa" 2> "$W/compress.log"
+cat "$W/compress.log"
+[ "$(grep -c "^Building the reference index" "$W/compress.log")" -eq 1 ] || fail "the index wasn't built once"
+grep -q "^Batch: 4 of 4 jobs succeeded\.$" "$W/compress.log" || fail "no report of the batch"
+
+cat > "$W/decompress.txt" <<MANIFEST
+$W/1.rz $W/1.out
+$W/2.rz $W/2.out
+$W/3.rz $W/3.out
+$W/4.rz $W/4.out
+MANIFEST
+
+rz -axf --batch "$W/decompress.txt" --jobs 2 "$W/ref.fa"
+same_reads "$READS" "$W/1.out"
+same_reads "$W/other.fa" "$W/2.out"
+same_reads "$READS" "$W/3.out"
+same_reads "$READS" "$W/4.out"
+
+# Paired jobs
+cat > "$W/pairs.txt" <<MANIFEST
+$PAIRS_1 $PAIRS_2 $W/c1.rz
+$PAIRS_1 $PAIRS_2 $W/c2.rz
+MANIFEST
+
+rz -cof --batch "$W/pairs.txt" --jobs 2 "$W/ref.fa"
+rz -cxf "$W/ref.fa" "$W/c1.rz" "$W/c1_1" "$W/c1_2"
+same_pairs "$PAIRS_1" "$PAIRS_2" "$W/c1_1" "$W/c1_2"
+cmp "$W/c1.rz" "$W/c2.rz" || fail "the jobs of the same pairs gave different archives"
+
+# A failing job fails the batch, the others still run
+echo "$W/missing.fa $W/5.rz" > "$W/failing.txt"
+echo "$READS $W/6.rz" >> "$W/failing.txt"
+rz_fails -aof --batch "$W/failing.txt" "$W/ref.fa"
+rz -axf "$W/ref.fa" "$W/6.rz" "$W/6.out"
+same_reads "$READS" "$W/6.out"
+
+# Every job removed its temporary files, and none were written next to the inputs
+[ -z "$(ls "$W/tmp")" ] || fail "temporary files were left behind: $(ls "$W/tmp")"
+ls "$RZ_DATA" | grep -q '\.\(tmp\|unique\|tab\)$' && fail "temporary files next to the inputs"
+true
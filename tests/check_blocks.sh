@@ -0,0 +1,26 @@
+# Archives are written as independent blocks of 65536 reads coded on a pool of threads, the archive is the same
+# whatever the number of threads.
+
+. tests/common.sh
+
+# verify prints "archive: OK, N reads in M blocks."
+blocks() {
+	./readzip verify "$1" 2>&1 | sed -n 's/.* in \([0-9]*\) blocks\./\1/p'
+}
+
+for method in a b; do
+
+	rz -${method}of -t 1 "$REF" "$MANY" "$W/$method.1.rz"
+	rz -${method}of -t 3 "$REF" "$MANY" "$W/$method.3.rz"
+	cmp "$W/$method.1.rz" "$W/$method.3.rz" || fail "method $method codes differently on 3 threads"
+	[ "$(blocks "$W/$method.3.rz")" -ge 2 ] || fail "70000 reads are in one block"
+done
+
+rz -axf "$REF" "$W/a.3.rz" "$W/a.out"
+same_reads "$MANY" "$W/a.out"
+rz -bxf "$REF" "$W/b.3.rz" "$W/b.out"
+same_read_set "$MANY" "$W/b.out"
+
+rz -cof -t 1 "$REF" "$PAIRS_1" "$PAIRS_2" "$W/c.1.rz"
+rz -cof -t 2 "$REF" "$PAIRS_1" "$PAIRS_2" "$W/c.2.rz"
+cmp "$W/c.1.rz" "$W/c.2.rz" || fail "method c codes differently on 2 threads"
@@ -0,0 +1,40 @@
+# Methods b and d code a run of identical records after the first one as its length, and decode the run by copying
+# the first read. A run is cut at the end of a block, the next block starts with the read in full.
+
+. tests/common.sh
+
+# A read 70000 times runs over the end of the first block (65536 reads), and another read follows 3 times
+simulate what=reads -v n=2 -v seed=5 > "$W/two.fa"
+head -n 2 "$W/two.fa" > "$W/one.fa"
+copies 70000 "$W/one.fa" > "$W/run.fa"
+sed -n 3,4p "$W/two.fa" | copies 3 /dev/stdin >> "$W/run.fa"
+
+rz -bof "$REF" "$W/run.fa" "$W/b.rz"
+rz -bxf "$REF" "$W/b.rz" "$W/b.out"
+same_read_set "$W/run.fa" "$W/b.out"
+rz verify "$W/b.rz"
+
+# Two blocks of a read and a run each
+echo "$(wc -c < "$W/b.rz") bytes"
+[ "$(wc -c < "$W/b.rz")" -lt 500 ] || fail "the run isn't coded as runs"
+
+# The regions of the chromosomes have all the copies, the second block starting within the run
+: > "$W/regions"
+for chromosome in $(sed -n 's/^>\([^ ]*\).*/\1/p' "$REF"); do
+	rz -bxf --region "$chromosome" "$REF" "$W/b.rz" "$W/b.region"
+	cat "$W/b.region" >> "$W/regions"
+done
+same_read_set "$W/run.fa" "$W/regions"
+
+# The same with a pair
+simulate what=pairs -v n=1 -v seed=5 -v out="$W/pair"
+copies 70000 "$W/pair_1.fa" > "$W/run_1.fa"
+copies 70000 "$W/pair_2.fa" > "$W/run_2.fa"
+
+rz -dof "$REF" "$W/run_1.fa" "$W/run_2.fa" "$W/d.rz"
+rz -dxf "$REF" "$W/d.rz" "$W/d_1" "$W/d_2"
+same_pair_set "$W/run_1.fa" "$W/run_2.fa" "$W/d_1" "$W/d_2"
+rz verify "$W/d.rz"
+
+echo "$(wc -c < "$W/d.rz") bytes"
+[ "$(wc -c < "$W/d.rz")" -lt 500 ] || fail "the run of pairs isn't coded as runs"
@@ -0,0 +1,32 @@
+# Identical reads (and pairs) are aligned once and the alignment reused for the copies.
+
+. tests/common.sh
+
+# Duplicate cache: N of M reads ...
+reused() {
+	sed -n 's/^Duplicate cache: \([0-9]*\) of.*/\1/p' "$1"
+}
+
+copies=$(($(reads "$READS" | wc -l) - $(reads "$READS" | sort -u | wc -l)))
+[ "$copies" -gt 0 ] || fail "the simulated reads have no duplicates"
+
+rz -aof "$REF" "$READS" "$W/a.rz" 2> "$W/a.log"
+cat "$W/a.log"
+[ "$(reused "$W/a.log")" -eq "$copies" ] || fail "$copies duplicates in the reads, $(reused "$W/a.log") reused"
+rz -axf "$REF" "$W/a.rz" "$W/a.out"
+same_reads "$READS" "$W/a.out"
+
+rz -bof "$REF" "$READS" "$W/b.rz"
+rz -bxf "$REF" "$W/b.rz" "$W/b.out"
+same_read_set "$READS" "$W/b.out"
+
+reads "$PAIRS_1" > "$W/mates_1"
+reads "$PAIRS_2" > "$W/mates_2"
+copies=$(($(wc -l < "$W/mates_1") - $(paste "$W/mates_1" "$W/mates_2" | sort -u | wc -l)))
+[ "$copies" -gt 0 ] || fail "the simulated pairs have no duplicates"
+
+rz -cof "$REF" "$PAIRS_1" "$PAIRS_2" "$W/c.rz" 2> "$W/c.log"
+cat "$W/c.log"
+[ "$(reused "$W/c.log")" -eq "$copies" ] || fail "$copies duplicate pairs, $(reused "$W/c.log") reused"
+rz -cxf "$REF" "$W/c.rz" "$W/c_1" "$W/c_2"
+same_pairs "$PAIRS_1" "$PAIRS_2" "$W/c_1" "$W/c_2"
@@ -0,0 +1,23 @@
+# The header of the archive gives its method and the checksum of the chromosome names of its reference, so the method
+# can be left out when decompressing and an archive isn't decoded against another reference.
+
+. tests/common.sh
+
+rz -aof "$REF" "$READS" "$W/a.rz"
+rz -xf "$REF" "$W/a.rz" "$W/a.out"
+same_reads "$READS" "$W/a.out"
+
+rz -dof "$REF" "$PAIRS_1" "$PAIRS_2" "$W/d.rz"
+rz -x "$REF" "$W/d.rz" "$W/d_1" "$W/d_2"
+same_pair_set "$PAIRS_1" "$PAIRS_2" "$W/d_1" "$W/d_2"
+
+# A method given when decompressing has to be that of the archive
+rz_fails -bxf "$REF" "$W/a.rz" "$W/bad.out"
+
+# The same sequences under other names are another reference
+sed 's/^>chr/>seq/' "$REF" > "$W/other.fa"
+rz_fails -xf "$W/other.fa" "$W/a.rz" "$W/bad.out"
+rz_fails -x "$W/other.fa" "$W/d.rz" "$W/bad_1" "$W/bad_2"
+
+# Files that aren't readzip archives
+rz_fails -xf "$REF" "$READS" "$W/bad.out"
@@ -0,0 +1,43 @@
+# The readzip index of the reference: built by readzip index or by the first compression, and built again when it
+# doesn't belong to the reference.
+
+. tests/common.sh
+
+# Building the reference index ... is printed when the index is (re)built
+builds() {
+	grep -c "^Building the reference index" "$1"
+}
+
+cp "$REF" "$W/ref.fa"
+cp "$REF.fmi" "$REF.reverse.fmi" "$W/"
+
+awk -f tests/simulate.awk -v what=reads -v n=300 -v seed=30 "$REF" > "$W/reads.fa"
+
+# The first compression builds the missing index
+rz -aof "$W/ref.fa" "$W/reads.fa" "$W/a.rz" 2> "$W/first.log"
+cat "$W/first.log"
+[ "$(builds "$W/first.log")" -eq 1 ] || fail "the missing index wasn't built"
+[ -s "$W/ref.fa.rzi" ] || fail "no index file"
+ls "$W" | grep -q '\.tmp$' && fail "the temporary index file was left behind"
+
+rz -aof "$W/ref.fa" "$W/reads.fa" "$W/a.rz" 2> "$W/second.log"
+[ "$(builds "$W/second.log")" -eq 0 ] || fail "the index was built again"
+
+# A copy of the reference (another modification time, the same contents) keeps the index
+touch -d "2001-01-01" "$W/ref.fa"
+rz -aof "$W/ref.fa" "$W/reads.fa" "$W/a.rz" 2> "$W/touched.log"
+[ "$(builds "$W/touched.log")" -eq 0 ] || fail "the index of a touched reference was built again"
+
+# An index of another reference (of the same size here), or a damaged one, is built again
+awk -f tests/simulate.awk -v what=reference -v seed=7 > "$W/ref.fa"
+cp "$REF.rzi" "$W/ref.fa.rzi"
+rz -aof "$W/ref.fa" "$W/reads.fa" "$W/other.rz" 2> "$W/other.log"
+[ "$(builds "$W/other.log")" -eq 1 ] || fail "the index of another reference was used"
+
+cp "$REF" "$W/ref.fa"
+head -c 1000 "$REF.rzi" > "$W/ref.fa.rzi"
+rz -aof "$W/ref.fa" "$W/reads.fa" "$W/a.rz" 2> "$W/damaged.log"
+[ "$(builds "$W/damaged.log")" -eq 1 ] || fail "the damaged index was used"
+
+rz -axf "$W/ref.fa" "$W/a.rz" "$W/a.out"
+same_reads "$W/reads.fa" "$W/a.out"
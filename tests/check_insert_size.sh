@@ -0,0 +1,49 @@
+# The distance of the mates is coded against the insert size of the block, with the direction given by the orientation
+# of the pair, and distances far from the insert size are coded as they are.
+
+. tests/common.sh
+
+# Two libraries in one file: most pairs with inserts of about 300, the rest of about 15000
+awk -f tests/simulate.awk -v what=pairs -v n=1000 -v seed=49 -v out="$W/near" "$REF"
+awk -f tests/simulate.awk -v what=pairs -v n=200 -v insert=15000 -v seed=50 -v out="$W/far" "$REF"
+cat "$W/near_1.fa" "$W/far_1.fa" > "$W/pairs_1.fa"
+cat "$W/near_2.fa" "$W/far_2.fa" > "$W/pairs_2.fa"
+
+rz -cof "$REF" "$W/pairs_1.fa" "$W/pairs_2.fa" "$W/c.rz"
+rz -cxf "$REF" "$W/c.rz" "$W/c_1" "$W/c_2"
+same_pairs "$W/pairs_1.fa" "$W/pairs_2.fa" "$W/c_1" "$W/c_2"
+
+rz -dof "$REF" "$W/pairs_1.fa" "$W/pairs_2.fa" "$W/d.rz"
+rz -dxf "$REF" "$W/d.rz" "$W/d_1" "$W/d_2"
+same_pair_set "$W/pairs_1.fa" "$W/pairs_2.fa" "$W/d_1" "$W/d_2"
+
+# Mates in either order: the pairs of method d, sorted by the first mate, and the mates swapped
+rz transcode -c "$REF" "$W/d.rz" "$W/dc.rz" 2> "$W/transcode.log"
+cat "$W/transcode.log"
+grep -q "stored unaligned" "$W/transcode.log" && fail "pairs were stored unaligned"
+rz -cxf "$REF" "$W/dc.rz" "$W/dc_1" "$W/dc_2"
+same_pairs "$W/d_1" "$W/d_2" "$W/dc_1" "$W/dc_2"
+
+rz -cof "$REF" "$W/pairs_2.fa" "$W/pairs_1.fa" "$W/swapped.rz"
+rz -cxf "$REF" "$W/swapped.rz" "$W/swapped_2" "$W/swapped_1"
+same_pairs "$W/pairs_1.fa" "$W/pairs_2.fa" "$W/swapped_1" "$W/swapped_2"
+
+
+# Unaligned pairs have no distance: among aligned pairs, whose insert size is far from 0, they cost no more than on
+# their own, but for the bit of each mate telling that its length isn't the modal length. SAM input keeps the aligner
+# from finding any of the unaligned pairs.
+simulate what=sam -v n=2000 -v unaligned=300 -v out="$W/mixed" > "$W/mixed.sam"
+awk '/^@/ || ($2 != 77 && $2 != 141)' "$W/mixed.sam" > "$W/aligned.sam"
+awk '/^@/ || $2 == 77 || $2 == 141' "$W/mixed.sam" > "$W/unaligned.sam"
+unaligned=$(grep -c '	77	' "$W/unaligned.sam")
+
+for part in mixed aligned unaligned; do
+	rz -cos "$REF" "$W/$part.sam" "$W/$part.c"
+done
+rz -cxf "$REF" "$W/mixed.c" "$W/mixed_c1" "$W/mixed_c2"
+same_pairs "$W/mixed_1.fa" "$W/mixed_2.fa" "$W/mixed_c1" "$W/mixed_c2"
+
+mixed=$(wc -c < "$W/mixed.c")
+apart=$(($(wc -c < "$W/aligned.c") + $(wc -c < "$W/unaligned.c")))
+echo "$mixed bytes mixed, $apart apart, $unaligned unaligned pairs"
+[ "$mixed" -le $((apart + unaligned / 4)) ] || fail "unaligned pairs cost more among aligned ones"
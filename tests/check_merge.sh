@@ -0,0 +1,58 @@
+# merge puts archives of method b or d of the same reference together by position without decompressing them.
+
+. tests/common.sh
+
+# Three lanes of the reads
+head -n 2000 "$READS" > "$W/lane1.fa"
+sed -n 2001,4000p "$READS" > "$W/lane2.fa"
+tail -n +4001 "$READS" > "$W/lane3.fa"
+
+for lane in 1 2 3; do
+	rz -bof "$REF" "$W/lane$lane.fa" "$W/b$lane.rz"
+done
+
+rz merge "$W/b.rz" "$W/b1.rz" "$W/b2.rz" "$W/b3.rz"
+rz -bxf "$REF" "$W/b.rz" "$W/b.out"
+same_read_set "$READS" "$W/b.out"
+rz verify "$W/b.rz"
+
+# The merged archive has the reads of a region like one compressed from all the reads
+rz -bof "$REF" "$READS" "$W/all.rz"
+for region in chr1:1000-20000 chr2 '*'; do
+	rz -bxf --region "$region" "$REF" "$W/b.rz" "$W/b.region"
+	rz -bxf --region "$region" "$REF" "$W/all.rz" "$W/all.region"
+	same_read_set "$W/all.region" "$W/b.region"
+done
+
+head -n 1600 "$PAIRS_1" > "$W/lane1_1.fa"
+head -n 1600 "$PAIRS_2" > "$W/lane1_2.fa"
+tail -n +1601 "$PAIRS_1" > "$W/lane2_1.fa"
+tail -n +1601 "$PAIRS_2" > "$W/lane2_2.fa"
+
+rz -dof "$REF" "$W/lane1_1.fa" "$W/lane1_2.fa" "$W/d1.rz"
+rz -dof "$REF" "$W/lane2_1.fa" "$W/lane2_2.fa" "$W/d2.rz"
+rz merge "$W/d.rz" "$W/d1.rz" "$W/d2.rz"
+rz -dxf "$REF" "$W/d.rz" "$W/d_1" "$W/d_2"
+same_pair_set "$PAIRS_1" "$PAIRS_2" "$W/d_1" "$W/d_2"
+
+# Archives of other methods, or of different methods, can't be merged
+rz -aof "$REF" "$W/lane1.fa" "$W/a1.rz"
+rz_fails merge "$W/bad.rz" "$W/a1.rz" "$W/b2.rz"
+rz_fails merge "$W/bad.rz" "$W/b1.rz" "$W/d2.rz"
+
+# The blocks are in the order of a compressed archive, the unaligned reads first, so merging one archive gives it back
+rz merge "$W/one.rz" "$W/all.rz"
+cmp -s "$W/one.rz" "$W/all.rz" || fail "merging one archive changed it"
+
+# Records at the same position are merged in the order of a compressed archive, so the copies of a read in different
+# inputs end up in one run of duplicates: merging an archive with itself gives the archive of the reads twice
+cat "$W/lane1.fa" "$W/lane1.fa" > "$W/twice.fa"
+rz -bof "$REF" "$W/twice.fa" "$W/twice.rz"
+rz merge "$W/b11.rz" "$W/b1.rz" "$W/b1.rz"
+cmp -s "$W/b11.rz" "$W/twice.rz" || fail "merged copies of the reads aren't coded like the reads twice ($(wc -c < "$W/b11.rz") and $(wc -c < "$W/twice.rz") bytes)"
+
+cat "$W/lane1_1.fa" "$W/lane1_1.fa" > "$W/twice_1.fa"
+cat "$W/lane1_2.fa" "$W/lane1_2.fa" > "$W/twice_2.fa"
+rz -dof "$REF" "$W/twice_1.fa" "$W/twice_2.fa" "$W/twice_d.rz"
+rz merge "$W/d11.rz" "$W/d1.rz" "$W/d1.rz"
+cmp -s "$W/d11.rz" "$W/twice_d.rz" || fail "merged copies of the pairs aren't coded like the pairs twice ($(wc -c < "$W/d11.rz") and $(wc -c < "$W/twice_d.rz") bytes)"
@@ -0,0 +1,35 @@
+# Reads of the modal length of their block are coded with one bit for the length, others with the length itself.
+
+. tests/common.sh
+
+# Mostly reads of 100 bases: every fifth one is followed by a short and a long read
+awk -f tests/simulate.awk -v what=reads -v n=300 -v len=36 -v seed=45 "$REF" > "$W/short.fa"
+awk -f tests/simulate.awk -v what=reads -v n=300 -v len=151 -v seed=46 "$REF" > "$W/long.fa"
+awk -v short="$W/short.fa" -v long="$W/long.fa" '
+	{ print }
+	FNR % 10 == 0 && (getline name < short) > 0 && (getline read < short) > 0 { print name; print read }
+	FNR % 10 == 0 && (getline name < long) > 0 && (getline read < long) > 0 { print name; print read }' "$READS" > "$W/mixed.fa"
+
+for method in a b; do
+	rz -${method}of "$REF" "$W/mixed.fa" "$W/$method.rz"
+	rz -${method}xf "$REF" "$W/$method.rz" "$W/$method.out"
+done
+same_reads "$W/mixed.fa" "$W/a.out"
+same_read_set "$W/mixed.fa" "$W/b.out"
+
+rz -aof --sort-blocks "$REF" "$W/mixed.fa" "$W/sorted.rz"
+rz -axf "$REF" "$W/sorted.rz" "$W/sorted.out"
+same_reads "$W/mixed.fa" "$W/sorted.out"
+
+# Mates of other lengths than the rest of the pairs
+awk -f tests/simulate.awk -v what=pairs -v n=200 -v len=50 -v seed=47 -v out="$W/short" "$REF"
+cat "$PAIRS_1" "$W/short_1.fa" > "$W/mixed_1.fa"
+cat "$PAIRS_2" "$W/short_2.fa" > "$W/mixed_2.fa"
+
+rz -cof "$REF" "$W/mixed_1.fa" "$W/mixed_2.fa" "$W/c.rz"
+rz -cxf "$REF" "$W/c.rz" "$W/c_1" "$W/c_2"
+same_pairs "$W/mixed_1.fa" "$W/mixed_2.fa" "$W/c_1" "$W/c_2"
+
+rz -dof "$REF" "$W/mixed_1.fa" "$W/mixed_2.fa" "$W/d.rz"
+rz -dxf "$REF" "$W/d.rz" "$W/d_1" "$W/d_2"
+same_pair_set "$W/mixed_1.fa" "$W/mixed_2.fa" "$W/d_1" "$W/d_2"
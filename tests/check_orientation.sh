@@ -0,0 +1,49 @@
+# The strand of the second mate is coded by the orientation of the pair against the orientations of the block, and
+# unaligned pairs code none. The pairs are given as SAM records of their true alignments, so that the aligner doesn't
+# change which pairs are aligned.
+
+. tests/common.sh
+
+# Pairs of fr, rf and ff libraries at the same positions, each with unaligned pairs among the aligned ones
+for orientation in fr rf ff; do
+	simulate what=sam -v n=1000 -v unaligned=300 -v orientation=$orientation -v seed=50 -v out="$W/$orientation" > "$W/$orientation.sam"
+
+	rz -cos "$REF" "$W/$orientation.sam" "$W/$orientation.c"
+	rz -cxf "$REF" "$W/$orientation.c" "$W/${orientation}_c1" "$W/${orientation}_c2"
+	same_pairs "$W/${orientation}_1.fa" "$W/${orientation}_2.fa" "$W/${orientation}_c1" "$W/${orientation}_c2"
+
+	rz -dos "$REF" "$W/$orientation.sam" "$W/$orientation.d"
+	rz -dxf "$REF" "$W/$orientation.d" "$W/${orientation}_d1" "$W/${orientation}_d2"
+	same_pair_set "$W/${orientation}_1.fa" "$W/${orientation}_2.fa" "$W/${orientation}_d1" "$W/${orientation}_d2"
+done
+
+# A block of one orientation codes it in no bits whichever it is
+for method in c d; do
+	fr=$(wc -c < "$W/fr.$method")
+	for orientation in rf ff; do
+		size=$(wc -c < "$W/$orientation.$method")
+		echo "method $method: $size bytes of $orientation pairs, $fr of fr pairs"
+		[ $((size * 100)) -le $((fr * 101)) ] || fail "$orientation pairs cost more than fr pairs with method $method"
+	done
+done
+
+# Blocks of all three orientations
+(cat "$W/fr.sam"; grep -hv '^@' "$W/rf.sam" "$W/ff.sam") > "$W/mixed.sam"
+cat "$W/fr_1.fa" "$W/rf_1.fa" "$W/ff_1.fa" > "$W/mixed_1.fa"
+cat "$W/fr_2.fa" "$W/rf_2.fa" "$W/ff_2.fa" > "$W/mixed_2.fa"
+rz -cos "$REF" "$W/mixed.sam" "$W/mixed.c"
+rz -cxf "$REF" "$W/mixed.c" "$W/mixed_c1" "$W/mixed_c2"
+same_pairs "$W/mixed_1.fa" "$W/mixed_2.fa" "$W/mixed_c1" "$W/mixed_c2"
+rz -dos "$REF" "$W/mixed.sam" "$W/mixed.d"
+rz -dxf "$REF" "$W/mixed.d" "$W/mixed_d1" "$W/mixed_d2"
+same_pair_set "$W/mixed_1.fa" "$W/mixed_2.fa" "$W/mixed_d1" "$W/mixed_d2"
+
+# The second mate of an unaligned pair codes no chromosome, strand, start, orientation or distance: 4 bits less than
+# as a single read with method a (2 of them the chromosome code), 2 bits with method b
+simulate what=sam -v n=1000 -v unaligned=1000 > "$W/unaligned.sam"
+for method in a b c d; do
+	rz -${method}os "$REF" "$W/unaligned.sam" "$W/unaligned.$method"
+done
+echo "unaligned: $(wc -c < "$W/unaligned.a") bytes a, $(wc -c < "$W/unaligned.c") c, $(wc -c < "$W/unaligned.b") b, $(wc -c < "$W/unaligned.d") d"
+[ $(($(wc -c < "$W/unaligned.a") - $(wc -c < "$W/unaligned.c"))) -ge $((1000 * 3 / 8)) ] || fail "unaligned pairs cost too much with method c"
+[ $(($(wc -c < "$W/unaligned.b") - $(wc -c < "$W/unaligned.d"))) -ge $((1000 / 8)) ] || fail "unaligned pairs cost too much with method d"
@@ -0,0 +1,19 @@
+# Paired reads: the aligner's candidates of both mates are paired by the cost of coding the pair, and a mate that
+# doesn't align is looked for near the other one.
+
+. tests/common.sh
+
+rz -cof "$REF" "$PAIRS_1" "$PAIRS_2" "$W/c.rz"
+rz -cxf "$REF" "$W/c.rz" "$W/c_1" "$W/c_2"
+same_pairs "$PAIRS_1" "$PAIRS_2" "$W/c_1" "$W/c_2"
+
+rz -dof "$REF" "$PAIRS_1" "$PAIRS_2" "$W/d.rz"
+rz -dxf "$REF" "$W/d.rz" "$W/d_1" "$W/d_2"
+same_pair_set "$PAIRS_1" "$PAIRS_2" "$W/d_1" "$W/d_2"
+
+# The pairs have to be coded smaller than the two mates on their own
+awk 'NR % 2 == 0' "$PAIRS_1" > "$W/mates.txt"
+awk 'NR % 2 == 0' "$PAIRS_2" >> "$W/mates.txt"
+awk '{ print ">r" NR; print }' "$W/mates.txt" > "$W/mates.fa"
+rz -aof "$REF" "$W/mates.fa" "$W/mates.rz"
+[ "$(wc -c < "$W/c.rz")" -lt "$(wc -c < "$W/mates.rz")" ] || fail "pairs aren't coded smaller than single reads"
@@ -0,0 +1,15 @@
+# The blocks are decompressed in parallel and written in order, the output is the same whatever the number of threads.
+
+. tests/common.sh
+
+rz -aof "$REF" "$MANY" "$W/a.rz"
+rz -bof "$REF" "$MANY" "$W/b.rz"
+
+for threads in 1 4; do
+	rz -axf -t $threads "$REF" "$W/a.rz" "$W/a.$threads"
+	same_reads "$MANY" "$W/a.$threads"
+	rz -bxf -t $threads "$REF" "$W/b.rz" "$W/b.$threads"
+	same_read_set "$MANY" "$W/b.$threads"
+done
+
+cmp "$W/b.1" "$W/b.4" || fail "method b decompresses in another order on 4 threads"
@@ -0,0 +1,20 @@
+# Compression runs as a pipeline of reading, coding and writing threads over bounded queues; the blocks come out in
+# order however many coders there are, and every stage reports how busy it was.
+
+. tests/common.sh
+
+for threads in 1 4; do
+	echo "+ readzip -aof -t $threads ref - a.$threads.rz < many.fa"
+	./readzip -aof -t $threads "$REF" - "$W/a.$threads.rz" < "$MANY" 2> "$W/a.$threads.log" || fail "compressing on $threads threads failed"
+	cat "$W/a.$threads.log"
+	grep -q "^Pipeline: reading [0-9]*% busy, coding [0-9]*% busy on $threads threads\?, writing [0-9]*% busy\.$" "$W/a.$threads.log" ||
+		fail "no report of the pipeline"
+done
+
+cmp "$W/a.1.rz" "$W/a.4.rz" || fail "the blocks are written in another order on 4 threads"
+rz -axf "$REF" "$W/a.4.rz" "$W/a.out"
+same_reads "$MANY" "$W/a.out"
+
+rz -cof -t 4 "$REF" "$PAIRS_1" "$PAIRS_2" "$W/c.rz"
+rz -cxf "$REF" "$W/c.rz" "$W/c_1" "$W/c_2"
+same_pairs "$PAIRS_1" "$PAIRS_2" "$W/c_1" "$W/c_2"
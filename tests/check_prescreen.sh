@@ -0,0 +1,23 @@
+# Reads with too few k-mers of the reference (contamination) are stored unaligned without calling the aligner.
+
+. tests/common.sh
+
+# Pre-screen: N reads had too few k-mers ...
+screened() {
+	sed -n 's/^Pre-screen: \([0-9]*\) reads.*/\1/p' "$1"
+}
+
+awk -f tests/simulate.awk -v what=reads -v n=200 -v unaligned=1000 -v seed=29 "$REF" > "$W/junk.fa"
+awk -f tests/simulate.awk -v what=reads -v n=200 -v seed=31 "$REF" > "$W/reads.fa"
+cat "$W/junk.fa" "$W/reads.fa" > "$W/mixed.fa"
+
+rz -aof "$REF" "$W/mixed.fa" "$W/a.rz" 2> "$W/a.log"
+cat "$W/a.log"
+[ "$(screened "$W/a.log")" -ge 190 ] || fail "the random reads weren't screened out"
+[ "$(screened "$W/a.log")" -le 200 ] || fail "reads of the reference were screened out"
+rz -axf "$REF" "$W/a.rz" "$W/a.out"
+same_reads "$W/mixed.fa" "$W/a.out"
+
+rz -bof "$REF" "$W/mixed.fa" "$W/b.rz"
+rz -bxf "$REF" "$W/b.rz" "$W/b.out"
+same_read_set "$W/mixed.fa" "$W/b.out"
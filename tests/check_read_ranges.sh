@@ -0,0 +1,27 @@
+# --reads decompresses a range of reads (pairs) of an order-preserving archive from the index of every 1024th read.
+
+. tests/common.sh
+
+rz -aof "$REF" "$MANY" "$W/a.rz"
+
+# Within the first block, over the end of the first block, and up to the last read
+for r in 1-1 1000-1030 2047-2049 65000-66000 69990-70000; do
+	rz -axf --reads $r "$REF" "$W/a.rz" "$W/a.$r"
+	range "$MANY" ${r%-*} ${r#*-} | cmp -s - "$W/a.$r" || fail "reads $r differ"
+done
+
+rz -cof "$REF" "$PAIRS_1" "$PAIRS_2" "$W/c.rz"
+
+for r in 1-10 1020-1030 1400-1500; do
+	rz -cxf --reads $r "$REF" "$W/c.rz" "$W/c_1.$r" "$W/c_2.$r"
+	range "$PAIRS_1" ${r%-*} ${r#*-} | cmp -s - "$W/c_1.$r" || fail "first mates of pairs $r differ"
+	range "$PAIRS_2" ${r%-*} ${r#*-} | cmp -s - "$W/c_2.$r" || fail "second mates of pairs $r differ"
+done
+
+# A range past the end of the archive stops at the last read
+rz -axf --reads 69999-80000 "$REF" "$W/a.rz" "$W/a.end"
+range "$MANY" 69999 70000 | cmp -s - "$W/a.end" || fail "reads 69999-80000 differ"
+
+# The methods that don't keep the order have no read numbers
+rz -bof "$REF" "$READS" "$W/b.rz"
+rz_fails -bxf --reads 1-10 "$REF" "$W/b.rz" "$W/b.out"
@@ -0,0 +1,78 @@
+# --region decompresses the reads (pairs) of a sorted archive overlapping a region from the reference ranges of the blocks.
+
+. tests/common.sh
+
+# Reads of 50 bases on the forward strand at known positions as SAM records, every 50th unmapped. The second mate of
+# a pair is 200 bases after the first one.
+simulate='
+	/^>/ { c++; next }
+	{ sequence[c] = sequence[c] $0 }
+	END {
+		for(i = 0; i < 2000; i++) {
+			c = 1 + i % 2
+			p = 1 + (i * 7919) % (length(sequence[c]) - 300)
+			if(i % 50 == 0) {
+				print "r" i "\t" (paired ? 77 : 4) "\t*\t0\t0\t*\t*\t0\t0\t" substr(sequence[c], p, 50) "\t*"
+				if(paired)
+					print "r" i "\t141\t*\t0\t0\t*\t*\t0\t0\t" substr(sequence[c], p + 200, 50) "\t*"
+			}
+			else {
+				print "r" i "\t" (paired ? 65 : 0) "\tchr" c "\t" p "\t60\t50M\t*\t0\t0\t" substr(sequence[c], p, 50) "\t*\tMD:Z:50"
+				if(paired)
+					print "r" i "\t129\tchr" c "\t" p + 200 "\t60\t50M\t*\t0\t0\t" substr(sequence[c], p + 200, 50) "\t*\tMD:Z:50"
+			}
+		}
+	}'
+awk -v paired=0 "$simulate" "$REF" > "$W/reads.sam"
+awk -v paired=1 "$simulate" "$REF" > "$W/pairs.sam"
+
+# in_region file region: the records of the SAM file overlapping the region (or unmapped for *), a pair if either mate does
+in_region() {
+	awk -F '\t' -v region="$2" -v out="$W/expected" '
+		BEGIN {
+			split(region, parts, "[:-]")
+			chromosome = parts[1]
+			from = parts[2] ? parts[2] : 1
+			to = parts[3] ? parts[3] : 1000000000
+		}
+		function overlaps(record) {
+			split(record, f, "\t")
+			return f[3] == chromosome && (chromosome == "*" || (f[4] <= to && f[4] + 49 >= from))
+		}
+		function read(record) {
+			split(record, f, "\t")
+			return f[10]
+		}
+		$2 < 64 && overlaps($0) {
+			print ">" $1 > (out ".fa")
+			print $10 > (out ".fa")
+		}
+		$2 >= 64 && $2 < 128 {
+			first = $0
+		}
+		$2 >= 128 && (overlaps(first) || overlaps($0)) {
+			print ">" $1 > (out "_1.fa")
+			print read(first) > (out "_1.fa")
+			print ">" $1 > (out "_2.fa")
+			print $10 > (out "_2.fa")
+		}' "$1"
+}
+
+rz -bos "$REF" "$W/reads.sam" "$W/b.rz"
+rz -dos "$REF" "$W/pairs.sam" "$W/d.rz"
+
+for region in chr1:1000-2000 chr1:39000-40000 chr2:1-100 chr2 "*"; do
+
+	rm -f "$W/expected.fa" "$W/expected_1.fa" "$W/expected_2.fa"
+	in_region "$W/reads.sam" "$region"
+	rz -bxf --region "$region" "$REF" "$W/b.rz" "$W/b.out"
+	[ -s "$W/expected.fa" ] || fail "no reads in $region"
+	same_read_set "$W/expected.fa" "$W/b.out"
+
+	in_region "$W/pairs.sam" "$region"
+	rz -dxf --region "$region" "$REF" "$W/d.rz" "$W/d_1" "$W/d_2"
+	same_pair_set "$W/expected_1.fa" "$W/expected_2.fa" "$W/d_1" "$W/d_2"
+done
+
+# A chromosome that isn't in the reference is an error
+rz_fails -bxf --region chr3:1-100 "$REF" "$W/b.rz" "$W/b.none"
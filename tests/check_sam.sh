@@ -0,0 +1,104 @@
+# SAM input: existing alignments are compressed without the aligner, the mates of the paired methods paired by name.
+
+. tests/common.sh
+
+# Collated pairs of the reference: every third pair has a mismatch given by the MD tag (the others are compared against
+# the reference), every fifth its records the other way around, every seventh its mates on different chromosomes,
+# every eleventh is unmapped and every thirteenth has a secondary alignment between the mates. The original reads
+# go to expected_1.fa and expected_2.fa.
+awk -v out="$W/expected" '
+	function complement(s,    i, r) {
+		r = ""
+		for(i = length(s); i > 0; i--)
+			r = r substr("TGCA", index("ACGT", substr(s, i, 1)), 1)
+		return r
+	}
+	/^>/ { c++; next }
+	{ sequence[c] = sequence[c] $0 }
+	END {
+		print "@HD\tVN:1.6\tSO:unsorted"
+		print "@SQ\tSN:chr1\tLN:" length(sequence[1])
+		print "@SQ\tSN:chr2\tLN:" length(sequence[2])
+		for(i = 0; i < 300; i++) {
+			name = "p" i
+			p_1 = 1 + (i * 7919) % 20000
+			p_2 = p_1 + 200
+			c_1 = 1 + i % 2
+			c_2 = i % 7 == 0 ? 3 - c_1 : c_1
+			seq_1 = substr(sequence[c_1], p_1, 50)
+			seq_2 = substr(sequence[c_2], p_2, 50)
+			md = ""
+			if(i % 3 == 0) {
+				base = substr(seq_1, 11, 1)
+				seq_1 = substr(seq_1, 1, 10) (base == "A" ? "C" : "A") substr(seq_1, 12)
+				md = "\tMD:Z:10" base "39"
+			}
+			first = name "\t99\tchr" c_1 "\t" p_1 "\t60\t50M\t=\t" p_2 "\t250\t" seq_1 "\t*" md
+			second = name "\t147\tchr" c_2 "\t" p_2 "\t60\t50M\t=\t" p_1 "\t-250\t" seq_2 "\t*"
+			if(i % 11 == 0) {
+				first = name "\t77\t*\t0\t0\t*\t*\t0\t0\t" seq_1 "\t*"
+				second = name "\t141\t*\t0\t0\t*\t*\t0\t0\t" seq_2 "\t*"
+				print ">" name > (out "_2.fa")
+				print seq_2 > (out "_2.fa")
+			}
+			else {
+				print ">" name > (out "_2.fa")
+				print complement(seq_2) > (out "_2.fa")
+			}
+			print ">" name > (out "_1.fa")
+			print seq_1 > (out "_1.fa")
+			if(i % 5 == 0) {
+				print second
+				print first
+			}
+			else {
+				print first
+				if(i % 13 == 0)
+					print name "\t353\tchr2\t100\t0\t50M\t=\t" p_2 "\t0\t*\t*"
+				print second
+			}
+		}
+	}' "$REF" > "$W/pairs.sam" || fail "failure in making the SAM file"
+
+# The single methods compress every primary record, the original read of a record on the reverse strand is the
+# reverse complement of its sequence
+awk -F '\t' '
+	function complement(s,    i, r) {
+		r = ""
+		for(i = length(s); i > 0; i--)
+			r = r substr("TGCA", index("ACGT", substr(s, i, 1)), 1)
+		return r
+	}
+	!/^@/ && $2 < 256 {
+		print ">" $1
+		print (int($2 / 16) % 2 ? complement($10) : $10)
+	}' "$W/pairs.sam" > "$W/records.fa"
+
+rz -aos "$REF" "$W/pairs.sam" "$W/a.rz"
+rz -axf "$REF" "$W/a.rz" "$W/a.out"
+same_reads "$W/records.fa" "$W/a.out"
+
+rz -bos "$REF" "$W/pairs.sam" "$W/b.rz"
+rz -bxf "$REF" "$W/b.rz" "$W/b.out"
+same_read_set "$W/records.fa" "$W/b.out"
+
+rz -cos "$REF" "$W/pairs.sam" "$W/c.rz"
+rz -cxf "$REF" "$W/c.rz" "$W/c_1" "$W/c_2"
+same_pairs "$W/expected_1.fa" "$W/expected_2.fa" "$W/c_1" "$W/c_2"
+
+rz -dos "$REF" "$W/pairs.sam" "$W/d.rz"
+rz -dxf "$REF" "$W/d.rz" "$W/d_1" "$W/d_2"
+same_pair_set "$W/expected_1.fa" "$W/expected_2.fa" "$W/d_1" "$W/d_2"
+
+# Records which aren't collated, a record without a mate, and a file ending with a lone mate are errors
+awk '!/^@/ && !/\t353\t/' "$W/pairs.sam" | sort -t "	" -k 3,3 -k 4,4n > "$W/sorted.sam"
+rz_fails -cos "$REF" "$W/sorted.sam" "$W/sorted.rz"
+rz_fails -dos "$REF" "$W/sorted.sam" "$W/sorted.rz"
+
+awk 'NR == 10 { sub(/\t99\t/, "\t0\t") } { print }' "$W/pairs.sam" > "$W/unpaired.sam"
+rz_fails -cos "$REF" "$W/unpaired.sam" "$W/unpaired.rz"
+rz_fails -dos "$REF" "$W/unpaired.sam" "$W/unpaired.rz"
+
+head -n -1 "$W/pairs.sam" > "$W/truncated.sam"
+rz_fails -cos "$REF" "$W/truncated.sam" "$W/truncated.rz"
+rz_fails -dos "$REF" "$W/truncated.sam" "$W/truncated.rz"
@@ -0,0 +1,62 @@
+# readzip serve keeps the reference loaded and runs the jobs of readzip client (files relative to the client's
+# directory), and stops on SIGTERM after the running jobs finish.
+
+. tests/common.sh
+
+top=$(pwd)
+socket=$W/readzip.sock
+
+./readzip serve "$socket" "$REF" 2> "$W/server.log" &
+server=$!
+trap 'kill $server 2> /dev/null' EXIT
+
+for i in $(seq 100); do
+	[ -S "$socket" ] && break
+	sleep 0.1
+done
+[ -S "$socket" ] || fail "the server didn't start"
+[ "$(stat -c %a "$socket")" = 600 ] || fail "other users can connect to the socket"
+
+# client args: runs readzip client in the working directory of the check
+client() {
+	echo "+ readzip client $*"
+	(cd "$W" && "$top/readzip" client readzip.sock "$@")
+}
+
+client -aof ../ref.fa ../reads.fa a.rz || fail "compressing on the server failed"
+client -axf ../ref.fa a.rz a.out || fail "decompressing on the server failed"
+same_reads "$READS" "$W/a.out"
+
+client -cof ../ref.fa ../pairs_1.fa ../pairs_2.fa c.rz || fail "compressing pairs on the server failed"
+client -cxf ../ref.fa c.rz c_1 c_2 || fail "decompressing pairs on the server failed"
+same_pairs "$PAIRS_1" "$PAIRS_2" "$W/c_1" "$W/c_2"
+
+# File names go to the aligner as they are, not through a shell
+cp "$READS" "$W/a b;touch rz-injected.fa"
+client -aof ../ref.fa "a b;touch rz-injected.fa" 'c$(touch rz-injected).rz' || fail "compressing a file with an odd name failed"
+[ -e rz-injected.fa ] || [ -e rz-injected ] && fail "a file name ran a command"
+rz -axf "$REF" "$W/c\$(touch rz-injected).rz" "$W/b.out"
+same_reads "$READS" "$W/b.out"
+
+client -aof ../ref.fa missing.fa missing.rz && fail "a job of a missing file succeeded"
+client -aof --batch jobs.txt ../ref.fa && fail "the server took a batch"
+
+client stats 2> "$W/stats" || fail "no stats"
+cat "$W/stats"
+grep -q "^6 jobs, 1 failed, mean latency [0-9.e+-]* ms, longest [0-9.e+-]* ms$" "$W/stats" || fail "wrong stats"
+
+# A job running when the server is stopped finishes first
+client -dof ../ref.fa ../pairs_1.fa ../pairs_2.fa d.rz > "$W/last.log" 2>&1 &
+last=$!
+sleep 0.5
+kill -TERM $server
+wait $server || fail "the server failed on SIGTERM"
+wait $last || fail "the job running at SIGTERM failed"
+rz -dxf "$REF" "$W/d.rz" "$W/d_1" "$W/d_2"
+same_pair_set "$PAIRS_1" "$PAIRS_2" "$W/d_1" "$W/d_2"
+
+cat "$W/server.log"
+[ -e "$socket" ] && fail "the socket wasn't removed"
+grep -q "^Stopped after 7 jobs\.$" "$W/server.log" || fail "the server didn't stop cleanly"
+client stats && fail "the server still takes jobs"
+true
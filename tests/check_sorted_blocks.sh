@@ -0,0 +1,51 @@
+# --sort-blocks codes the reads of every block of method a sorted by position with their places in the block, the
+# order of the reads is kept.
+
+. tests/common.sh
+
+# sorted in.fa name: compresses in.fa with sorted blocks into name.rz, checking the round trip and verify
+sorted() {
+	rz -aof --sort-blocks "$REF" "$1" "$W/$2.rz"
+	rz -axf "$REF" "$W/$2.rz" "$W/$2.out"
+	same_reads "$1" "$W/$2.out"
+	rz verify "$W/$2.rz"
+}
+
+# An archive of one read
+simulate what=reads -v n=1 > "$W/one.fa"
+sorted "$W/one.fa" one
+rz -axf --reads 1-1 "$REF" "$W/one.rz" "$W/one.range"
+same_range "$W/one.fa" 1 1 "$W/one.range"
+
+# Reads all at one place with their errors and copies, on either strand in random order: only the places in the
+# block order them
+simulate what=reads -v n=3000 -v stacked=1 -v errors=20 -v duplicates=100 > "$W/stacked.fa"
+sorted "$W/stacked.fa" stacked
+
+for r in 1-1 1000-1030 2990-3000; do
+	rz -axf --reads $r "$REF" "$W/stacked.rz" "$W/stacked.$r"
+	same_range "$W/stacked.fa" ${r%-*} ${r#*-} "$W/stacked.$r"
+done
+
+# Appended to the archive of one read, in a block of their own
+rz -aof --sort-blocks --append "$REF" "$W/stacked.fa" "$W/one.rz"
+rz -axf "$REF" "$W/one.rz" "$W/appended.out"
+cat "$W/one.fa" "$W/stacked.fa" > "$W/appended.fa"
+same_reads "$W/appended.fa" "$W/appended.out"
+
+rz transcode -b "$REF" "$W/one.rz" "$W/b.rz"
+rz -bxf "$REF" "$W/b.rz" "$W/b.out"
+same_read_set "$W/appended.fa" "$W/b.out"
+
+# A last block of one read
+head -n 131074 "$MANY" > "$W/block.fa"
+sorted "$W/block.fa" block
+
+for r in 65530-65537 65537-65537; do
+	rz -axf --reads $r "$REF" "$W/block.rz" "$W/block.$r"
+	same_range "$W/block.fa" ${r%-*} ${r#*-} "$W/block.$r"
+done
+
+rz -aof "$REF" "$W/block.fa" "$W/unsorted.rz"
+echo "$(wc -c < "$W/block.rz") bytes sorted, $(wc -c < "$W/unsorted.rz") not"
+[ "$(wc -c < "$W/block.rz")" -lt "$(wc -c < "$W/unsorted.rz")" ] || fail "sorted blocks aren't smaller"
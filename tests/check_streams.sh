@@ -0,0 +1,50 @@
+# Files given as - are the standard input and output: methods a and c compress from a stream, every method decompresses
+# from one, and two - inputs (or outputs) of method c interleave the mates.
+
+. tests/common.sh
+
+# Reads from a stream are compressed into the same archive as from the file
+echo "+ readzip -aof ref - a.rz < reads.fa"
+./readzip -aof "$REF" - "$W/a.rz" < "$READS" || fail "compressing from the standard input failed"
+rz -aof "$REF" "$READS" "$W/a.file.rz"
+cmp "$W/a.rz" "$W/a.file.rz" || fail "compressing from the standard input gives another archive"
+echo "+ readzip -axf ref - - < a.rz > a.out"
+./readzip -axf "$REF" - - < "$W/a.rz" > "$W/a.out" || fail "decompressing to the standard output failed"
+same_reads "$READS" "$W/a.out"
+
+echo "+ readzip -aof ref reads.fa - > a.stdout.rz"
+./readzip -aof "$REF" "$READS" - > "$W/a.stdout.rz" || fail "compressing to the standard output failed"
+rz -axf "$REF" "$W/a.stdout.rz" "$W/a.stdout.out"
+same_reads "$READS" "$W/a.stdout.out"
+
+rz -bof "$REF" "$READS" "$W/b.rz"
+echo "+ readzip -bxf ref - b.out < b.rz"
+./readzip -bxf "$REF" - "$W/b.out" < "$W/b.rz" || fail "method b failed to decompress from the standard input"
+same_read_set "$READS" "$W/b.out"
+
+# Interleaved mates
+awk 'NR == FNR { first[FNR] = $0; next } { second[FNR] = $0 }
+	END { for(i = 1; i < FNR; i += 2) print first[i] "\n" first[i + 1] "\n" second[i] "\n" second[i + 1] }' "$PAIRS_1" "$PAIRS_2" > "$W/interleaved.fa"
+
+echo "+ readzip -cof ref - - c.rz < interleaved.fa"
+./readzip -cof "$REF" - - "$W/c.rz" < "$W/interleaved.fa" || fail "compressing interleaved mates failed"
+rz -cxf "$REF" "$W/c.rz" "$W/c_1" "$W/c_2"
+same_pairs "$PAIRS_1" "$PAIRS_2" "$W/c_1" "$W/c_2"
+
+echo "+ readzip -cxf ref - - - < c.rz > c.out"
+./readzip -cxf "$REF" - - - < "$W/c.rz" > "$W/c.out" || fail "decompressing interleaved mates failed"
+same_reads "$W/interleaved.fa" "$W/c.out"
+
+# One mate from the standard input, the other from a file
+echo "+ readzip -cof ref - pairs_2.fa c.half.rz < pairs_1.fa"
+./readzip -cof "$REF" - "$PAIRS_2" "$W/c.half.rz" < "$PAIRS_1" || fail "compressing the first mates from the standard input failed"
+rz -cxf "$REF" "$W/c.half.rz" "$W/c.half_1" "$W/c.half_2"
+same_pairs "$PAIRS_1" "$PAIRS_2" "$W/c.half_1" "$W/c.half_2"
+
+rz -dof "$REF" "$PAIRS_1" "$PAIRS_2" "$W/d.rz"
+echo "+ readzip -dxf ref - d_1 d_2 < d.rz"
+./readzip -dxf "$REF" - "$W/d_1" "$W/d_2" < "$W/d.rz" || fail "method d failed to decompress from the standard input"
+same_pair_set "$PAIRS_1" "$PAIRS_2" "$W/d_1" "$W/d_2"
+
+# The sorting methods need the reads as files
+rz_fails -bof "$REF" - "$W/b.stdin.rz" < "$READS"
@@ -0,0 +1,20 @@
+# -t sets the number of threads of the work-stealing pool and --affinity pins them to cores; neither changes the archive
+# or the reads.
+
+. tests/common.sh
+
+rz -aof -t 1 "$REF" "$MANY" "$W/a.1.rz"
+rz -aof -t 3 --affinity "$REF" "$MANY" "$W/a.pinned.rz"
+rz -aof --threads 8 "$REF" "$MANY" "$W/a.8.rz"
+cmp "$W/a.1.rz" "$W/a.pinned.rz" || fail "pinned threads code differently"
+cmp "$W/a.1.rz" "$W/a.8.rz" || fail "8 threads code differently"
+
+rz -axf -t 2 --affinity "$REF" "$W/a.8.rz" "$W/a.out"
+same_reads "$MANY" "$W/a.out"
+
+rz -dof -t 3 --affinity "$REF" "$PAIRS_1" "$PAIRS_2" "$W/d.rz"
+rz -dxf -t 5 "$REF" "$W/d.rz" "$W/d_1" "$W/d_2"
+same_pair_set "$PAIRS_1" "$PAIRS_2" "$W/d_1" "$W/d_2"
+
+rz_fails -aof -t 0 "$REF" "$READS" "$W/a.none.rz"
+rz_fails -aof -t many "$REF" "$READS" "$W/a.none.rz"
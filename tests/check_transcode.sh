@@ -0,0 +1,34 @@
+# transcode recodes an archive into another method from the alignments stored in it, without the aligner.
+
+. tests/common.sh
+
+rz -aof "$REF" "$READS" "$W/a.rz"
+
+rz transcode -b "$REF" "$W/a.rz" "$W/b.rz"
+rz -bxf "$REF" "$W/b.rz" "$W/b.out"
+same_read_set "$READS" "$W/b.out"
+
+# Back to method a the order is that of the sorted archive
+rz transcode -a "$REF" "$W/b.rz" "$W/ba.rz"
+rz -axf "$REF" "$W/ba.rz" "$W/ba.out"
+same_reads "$W/b.out" "$W/ba.out"
+
+# More than a block of reads
+rz -aof "$REF" "$MANY" "$W/many.rz"
+rz transcode -b "$REF" "$W/many.rz" "$W/many_b.rz"
+rz -bxf "$REF" "$W/many_b.rz" "$W/many_b.out"
+same_read_set "$MANY" "$W/many_b.out"
+
+rz -cof "$REF" "$PAIRS_1" "$PAIRS_2" "$W/c.rz"
+
+rz transcode -d "$REF" "$W/c.rz" "$W/d.rz"
+rz -dxf "$REF" "$W/d.rz" "$W/d_1" "$W/d_2"
+same_pair_set "$PAIRS_1" "$PAIRS_2" "$W/d_1" "$W/d_2"
+
+rz transcode -c "$REF" "$W/d.rz" "$W/dc.rz"
+rz -cxf "$REF" "$W/dc.rz" "$W/dc_1" "$W/dc_2"
+same_pairs "$W/d_1" "$W/d_2" "$W/dc_1" "$W/dc_2"
+
+# Single reads can't become pairs, and an archive isn't transcoded into its own method
+rz_fails transcode -c "$REF" "$W/a.rz" "$W/bad.rz"
+rz_fails transcode -a "$REF" "$W/a.rz" "$W/bad.rz"
@@ -0,0 +1,36 @@
+# verify checks the checksums and decodes the records of archives without the reference, a corrupted or truncated
+# archive is reported instead of decompressed into wrong reads.
+
+. tests/common.sh
+
+# corrupt in out offset: out is in with the byte at offset changed
+corrupt() {
+	cp "$1" "$2"
+	byte=$(od -An -tu1 -j "$3" -N 1 "$1" | tr -d ' ')
+	printf "\\$(printf %o $(( (byte + 1) % 256 )))" | dd of="$2" bs=1 seek="$3" conv=notrunc 2> /dev/null
+}
+
+rz -aof "$REF" "$READS" "$W/a.rz"
+rz -bof "$REF" "$READS" "$W/b.rz"
+rz -cof "$REF" "$PAIRS_1" "$PAIRS_2" "$W/c.rz"
+rz -dof "$REF" "$PAIRS_1" "$PAIRS_2" "$W/d.rz"
+
+rz verify "$W/a.rz" "$W/b.rz" "$W/c.rz" "$W/d.rz" > "$W/verify.log" 2>&1
+grep -q "a.rz: OK, 3000 reads in" "$W/verify.log" || fail "verify didn't report the reads of a.rz"
+grep -q "c.rz: OK, 1500 reads in" "$W/verify.log" || fail "verify didn't report the pairs of c.rz"
+
+# A byte of the first block, of the table at the end, and an archive cut short
+for method in a b c d; do
+	corrupt "$W/$method.rz" "$W/$method.block" 200
+	rz_fails verify "$W/$method.block"
+
+	corrupt "$W/$method.rz" "$W/$method.table" $(( $(wc -c < "$W/$method.rz") - 40 ))
+	rz_fails verify "$W/$method.table"
+
+	head -c $(( $(wc -c < "$W/$method.rz") / 2 )) "$W/$method.rz" > "$W/$method.short"
+	rz_fails verify "$W/$method.short"
+done
+
+# Nor is a corrupted block decompressed
+rz_fails -axf "$REF" "$W/a.block" "$W/a.out"
+rz_fails -cxf "$REF" "$W/c.block" "$W/c_1" "$W/c_2"
@@ -0,0 +1,82 @@
+# Helpers of the round-trip checks, sourced by every check (see run.sh). The simulated data is in $RZ_DATA:
+# the reference ref.fa, single reads reads.fa, more than a block of short reads many.fa and pairs pairs_1.fa and pairs_2.fa. $W is the working directory of the check.
+
+REF=$RZ_DATA/ref.fa
+READS=$RZ_DATA/reads.fa
+MANY=$RZ_DATA/many.fa
+PAIRS_1=$RZ_DATA/pairs_1.fa
+PAIRS_2=$RZ_DATA/pairs_2.fa
+
+W=$RZ_DATA/$(basename "$0" .sh)
+mkdir -p "$W" || exit 1
+
+# simulate what=... [-v name=value ...]: reads, pairs or SAM records of the reference (see simulate.awk).
+simulate() {
+	awk -f tests/simulate.awk -v "$@" "$REF"
+}
+
+fail() {
+	echo "$0: $*"
+	exit 1
+}
+
+# Runs readzip, failing the check if it fails.
+rz() {
+	echo "+ readzip $*"
+	./readzip "$@" || fail "readzip $* failed"
+}
+
+# Runs readzip, failing the check if it succeeds.
+rz_fails() {
+	echo "+ readzip $* (should fail)"
+	./readzip "$@" && fail "readzip $* should have failed"
+	return 0
+}
+
+# Sequences of a fasta file or of decompressed reads (with or without names), one per line.
+reads() {
+	grep -v '^>' "$1"
+}
+
+# same_reads in.fa out: out has the reads of in.fa in the same order.
+same_reads() {
+	reads "$1" > "$W/expected"
+	reads "$2" | cmp -s - "$W/expected" || fail "$2 differs from the reads of $1"
+}
+
+# same_read_set in.fa out: out has the reads of in.fa in any order.
+same_read_set() {
+	reads "$1" | sort > "$W/expected.sorted"
+	reads "$2" | sort | cmp -s - "$W/expected.sorted" || fail "$2 differs from the reads of $1"
+}
+
+# same_pairs in_1.fa in_2.fa out_1 out_2: the outputs have the pairs of the inputs in the same order.
+same_pairs() {
+	same_reads "$1" "$3"
+	same_reads "$2" "$4"
+}
+
+# same_pair_set in_1.fa in_2.fa out_1 out_2: the outputs have the pairs of the inputs in any order.
+same_pair_set() {
+	reads "$1" > "$W/expected_1"
+	reads "$2" > "$W/expected_2"
+	paste "$W/expected_1" "$W/expected_2" | sort > "$W/expected.sorted"
+	reads "$3" > "$W/output_1"
+	reads "$4" > "$W/output_2"
+	paste "$W/output_1" "$W/output_2" | sort | cmp -s - "$W/expected.sorted" || fail "$3 and $4 differ from the pairs of $1 and $2"
+}
+
+# range in.fa from to: the reads from to to of in.fa.
+range() {
+	reads "$1" | sed -n "$2,$3p"
+}
+
+# same_range in.fa from to out: out has the reads from to to of in.fa in the same order.
+same_range() {
+	range "$1" "$2" "$3" | cmp -s - "$4" || fail "$4 differs from reads $2-$3 of $1"
+}
+
+# copies n in.fa: every read of in.fa n times in a row, the copies named after it.
+copies() {
+	awk -v n="$1" '/^>/ { name = $0; next } { for(i = 0; i < n; i++) { print name "_" i; print } }' "$2"
+}
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Runs the round-trip checks of readzip: make check, or sh tests/run.sh [tests/check_name.sh ...] from the top directory
+# (readzip runs the aligner from ./readaligner). The checks compress and decompress reads simulated with simulate.awk
+# against a small reference, in a temporary directory that is removed afterwards.
+
+RZ_DATA=$(mktemp -d "${TMPDIR:-/tmp}/readzip-check.XXXXXX") || exit 1
+export RZ_DATA
+trap 'rm -rf "$RZ_DATA"' EXIT
+trap 'exit 1' INT TERM
+
+awk -f tests/simulate.awk -v what=reference > "$RZ_DATA/ref.fa" &&
+	awk -f tests/simulate.awk -v what=reads -v n=3000 -v duplicates=100 -v unaligned=20 "$RZ_DATA/ref.fa" > "$RZ_DATA/reads.fa" &&
+	awk -f tests/simulate.awk -v what=reads -v n=70000 -v len=50 -v seed=31 "$RZ_DATA/ref.fa" > "$RZ_DATA/many.fa" &&
+	awk -f tests/simulate.awk -v what=pairs -v n=1500 -v duplicates=50 -v unaligned=20 -v out="$RZ_DATA/pairs" "$RZ_DATA/ref.fa" &&
+	./readzip index "$RZ_DATA/ref.fa" > "$RZ_DATA/index.log" 2>&1 || {
+		echo "Failure in making the test data:"
+		cat "$RZ_DATA/index.log"
+		exit 1
+	}
+
+passed=0
+failed=0
+
+for check in ${*:-tests/check_*.sh}; do
+
+	name=$(basename "$check" .sh)
+
+	if sh "$check" > "$RZ_DATA/$name.log" 2>&1; then
+		echo "PASS: $name"
+		passed=$((passed + 1))
+	else
+		echo "FAIL: $name"
+		sed 's/^/    /' "$RZ_DATA/$name.log" | tail -n 30
+		failed=$((failed + 1))
+	fi
+done
+
+echo "$passed passed, $failed failed"
+[ $failed -eq 0 ]
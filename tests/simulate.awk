@@ -0,0 +1,165 @@
+# Simulates a reference, or reads and pairs of a reference, for the checks and the benchmarks:
+#
+#	awk -f tests/simulate.awk -v what=reference > ref.fa
+#	awk -f tests/simulate.awk -v what=reads -v n=1000 ref.fa > reads.fa
+#	awk -f tests/simulate.awk -v what=pairs -v n=1000 -v orientation=rf -v out=pairs ref.fa
+#	awk -f tests/simulate.awk -v what=sam -v n=1000 -v unaligned=500 ref.fa > pairs.sam
+#
+# Pairs are written to out_1.fa and out_2.fa. The mates face each other (fr, default), face away from each other (rf)
+# or are on the same strand (ff). With what=sam the pairs are also written as collated SAM records with their true
+# alignments, to compress them without the aligner. Other settings: seed, len (length of the reads, 100), insert (mean insert size, 300),
+# errors, unaligned and duplicates (per mille of the bases with a substitution (10), of random reads that don't
+# align (0) and of reads repeating the one before (0)), and stacked (1 for reads all from one place, on either strand).
+# The generator is a plain Lehmer generator, so the files are the same with any awk.
+
+function random(n) {
+	state = (state * 16807) % 2147483647
+	return int(state / 2147483647 * n)
+}
+
+function base() {
+	return substr("ACGT", random(4) + 1, 1)
+}
+
+function complement(s,    i, r) {
+	r = ""
+	for(i = length(s); i > 0; i--)
+		r = r comp[substr(s, i, 1)]
+	return r
+}
+
+function mutate(s,    i, r) {
+	r = ""
+	for(i = 1; i <= length(s); i++)
+		r = r (random(1000) < errors ? base() : substr(s, i, 1))
+	return r
+}
+
+# Fragment of the reference, its chromosome, start and strand are left in fragment_chromosome, fragment_start and
+# fragment_reverse
+function fragment(size,    c, p, s) {
+	c = random(chromosomes) + 1
+	p = random(length(sequence[c]) - size) + 1
+	s = substr(sequence[c], p, size)
+	fragment_chromosome = c
+	fragment_start = p
+	fragment_reverse = random(2)
+	return fragment_reverse ? complement(s) : s
+}
+
+# The fragment of the first call on either strand, for stacked reads
+function stack() {
+	if(stacked_read == "")
+		stacked_read = fragment(len)
+	return random(2) ? complement(stacked_read) : stacked_read
+}
+
+# SAM record of a mate, SEQ is along the reference
+function record(flag, start, mate_start, read, reverse) {
+	if(!aligned)
+		return "p" i "\t" flag "\t*\t0\t0\t*\t*\t0\t0\t" read "\t*"
+	return "p" i "\t" flag "\t" name[fragment_chromosome] "\t" start "\t60\t" len "M\t=\t" mate_start "\t0\t" (reverse ? complement(read) : read) "\t*"
+}
+
+function junk(    i, r) {
+	r = ""
+	for(i = 0; i < len; i++)
+		r = r base()
+	return r
+}
+
+BEGIN {
+	state = seed ? seed : 1
+	for(i = 0; i < 10; i++)
+		random(1)
+	len = len ? len : 100
+	insert = insert ? insert : 300
+	errors = errors != "" ? errors : 10
+	orientation = orientation ? orientation : "fr"
+	comp["A"] = "T"; comp["C"] = "G"; comp["G"] = "C"; comp["T"] = "A"; comp["N"] = "N"
+
+	if(what == "reference") {
+		for(c = 1; c <= 2; c++) {
+			print ">chr" c " simulated"
+			for(i = 0; i < (c == 1 ? 40000 : 24000) / 60; i++) {
+				row = ""
+				for(j = 0; j < 60; j++)
+					row = row base()
+				print row
+			}
+		}
+		exit
+	}
+}
+
+/^>/ {
+	chromosomes++
+	name[chromosomes] = substr($1, 2)
+	next
+}
+
+{
+	sequence[chromosomes] = sequence[chromosomes] toupper($0)
+}
+
+END {
+	if(what == "reads") {
+		for(i = 0; i < n; i++) {
+			if(i == 0 || random(1000) >= duplicates)
+				read = random(1000) < unaligned ? junk() : mutate(stacked ? stack() : fragment(len))
+			print ">r" i
+			print read
+		}
+	}
+
+	if(what == "pairs" || what == "sam") {
+		if(what == "sam") {
+			print "@HD\tVN:1.6\tSO:unsorted"
+			for(c = 1; c <= chromosomes; c++)
+				print "@SQ\tSN:" name[c] "\tLN:" length(sequence[c])
+		}
+		for(i = 0; i < n; i++) {
+			if(i > 0 && random(1000) < duplicates) {
+				# The pair before is repeated
+			}
+			else if(random(1000) < unaligned) {
+				first = junk()
+				second = junk()
+				aligned = 0
+			}
+			else {
+				# Sum of uniform variables, about normal with a deviation of 30
+				size = insert - 100
+				for(k = 0; k < 4; k++)
+					size += random(51)
+				f = fragment(size)
+				first = substr(f, 1, len)
+				second = substr(f, size - len + 1)
+				reverse_1 = reverse_2 = fragment_reverse
+				if(orientation == "fr") {
+					second = complement(second)
+					reverse_2 = !reverse_2
+				}
+				else if(orientation == "rf") {
+					first = complement(first)
+					reverse_1 = !reverse_1
+				}
+				start_1 = fragment_start + (fragment_reverse ? size - len : 0)
+				start_2 = fragment_start + (fragment_reverse ? 0 : size - len)
+				first = mutate(first)
+				second = mutate(second)
+				aligned = 1
+			}
+			if(out != "") {
+				print ">p" i > (out "_1.fa")
+				print first > (out "_1.fa")
+				print ">p" i > (out "_2.fa")
+				print second > (out "_2.fa")
+			}
+			if(what == "sam") {
+				print record(aligned ? 67 + 16 * reverse_1 + 32 * reverse_2 : 77, start_1, start_2, first, reverse_1)
+				print record(aligned ? 131 + 16 * reverse_2 + 32 * reverse_1 : 141, start_2, start_1, second, reverse_2)
+			}
+		}
+	}
+}
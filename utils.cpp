@@ -5,24 +5,72 @@
 #include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
 #include "AlignmentReader.h"
 
+// Alignments of a read sequence (the mates joined by newline for pairs), empty while the alignment isn't known yet
+struct cached_alignment_t {
+	std::string sequence;
+	std::vector<Alignment> alignments;
+};
+
+// Alignments of the reads of a chunk keyed by the 64-bit hash of the sequence. A sequence whose hash is taken by
+// another one isn't cached, it's aligned as if it had no copies.
+typedef std::unordered_map<uint64_t, cached_alignment_t> alignment_cache_t;
+
+// Where the reads given to align_single and align_pair ended up before the aligner
+struct alignment_stats_t {
+	long total, duplicates, screened, fast;
+	alignment_stats_t() : total(0), duplicates(0), screened(0), fast(0) {}
+};
+
 bool startPosComp(const Alignment& a, const Alignment& b)
 {
-	return a.getStart() < b.getStart();
+	if(a.getChromosome() != b.getChromosome())
+		return a.getChromosome() < b.getChromosome();
+
+	if(a.getStart() != b.getStart())
+		return a.getStart() < b.getStart();
+
+	if(a.getStrand() != b.getStrand())
+		return a.getStrand() < b.getStrand();
+
+	if(a.getLength() != b.getLength())
+		return a.getLength() < b.getLength();
+
+	return a.getEdits() < b.getEdits();
 }
 
-void writeAlignment(bit_file_c& out, Alignment& a, long prevPos)
+bool sameAlignment(const Alignment& a, const Alignment& b)
+{
+	return a.getStart() == b.getStart() && a.getStrand() == b.getStrand() && a.getLength() == b.getLength() &&
+		a.getEdits() == b.getEdits() && a.getChromosome() == b.getChromosome();
+}
+
+bool sameAlignment(const std::pair<Alignment, Alignment>& a, const std::pair<Alignment, Alignment>& b)
+{
+	return sameAlignment(a.first, b.first) && sameAlignment(a.second, b.second);
+}
+
+// Codes the fields of the alignment after its start: the length, the strand (unless it follows from the orientation of
+// a second mate) and the edits.
+static void writeAlignmentFields(bit_file_c& out, const Alignment& a, long modal, bool strand)
 {
-	long posField = a.getStart() - prevPos;
-	if(posField < 0)
-		posField = -posField;
 	long lengthField = a.getLength();
 	long edField = a.getEdits().size();
 
-	writeGammaCode(out, posField);
-	writeGammaCode(out, lengthField);
-	out.PutBit(a.getStrand() == 'F' ? 0 : 1);
+	writeLength(out, lengthField, modal);
+	if(strand)
+		out.PutBit(a.getStrand() == 'F' ? 0 : 1);
 	writeGammaCode(out, edField);
 
 	// Write edit ops
@@ -38,28 +86,305 @@ void writeAlignment(bit_file_c& out, Alignment& a, long prevPos)
 	}
 }
 
+void writeAlignment(bit_file_c& out, const Alignment& a, long prevPos, long modal, bool runs)
+{
+	long posField = a.getStart() - prevPos;
+
+	writeGammaCode(out, posField);
+	if(runs && posField == 0)
+		out.PutBit(0);
+	writeAlignmentFields(out, a, modal, true);
+}
+
+void writeDuplicates(bit_file_c& out, long count)
+{
+	writeGammaCode(out, 0);
+	out.PutBit(1);
+	writeGammaCode(out, count - 1);
+}
+
+// Ones before the distances that the Rice code of writeMateDistance doesn't reach
+static const long MATE_ESCAPE = 16;
+
+// Difference of the distance of the mates to the insert size, zigzag mapped to 0, 1, 2... for 0, -1, 1...
+static long mateDifference(long distance, uint32_t insert_size)
+{
+	long difference = labs(distance) - insert_size;
+
+	return difference >= 0 ? 2 * difference : -2 * difference - 1;
+}
+
+long mateDistanceCodeLength(long distance, uint32_t insert_size, uint32_t rice)
+{
+	long quotient = mateDifference(distance, insert_size) >> rice;
+
+	return quotient < MATE_ESCAPE ? quotient + 1 + rice : MATE_ESCAPE + gammaCodeLength(distance);
+}
+
+int mateOrientation(const Alignment& a_1, const Alignment& a_2)
+{
+	// Behind along the reverse strand is a greater start
+	bool behind = (a_2.getStart() < a_1.getStart()) != (a_1.getStrand() == 'R');
+
+	return ((a_2.getStrand() == 'R') == (a_1.getStrand() == 'R') ? 2 : 0) + (behind ? 1 : 0);
+}
+
+uint32_t mateOrientationModel(const std::vector<int>& orientations)
+{
+	long counts[4] = {0, 0, 0, 0};
+	for(size_t i = 0; i < orientations.size(); ++i)
+		counts[orientations[i] & 3]++;
+
+	int order[4] = {0, 1, 2, 3};
+	std::stable_sort(order, order + 4, [&counts](int a, int b) { return counts[a] > counts[b]; });
+
+	uint32_t model = 0;
+	int present = 0;
+	for(int rank = 0; rank < 4; ++rank)
+	{
+		model |= order[rank] << (2 * rank);
+		present += counts[order[rank]] > 0 ? 1 : 0;
+	}
+
+	return model | (std::max(present, 1) - 1) << 8;
+}
+
+// Rank of the orientation in the orientations of the block, the number of ones of its code
+static int orientationRank(int orientation, uint32_t orientations)
+{
+	for(int rank = 0; rank < 3; ++rank)
+		if((int)((orientations >> (2 * rank)) & 3) == orientation)
+			return rank;
+
+	return 3;
+}
+
+// The last orientation the pairs of the block have, its code has no zero after the ones
+static int lastOrientationRank(uint32_t orientations)
+{
+	return (orientations >> 8) & 3;
+}
+
+long mateOrientationCodeLength(const Alignment& a_1, const Alignment& a_2, uint32_t orientations)
+{
+	if(a_1.getStart() == 0)
+		return 0;
+
+	int rank = orientationRank(mateOrientation(a_1, a_2), orientations);
+
+	return rank < lastOrientationRank(orientations) ? rank + 1 : rank;
+}
+
+void writeMateOrientation(bit_file_c& out, const Alignment& a_1, const Alignment& a_2, uint32_t orientations)
+{
+	// Unaligned pairs aren't in the model, their mates are on the same strand
+	if(a_1.getStart() == 0)
+		return;
+
+	int rank = orientationRank(mateOrientation(a_1, a_2), orientations);
+
+	for(int i = 0; i < rank; ++i)
+		out.PutBit(1);
+	if(rank < lastOrientationRank(orientations))
+		out.PutBit(0);
+}
+
+bool readMateOrientation(bit_file_c& in, uint32_t orientations, char strand, long start, char& mate_strand, long& direction)
+{
+	// Unaligned pairs code none, their mates are on the same strand and not behind
+	long orientation = 2;
+
+	if(start > 0)
+	{
+		int rank = 0;
+
+		while(rank < lastOrientationRank(orientations) && in.GetBit() == 1)
+			rank++;
+
+		orientation = (orientations >> (2 * rank)) & 3;
+	}
+
+	if(!in.good())
+		return false;
+
+	mate_strand = (orientation & 2) ? strand : (strand == 'R' ? 'F' : 'R');
+	direction = ((orientation & 1) != 0) != (strand == 'R') ? -1 : 1;
+	return true;
+}
+
+void insertSizeModel(std::vector<long> distances, uint32_t& insert_size, uint32_t& rice)
+{
+	insert_size = rice = 0;
+
+	if(distances.empty())
+		return;
+
+	for(size_t i = 0; i < distances.size(); ++i)
+		distances[i] = labs(distances[i]);
+
+	std::nth_element(distances.begin(), distances.begin() + distances.size() / 2, distances.end());
+	insert_size = distances[distances.size() / 2];
+
+	// The spread of the insert sizes sets the parameter, it's picked by the bits the distances take
+	long best = -1;
+
+	for(uint32_t parameter = 0; parameter < 24; ++parameter)
+	{
+		long bits = 0;
+		for(size_t i = 0; i < distances.size(); ++i)
+			bits += mateDistanceCodeLength(distances[i], insert_size, parameter);
+
+		if(best < 0 || bits < best)
+		{
+			best = bits;
+			rice = parameter;
+		}
+	}
+}
+
+void writeMateDistance(bit_file_c& out, long distance, uint32_t insert_size, uint32_t rice)
+{
+	long value = mateDifference(distance, insert_size);
+	long quotient = value >> rice;
+
+	for(long i = 0; i < std::min(quotient, MATE_ESCAPE); ++i)
+		out.PutBit(1);
+
+	// Distances far from the insert size are coded as they are
+	if(quotient >= MATE_ESCAPE)
+	{
+		writeGammaCode(out, labs(distance));
+		return;
+	}
+
+	out.PutBit(0);
+
+	if(rice > 0)
+	{
+		long remainder = value & ((1L << rice) - 1);
+		out.PutBitsInt(&remainder, rice, sizeof(long));
+	}
+}
+
+bool readMateDistance(bit_file_c& in, uint32_t insert_size, uint32_t rice, long& distance)
+{
+	long quotient = 0;
+
+	while(quotient < MATE_ESCAPE && in.GetBit() == 1)
+		quotient++;
+
+	long magnitude;
+
+	if(quotient == MATE_ESCAPE)
+		magnitude = readGammaCode(in);
+	else
+	{
+		long remainder = 0;
+		if(rice > 0)
+			in.GetBitsInt(&remainder, rice, sizeof(long));
+
+		long value = (quotient << rice) | remainder;
+		magnitude = (long)insert_size + ((value & 1) ? -(value + 1) / 2 : value / 2);
+	}
+
+	if(!in.good() || magnitude < 0)
+		return false;
+
+	distance = magnitude;
+	return true;
+}
+
+void writeMate(bit_file_c& out, const Alignment& a, const Alignment& first, long modal, uint32_t insert_size, uint32_t rice, uint32_t orientations)
+{
+	writeMateOrientation(out, first, a, orientations);
+
+	// Unaligned pairs have both mates at 0, without a distance
+	if(first.getStart() > 0)
+		writeMateDistance(out, a.getStart() - first.getStart(), insert_size, rice);
+	writeAlignmentFields(out, a, modal, false);
+}
+
 bool startPosPairComp(const std::pair<Alignment, Alignment>& a, const std::pair<Alignment, Alignment>& b)
 {
-	return startPosComp(a.first, b.first); 
+	if(startPosComp(a.first, b.first))
+		return true;
+
+	if(startPosComp(b.first, a.first))
+		return false;
+
+	// Pairs are duplicates if the second mates are too
+	return startPosComp(a.second, b.second);
+}
+
+// Reads the delta of the start of a record written with writeAlignment or writeDuplicates, returns -1 on failure.
+// In a block with runs (repeats given) a run of duplicates has its number of records stored to repeats, 0 otherwise.
+static long readStartDelta(bit_file_c& in, long* repeats)
+{
+	long posField = readGammaCode(in);
+
+	if(repeats == NULL)
+		return in.good() ? posField : -1;
+
+	*repeats = 0;
+
+	if(posField != 0 || in.GetBit() == 0)
+		return in.good() ? posField : -1;
+
+	*repeats = readGammaCode(in) + 1;
+	return in.good() ? 0 : -1;
 }
 
-void readAllAlignments(std::vector<Alignment>& alignments, const std::string& infile)
+void readAllAlignments(std::vector<Alignment>& alignments, const std::string& infile, AlignmentReader::input_format_t format, const std::string& genomefile)
 {
-	AlignmentReader reader(AlignmentReader::input_tabdelimited, infile);
+	AlignmentReader reader(format, infile, genomefile);
 	Alignment a;
 
 	while(reader.next(a))
 		alignments.push_back(a);
 }
 
-void readAllPairAlignments(std::vector<std::pair<Alignment, Alignment> >& alignments, const std::string& infile1, const std::string& infile2)
+bool readAllPairAlignments(std::vector<std::pair<Alignment, Alignment> >& alignments, const std::string& infile1, const std::string& infile2, AlignmentReader::input_format_t format, const std::string& genomefile)
 {
-	AlignmentReader first_reader(AlignmentReader::input_tabdelimited, infile1);
-	AlignmentReader second_reader(AlignmentReader::input_tabdelimited, infile2);
-
 	Alignment a, b;
-	while(first_reader.next(a) && second_reader.next(b))
+
+	if(format == AlignmentReader::input_sam) {
+
+		// For SAM input both mates come from the same file
+		AlignmentReader reader(format, infile1, genomefile);
+
+		while(reader.nextPair(a, b)) {
+
+			// Mates are coded in the block of the first mate's chromosome, mates aligned elsewhere are stored unaligned
+			if(a.getChromosome() != b.getChromosome()) {
+				a = unalignedAlignment(a.getName(), reader.getSequence());
+				b = unalignedAlignment(b.getName(), reader.getMateSequence());
+			}
+
+			alignments.push_back(std::make_pair(a,b));
+		}
+
+		return reader.good();
+	}
+
+	AlignmentReader first_reader(format, infile1);
+	AlignmentReader second_reader(format, infile2);
+
+	while(first_reader.next(a)) {
+
+		if(!second_reader.next(b)) {
+			std::cerr << "Second inputfile ended before the first, error in syncronizing the alignments." << std::endl;
+			return false;
+		}
+
 		alignments.push_back(std::make_pair(a,b));
+	}
+
+	if(second_reader.next(b)) {
+		std::cerr << "First input file ended before the second, error in syncronizing the alignments." << std::endl;
+		return false;
+	}
+
+	return true;
 }
 
 void writeGammaCode(bit_file_c& out, long value)
@@ -179,6 +504,111 @@ std::map<std::string, int> code_chromosomes(std::string genomefile) {
 	return codes;
 }
 
+std::istream& open_input(const std::string& file, std::ifstream& stream) {
+
+	if(file == "-")
+		return std::cin;
+
+	stream.open(file.c_str(), std::ios::in | std::ios::binary);
+	return stream;
+}
+
+std::ostream& open_output(const std::string& file, std::ofstream& stream) {
+
+	if(file == "-")
+		return std::cout;
+
+	stream.open(file.c_str(), std::ios::out | std::ios::binary);
+	return stream;
+}
+
+std::vector<std::string> chromosome_names(const std::map<std::string, int>& codes) {
+
+	std::vector<std::string> names(codes.size());
+
+	for(std::map<std::string, int>::const_iterator it = codes.begin(); it != codes.end(); it++)
+		names.at(it->second) = it->first;
+
+	return names;
+}
+
+Reference::Reference(const std::string& genomefile_)
+	: genomefile(genomefile_), codes(code_chromosomes(genomefile_)), names(chromosome_names(codes)) {
+}
+
+const std::map<std::string, std::string>& Reference::getChromosomes() const {
+
+	std::call_once(loaded, [this]() { chromosomes = read_chromosomes(genomefile); });
+
+	return chromosomes;
+}
+
+const Reference& load_reference(const std::string& genomefile) {
+
+	static std::mutex lock;
+	static std::map<std::string, std::unique_ptr<Reference> > references;
+
+	std::unique_lock<std::mutex> guard(lock);
+	std::unique_ptr<Reference>& reference = references[genomefile];
+
+	if(!reference)
+		reference.reset(new Reference(genomefile));
+
+	return *reference;
+}
+
+// Reads the chromosome sequences from given genomefile
+std::map<std::string, std::string> read_chromosomes(std::string genomefile) {
+
+	ifstream in_genome(genomefile.c_str());
+
+	if(!in_genome.is_open()) {
+		std::cerr << "Failure to read the chromosomes, file could not be opened." << std::endl;
+		abort();
+	}
+
+	std::map<std::string, std::string> chromosomes;
+
+	std::string info = "";
+	std::string row;
+
+	getline(in_genome, row);
+
+	std::string id = row.substr(1, row.find_first_of(' ')-1);
+
+	while(getline(in_genome, row)) {
+
+		if(row.at(0) == '>') {
+			chromosomes[id] = info;
+			id = row.substr(1, row.find_first_of(' ')-1);
+			info = "";
+		}
+		else {
+			info.append(row);
+		}
+	}
+
+	chromosomes[id] = info;
+
+	return chromosomes;
+}
+
+Alignment unalignedAlignment(const std::string& name, const std::string& sequence)
+{
+	// Every base is inserted in front of the (empty) reference window
+	std::vector<std::pair<int, char> > edit_vector;
+
+	for(unsigned i = 0; i < sequence.length(); i++)
+		edit_vector.push_back(make_pair(0, (char)tolower(sequence.at(i))));
+
+	return Alignment(name, 'F', 0, "*", 0, edit_vector);
+}
+
+bool bam_to_sam(std::string bamfile, std::string samfile)
+{
+	return run_program({"samtools", "view", "-h", bamfile}, samfile);
+}
+
 int getEditCode(char c)
 {
 	switch(c) {
@@ -212,6 +642,16 @@ int getEditCode(char c)
 }
 
 
+char getEditChar(int edCode)
+{
+	static const char chars[] = {'A', 'C', 'G', 'T', 'N', 'a', 'n', 'c', 'g', 't', 'D'};
+
+	if(edCode < 0 || edCode > deletion)
+		return 0;
+
+	return chars[edCode];
+}
+
 void writeEditOp(bit_file_c& out, long edPos, int edCode)
 {
 	writeGammaCode(out, edPos);
@@ -226,10 +666,24 @@ std::pair<long, int> readEditOp(bit_file_c& in)
 	return std::make_pair(pos, code);
 }
 
+// True if the edit can be made at the index of the string: mismatches and deletions change a base of it, insertions can
+// also go after its last base.
+static bool editFits(int edCode, long index, const std::string& str)
+{
+	if(getEditChar(edCode) == 0 || index < 0)
+		return false;
+
+	bool insertion = (edCode >= insertion_A && edCode <= insertion_T);
+	return index < (long)str.length() || (insertion && index == (long)str.length());
+}
+
 long modifyString(int edCode, std::string& str, size_t index)
 {
-	if(index > str.length())
-		std::cerr << "Edit position " << index << " > String length " << str.length() << '\n';
+	if(!editFits(edCode, (long)index, str)) {
+		std::cerr << "Edit " << edCode << " at " << index << " doesn't fit in a string of length " << str.length() << '\n';
+		return 0;
+	}
+
 	switch(edCode) {
 		case mismatch_A:
 			str[index] = 'A';	
@@ -238,10 +692,10 @@ long modifyString(int edCode, std::string& str, size_t index)
 			str[index] = 'C';
 			return 0;
 		case mismatch_G:
-			str[index] = 'A';	
+			str[index] = 'G';
 			return 0;
 		case mismatch_T:
-			str[index] = 'C';
+			str[index] = 'T';
 			return 0;
 		case mismatch_N:
 			str[index] = 'N';
@@ -270,57 +724,267 @@ long modifyString(int edCode, std::string& str, size_t index)
 	}
 }
 
-bool align_single(std::string inputfile, std::string index, std::string outputfile, read_mode_t read_mode, bool maintainOrder) {
+bool open_reference_index(std::string genomefile, ReferenceIndex& index)
+{
+	std::string indexfile = genomefile + ".rzi";
 
-	std::string temp_file = outputfile + ".tmp";
+	if(index.open(indexfile, genomefile))
+		return true;
 
-	std::string callstring = "awk -f rnreads.awk " + inputfile + " > " + inputfile + ".tmp";
+	std::cerr << "Building the reference index " << indexfile << ", readzip index can build it ahead of time." << std::endl;
 
-	system(callstring.c_str());
+	if(!ReferenceIndex::build(genomefile, indexfile) || !index.open(indexfile, genomefile)) {
+		std::cerr << "Warning: could not build the reference index, every read goes to the aligner." << std::endl;
+		return false;
+	}
 
-	callstring = "./readaligner/readaligner -P0 -i3 -v ";
+	return true;
+}
 
-	if(read_mode == read_mode_fasta)
-		callstring += "--fasta ";
-	else if(read_mode == read_mode_fastq)
-		callstring += "--fastq ";
-	else {
-		std::cerr << "Unrecognized read mode. Exiting." << std::endl;
-		exit(1);
-	}
+bool prescreen_fails(const BloomFilter& filter, const std::string& read)
+{
+	std::pair<unsigned, unsigned> hits = filter.countHits(read);
 
-	system((callstring + " -o " + temp_file + " " + index + " " + inputfile + ".tmp").c_str());
+	// Reads shorter than the k-mers are left for the aligner
+	if(hits.first == 0)
+		return false;
 
-	callstring = "sort -t 'd' -n +1 -2 " + temp_file + " > " + temp_file + ".sorted";
-	system(callstring.c_str());
-	system(("rm " + temp_file).c_str());
+	return hits.second < PRESCREEN_MIN_HITS + hits.first / PRESCREEN_KMERS_PER_HIT;
+}
 
-	//Create "insertion alignments" for unmapped reads
-	ifstream in_reads((inputfile + ".tmp").c_str());
-	ofstream out(outputfile.c_str());
+// Aligns the read (or both mates) without the aligner if it matches the reference with few mismatches.
+static bool fastAlign(const std::vector<std::string>& ids, const std::vector<std::string>& sequences, const ReferenceIndex& index,
+	bool maintainOrder, std::vector<Alignment>& result)
+{
+	std::vector<std::vector<Alignment> > candidates(sequences.size());
 
-	if(!in_reads.is_open() | !out.is_open()) {
-		std::cerr << "Failure to open files. Exiting." << std::endl;
-		exit(1);
+	for(unsigned i = 0; i < sequences.size(); i++) {
+		index.alignUngapped(ids.at(i), sequences.at(i), FAST_PATH_MAX_MISMATCHES, candidates.at(i));
+		if(candidates.at(i).empty())
+			return false;
 	}
 
-	AlignmentReader* alignment_reader = new AlignmentReader(AlignmentReader::input_tabdelimited, temp_file+".sorted");
+	if(sequences.size() == 1) {
+		unsigned best = 0;
+		for(unsigned j = 1; j < candidates.at(0).size(); j++)
+			if(editsCodeLength(candidates.at(0).at(j)) < editsCodeLength(candidates.at(0).at(best)))
+				best = j;
+		result.push_back(candidates.at(0).at(best));
+		return true;
+	}
 
-	string id;
-	string pattern;
-	string row;
+	Alignment unaligned_1 = unalignedAlignment(ids.at(0), sequences.at(0));
+	Alignment unaligned_2 = unalignedAlignment(ids.at(1), sequences.at(1));
 
-	Alignment a;
+	std::pair<int, int> best = choosePair(candidates.at(0), candidates.at(1), pairCodeLength(unaligned_1, unaligned_2, maintainOrder), maintainOrder);
 
-	bool no_more_alignments = false;
+	if(best.first < 0)
+		return false;
 
-	int number_of_missing = 0;
-	int total_number = 0;
+	result.push_back(candidates.at(0).at(best.first));
+	result.push_back(candidates.at(1).at(best.second));
+	return true;
+}
 
-	if(!(alignment_reader->next(a)))
-		no_more_alignments = true;
+// Entry of the sequence in the cache, a new one (added) if its hash is free. Returns NULL if another sequence has the hash.
+static cached_alignment_t* cacheEntry(alignment_cache_t& cache, const std::string& sequence, bool& added)
+{
+	std::pair<alignment_cache_t::iterator, bool> inserted = cache.insert(std::make_pair((uint64_t)std::hash<std::string>()(sequence), cached_alignment_t()));
+	added = inserted.second;
 
-	while(getline(in_reads, id)) {
+	if(added)
+		inserted.first->second.sequence = sequence;
+	else if(inserted.first->second.sequence != sequence)
+		return NULL;
+
+	return &inserted.first->second;
+}
+
+// Copies the reads (mates on the same line of each file) to the outputfiles unless an identical read has been copied before,
+// the index shows that the read (any of the mates) can't align, or the read was aligned in the fast path.
+// Returns the number of reads copied.
+static long writeUniqueReads(const std::vector<std::string>& inputfiles, const std::vector<std::string>& outputfiles, read_mode_t read_mode,
+	alignment_cache_t& cache, const ReferenceIndex& index, bool maintainOrder, alignment_stats_t& stats)
+{
+	std::vector<ifstream*> in;
+	std::vector<ofstream*> out;
+
+	for(unsigned i = 0; i < inputfiles.size(); i++) {
+		in.push_back(new ifstream(inputfiles.at(i).c_str()));
+		out.push_back(new ofstream(outputfiles.at(i).c_str()));
+
+		if(!in.back()->is_open() | !out.back()->is_open()) {
+			std::cerr << "Failure to open files. Exiting." << std::endl;
+			exit(1);
+		}
+	}
+
+	long unique = 0;
+	unsigned lines = (read_mode == read_mode_fastq) ? 4 : 2;
+
+	while(true) {
+
+		std::vector<std::string> records(in.size());
+		std::vector<std::string> ids(in.size());
+		std::vector<std::string> sequences(in.size());
+
+		for(unsigned i = 0; i < in.size(); i++) {
+
+			std::string row;
+
+			for(unsigned j = 0; j < lines && getline(*in.at(i), row); j++) {
+				records.at(i) += row + '\n';
+
+				if(j == 0)
+					ids.at(i) = row.substr(1);
+				else if(j == 1)
+					sequences.at(i) = row;
+			}
+		}
+
+		if(!(*in.at(0)))
+			break;
+
+		stats.total++;
+
+		std::string key = sequences.at(0);
+		for(unsigned i = 1; i < sequences.size(); i++)
+			key += '\n' + sequences.at(i);
+
+		// Duplicates are served from the cache
+		bool added;
+		cached_alignment_t* entry = cacheEntry(cache, key, added);
+
+		if(entry != NULL && !added) {
+			stats.duplicates++;
+			continue;
+		}
+
+		if(!index.isOpen()) {
+			unique++;
+			for(unsigned i = 0; i < out.size(); i++)
+				*out.at(i) << records.at(i);
+			continue;
+		}
+
+		// Reads left out are stored unaligned when merging the alignments
+		bool unalignable = false;
+		for(unsigned i = 0; i < sequences.size(); i++)
+			unalignable = unalignable || prescreen_fails(index.getFilter(), sequences.at(i));
+
+		if(unalignable) {
+			stats.screened++;
+			continue;
+		}
+
+		// The fast path keeps its alignment in the cache, reads left out of it go to the aligner
+		if(entry != NULL && fastAlign(ids, sequences, index, maintainOrder, entry->alignments)) {
+			stats.fast++;
+			continue;
+		}
+
+		unique++;
+
+		for(unsigned i = 0; i < out.size(); i++)
+			*out.at(i) << records.at(i);
+	}
+
+	for(unsigned i = 0; i < in.size(); i++) {
+		delete in.at(i);
+		delete out.at(i);
+	}
+
+	return unique;
+}
+
+// Copy of the alignment for another read with the same sequence.
+static Alignment renameAlignment(const Alignment& a, const std::string& name)
+{
+	return Alignment(name, a.getStrand(), a.getLength(), a.getChromosome(), a.getStart(), a.getEdits());
+}
+
+static void reportAlignmentStats(const alignment_stats_t& stats)
+{
+	double total = stats.total > 0 ? stats.total : 1;
+
+	std::cerr << "Duplicate cache: " << stats.duplicates << " of " << stats.total << " reads (" << 100.0 * stats.duplicates / total
+		<< "%) reused the alignment of an identical earlier read." << std::endl;
+	std::cerr << "Pre-screen: " << stats.screened << " reads had too few k-mers in the reference and skipped the aligner." << std::endl;
+	std::cerr << "Fast path: " << stats.fast << " reads (" << 100.0 * stats.fast / total << "%) matched the reference without the aligner." << std::endl;
+}
+
+// Aligns a chunk of single reads, the duplicate cache holds the reads of the chunk.
+static bool alignSingleChunk(std::string inputfile, std::string index, std::string outputfile, read_mode_t read_mode, bool maintainOrder) {
+
+	// Temporary files have names of their own, the jobs of a batch can read the same input at the same time
+	std::string prefix = temporary_prefix();
+	std::string reads_file = prefix + ".reads";
+	std::string unique_file = prefix + ".unique";
+	std::string temp_file = prefix + ".aligned";
+
+	run_program({"awk", "-f", "rnreads.awk", inputfile}, reads_file);
+
+	// Only the first of identical reads is aligned, and only if it passes the pre-screen and misses the fast path
+	alignment_cache_t cache;
+	alignment_stats_t stats;
+	ReferenceIndex reference_index;
+
+	open_reference_index(index, reference_index);
+	long unique = writeUniqueReads(std::vector<std::string>(1, reads_file), std::vector<std::string>(1, unique_file), read_mode,
+		cache, reference_index, maintainOrder, stats);
+
+	std::vector<std::string> args = {"./readaligner/readaligner", "-P0", "-i3", "-v"};
+
+	if(read_mode == read_mode_fasta)
+		args.push_back("--fasta");
+	else if(read_mode == read_mode_fastq)
+		args.push_back("--fastq");
+	else {
+		std::cerr << "Unrecognized read mode. Exiting." << std::endl;
+		exit(1);
+	}
+
+	// The aligner doesn't take an empty read file
+	if(unique > 0) {
+		args.insert(args.end(), {"-o", temp_file, index, unique_file});
+		run_program(args);
+	}
+	else
+		ofstream(temp_file.c_str());
+	unlink(unique_file.c_str());
+
+	run_program({"sort", "-t", "d", "-n", "+1", "-2", temp_file}, temp_file + ".sorted");
+	unlink(temp_file.c_str());
+
+	//Create "insertion alignments" for unmapped reads
+	ifstream in_reads(reads_file.c_str());
+	ofstream out(outputfile.c_str());
+
+	if(!in_reads.is_open() | !out.is_open()) {
+		std::cerr << "Failure to open files. Exiting." << std::endl;
+		exit(1);
+	}
+
+	AlignmentReader* alignment_reader = new AlignmentReader(AlignmentReader::input_tabdelimited, temp_file+".sorted");
+
+	string id;
+	string pattern;
+	string row;
+
+	Alignment a;
+
+	bool no_more_alignments = false;
+
+	// Alignments of a read that isn't cached, another sequence has its hash
+	std::vector<Alignment> uncached;
+
+	int number_of_missing = 0;
+	int total_number = 0;
+
+	if(!(alignment_reader->next(a)))
+		no_more_alignments = true;
+
+	while(getline(in_reads, id)) {
 
 		total_number++;
 
@@ -334,88 +998,248 @@ bool align_single(std::string inputfile, std::string index, std::string outputfi
 			getline(in_reads,row);
 		}
 
-		// Missing alignment
-		if(no_more_alignments | (a.getName() != id)) {
+		bool added;
+		cached_alignment_t* entry = cacheEntry(cache, pattern, added);
+		std::vector<Alignment>& cached = (entry != NULL) ? entry->alignments : uncached;
+		uncached.clear();
+
+		// First of identical reads that wasn't aligned in the fast path
+		if(cached.empty()) {
+
+			// Missing alignment
+			if(no_more_alignments | (a.getName() != id))
+				cached.push_back(unalignedAlignment(id, pattern));
+
+			else {
+				cached.push_back(a);
 
+				if(!alignment_reader->next(a))
+					no_more_alignments = true;
+			}
+		}
+
+		if(cached.at(0).getChromosome() == "*")
 			number_of_missing++;
 
-			char strand = 'F';
-			string chromosome = "*";
-			long start = 0;
-			int length = 0;
+		out << renameAlignment(cached.at(0), id).toString() << endl;
+	}
+
+	reportAlignmentStats(stats);
 
-			std::vector<std::pair<int, char> > edit_vector;
+	unlink(reads_file.c_str());
+	unlink((temp_file + ".sorted").c_str());
 
-			char c = pattern.at(0);
+	in_reads.close();
+	out.close();
 
-			edit_vector.push_back(make_pair(0, tolower(c)));
 
-			for(unsigned i = 1; i < pattern.length(); i++) {
-				c = pattern.at(i);
-				edit_vector.push_back(make_pair(maintainOrder ? (int)i : 0,tolower(c)));
-			}
+	if(number_of_missing > (0.5 * total_number))
+		std::cerr << "Warning: more than half the reads failed to align, compression isn't good." << std::endl;
 
-			Alignment new_a(id, strand, length, chromosome, start, edit_vector);
+	return true;
 
-			out << new_a.toString() << endl;
+}
 
+long modalLength(const std::vector<long>& lengths)
+{
+	std::unordered_map<long, long> counts;
+	long modal = 0, count = 0;
+
+	for(size_t i = 0; i < lengths.size(); i++) {
+		long& n = counts[lengths[i]];
+		if(++n > count) {
+			modal = lengths[i];
+			count = n;
 		}
+	}
 
-		else {
-			out << a.toString() << endl;
+	// Every read pays a bit for the flag, the reads of the modal length save their gamma code
+	if(modal <= 0 || count * gammaCodeLength(modal) <= (long)lengths.size())
+		return 0;
 
-			if(!alignment_reader->next(a))
-				no_more_alignments = true;
-		}
+	return modal;
+}
 
+void writeLength(bit_file_c& out, long length, long modal)
+{
+	if(modal > 0) {
+		out.PutBit(length == modal ? 1 : 0);
+		if(length == modal)
+			return;
 	}
 
-	system(("rm " + inputfile + ".tmp").c_str());
-	system(("rm " + temp_file + ".sorted").c_str());
+	writeGammaCode(out, length);
+}
 
-	in_reads.close();
-	out.close();
+long readLength(bit_file_c& in, long modal)
+{
+	if(modal > 0 && in.GetBit() == 1)
+		return modal;
 
+	return readGammaCode(in);
+}
 
-	if(number_of_missing > (0.5 * total_number))
-		std::cerr << "Warning: more than half the reads failed to align, compression isn't good." << std::endl;
+long gammaCodeLength(long value)
+{
+	if(value < 0)
+		value = -value;
 
-	return true;
+	long length = 0;
+	while((value + 1) >> (length + 1))
+		length++;
 
+	return 2 * length + 1;
 }
 
-bool align_pair(std::string inputfile_1, std::string inputfile_2, std::string index, std::string outputfile_1, std::string outputfile_2, read_mode_t read_mode, bool maintainOrder) {
+long editsCodeLength(const Alignment& a)
+{
+	long bits = gammaCodeLength(a.getEdits().size());
+	long previous = 0;
+
+	for(unsigned i = 0; i < a.getEdits().size(); i++) {
+		bits += gammaCodeLength(a.getEdits()[i].first - previous) + 4;
+		previous = a.getEdits()[i].first;
+	}
 
-	std::string temp_file_1 = outputfile_1 + ".tmp";
-	std::string temp_file_2 = outputfile_2 + ".tmp";
+	return bits;
+}
 
-	std::string callstring = "awk -f rnreads.awk " + inputfile_1 + " > " + inputfile_1 + ".tmp";
+long alignmentCodeLength(const Alignment& a, long prevPos, long modal)
+{
+	long length = (modal > 0 && a.getLength() == modal) ? 0 : gammaCodeLength(a.getLength());
 
-	system(callstring.c_str());
-	callstring = "awk -f rnreads.awk " + inputfile_2 + " > " + inputfile_2 + ".tmp";
-	system(callstring.c_str());
+	return gammaCodeLength(a.getStart() - prevPos) + (modal > 0 ? 1 : 0) + length + 1 + editsCodeLength(a);
+}
+
+long pairCodeLength(const Alignment& a_1, const Alignment& a_2, bool maintainOrder)
+{
+	if(a_1.getChromosome() != a_2.getChromosome())
+		return -1;
+
+	long distance = a_2.getStart() - a_1.getStart();
+
+	if(distance > MAX_INSERT_SIZE || -distance > MAX_INSERT_SIZE)
+		return -1;
+
+	// Strands, lengths and edits of both mates are coded the same way in both methods
+	long bits = gammaCodeLength(a_1.getLength()) + gammaCodeLength(a_2.getLength()) + editsCodeLength(a_1) + editsCodeLength(a_2);
+
+	// Method C codes the first mate with its absolute start, method D as a delta in the sorted stream. The insert size
+	// and the orientations of the block aren't known yet, the strand of the first mate and the orientation of the pair
+	// are counted as three bits and the distance of the mates as its gamma code. An unaligned pair only has the strand.
+	if(maintainOrder)
+		bits += gammaCodeLength(a_1.getStart());
+
+	bits += a_1.getStart() > 0 ? 3 + gammaCodeLength(distance) : 1;
+
+	return bits;
+}
+
+std::pair<int, int> choosePair(const std::vector<Alignment>& first_alignments, const std::vector<Alignment>& second_alignments, long maxBits, bool maintainOrder)
+{
+	// Second mates sorted by chromosome and start, so only the ones within the insert size are looked at
+	std::vector<std::pair<std::pair<std::string, long>, int> > second_sorted;
+
+	for(unsigned j = 0; j < second_alignments.size(); j++)
+		second_sorted.push_back(std::make_pair(std::make_pair(second_alignments[j].getChromosome(), second_alignments[j].getStart()), (int)j));
+
+	std::sort(second_sorted.begin(), second_sorted.end());
+
+	std::pair<int, int> best(-1, -1);
+	long best_bits = maxBits;
+
+	for(unsigned i = 0; i < first_alignments.size(); i++) {
+
+		const Alignment& candidate_1 = first_alignments[i];
+
+		std::vector<std::pair<std::pair<std::string, long>, int> >::iterator it = std::lower_bound(second_sorted.begin(), second_sorted.end(),
+			std::make_pair(std::make_pair(candidate_1.getChromosome(), candidate_1.getStart() - MAX_INSERT_SIZE), -1));
+
+		for(; it != second_sorted.end() && it->first.first == candidate_1.getChromosome() && it->first.second <= candidate_1.getStart() + MAX_INSERT_SIZE; ++it) {
+
+			long bits = pairCodeLength(candidate_1, second_alignments[it->second], maintainOrder);
+
+			if(bits >= 0 && bits < best_bits) {
+				best_bits = bits;
+				best = std::make_pair((int)i, it->second);
+			}
+		}
+	}
+
+	return best;
+}
+
+// Adds the ungapped alignments of the read within the insert size of the anchors (alignments of the other mate).
+static void rescueMate(const ReferenceIndex& index, const std::vector<Alignment>& anchors, const std::string& name, const std::string& read,
+	std::vector<Alignment>& alignments)
+{
+	for(unsigned i = 0; i < anchors.size(); i++)
+		index.alignUngapped(name, read, RESCUE_MAX_MISMATCHES, alignments, anchors.at(i).getChromosome(),
+			anchors.at(i).getStart() - MAX_INSERT_SIZE, anchors.at(i).getStart() + MAX_INSERT_SIZE);
+}
+
+// Aligns a chunk of paired reads, the duplicate cache holds the pairs of the chunk.
+static bool alignPairChunk(std::string inputfile_1, std::string inputfile_2, std::string index, std::string outputfile_1, std::string outputfile_2, read_mode_t read_mode, bool maintainOrder) {
+
+	// Temporary files have names of their own, the jobs of a batch can read the same input at the same time
+	std::string prefix = temporary_prefix();
+	std::string reads_file_1 = prefix + ".1.reads";
+	std::string reads_file_2 = prefix + ".2.reads";
+	std::string unique_file_1 = prefix + ".1.unique";
+	std::string unique_file_2 = prefix + ".2.unique";
+	std::string temp_file_1 = prefix + ".1.aligned";
+	std::string temp_file_2 = prefix + ".2.aligned";
+
+	run_program({"awk", "-f", "rnreads.awk", inputfile_1}, reads_file_1);
+	run_program({"awk", "-f", "rnreads.awk", inputfile_2}, reads_file_2);
+
+	// Only the first of identical pairs is aligned, and only if both mates pass the pre-screen and the pair misses the fast path
+	alignment_cache_t cache;
+	alignment_stats_t stats;
+	ReferenceIndex reference_index;
+
+	open_reference_index(index, reference_index);
+	std::vector<std::string> tmp_files, unique_files;
+	tmp_files.push_back(reads_file_1);
+	tmp_files.push_back(reads_file_2);
+	unique_files.push_back(unique_file_1);
+	unique_files.push_back(unique_file_2);
+
+	long unique = writeUniqueReads(tmp_files, unique_files, read_mode, cache, reference_index, maintainOrder, stats);
 
 	// Ask for max 10 alignments per read, out of those bigger chance to find matching pair
-	callstring = "./readaligner/readaligner -P0 -i3 -r10 -v ";
+	std::vector<std::string> args = {"./readaligner/readaligner", "-P0", "-i3", "-r10", "-v"};
 
 	if(read_mode == read_mode_fasta)
-		callstring += "--fasta ";
+		args.push_back("--fasta");
 	else if(read_mode == read_mode_fastq)
-		callstring += "--fastq ";
+		args.push_back("--fastq");
 	else {
 		std::cerr << "Unrecognized read mode. Exiting." << std::endl;
 		exit(1);
 	}
 
-	system((callstring + " -o " + temp_file_1 + " " + index + " " + inputfile_1 + ".tmp").c_str());
-	system((callstring + " -o " + temp_file_2 + " " + index + " " + inputfile_2 + ".tmp").c_str());
+	// The aligner doesn't take an empty read file
+	if(unique > 0) {
+		std::vector<std::string> args_1 = args, args_2 = args;
+		args_1.insert(args_1.end(), {"-o", temp_file_1, index, unique_file_1});
+		args_2.insert(args_2.end(), {"-o", temp_file_2, index, unique_file_2});
+		run_program(args_1);
+		run_program(args_2);
+	}
+	else {
+		ofstream(temp_file_1.c_str());
+		ofstream(temp_file_2.c_str());
+	}
+	unlink(unique_file_1.c_str());
+	unlink(unique_file_2.c_str());
 
 	//Create "insertion alignments" for unmapped reads
 
-	ifstream in_reads_1((inputfile_1 + ".tmp").c_str());
+	ifstream in_reads_1(reads_file_1.c_str());
 	ofstream out_1(outputfile_1.c_str());
 
-	ifstream in_reads_2((inputfile_2 + ".tmp").c_str());
+	ifstream in_reads_2(reads_file_2.c_str());
 	ofstream out_2(outputfile_2.c_str());
 
 
@@ -424,12 +1248,10 @@ bool align_pair(std::string inputfile_1, std::string inputfile_2, std::string in
 		exit(1);
 	}
 
-	callstring = "sort -t 'd' -n +1 -2 " + temp_file_1 + " > " + temp_file_1 + ".sorted";
-	system(callstring.c_str());
-	system(("rm " + temp_file_1).c_str());
-	callstring = "sort -t 'd' -n +1 -2 " + temp_file_2 + " > " + temp_file_2 + ".sorted";
-	system(callstring.c_str());
-	system(("rm " + temp_file_2).c_str());
+	run_program({"sort", "-t", "d", "-n", "+1", "-2", temp_file_1}, temp_file_1 + ".sorted");
+	unlink(temp_file_1.c_str());
+	run_program({"sort", "-t", "d", "-n", "+1", "-2", temp_file_2}, temp_file_2 + ".sorted");
+	unlink(temp_file_2.c_str());
 
 	AlignmentReader* alignment_reader_1 = new AlignmentReader(AlignmentReader::input_tabdelimited, temp_file_1+".sorted");
 	AlignmentReader* alignment_reader_2 = new AlignmentReader(AlignmentReader::input_tabdelimited, temp_file_2+".sorted");
@@ -450,8 +1272,12 @@ bool align_pair(std::string inputfile_1, std::string inputfile_2, std::string in
 	bool no_more_alignments_1 = false;
 	bool no_more_alignments_2 = false;
 
+	// Alignments of a pair that isn't cached, another sequence has its hash
+	std::vector<Alignment> uncached;
+
 	int number_of_missing = 0;
 	int total_number = 0;
+	long rescued = 0;
 
 	if(!alignment_reader_1->next(a_1))
 		no_more_alignments_1 = true;
@@ -479,176 +1305,337 @@ bool align_pair(std::string inputfile_1, std::string inputfile_2, std::string in
 			getline(in_reads_2,row_2);
 		}
 
-		// Missing alignment
-		if(no_more_alignments_1 | (a_1.getName() != id_1) | no_more_alignments_2 | (a_2.getName() != id_2)) {
+		bool added;
+		cached_alignment_t* entry = cacheEntry(cache, pattern_1 + '\n' + pattern_2, added);
+		std::vector<Alignment>& cached = (entry != NULL) ? entry->alignments : uncached;
+		uncached.clear();
 
-			number_of_missing++;
+		// First of identical pairs that wasn't aligned in the fast path
+		if(cached.empty()) {
+
+			vector<Alignment> first_alignments;
+			vector<Alignment> second_alignments;
+
+			while(!no_more_alignments_1 && (a_1.getName() == id_1)) {
+				first_alignments.push_back(a_1);
+				if(!alignment_reader_1->next(a_1))
+					no_more_alignments_1 = true;
+			}
+
+			while(!no_more_alignments_2 && (a_2.getName() == id_2)) {
+				second_alignments.push_back(a_2);
+				if(!alignment_reader_2->next(a_2))
+					no_more_alignments_2 = true;
+			}
 
-			// Create insertion alignments for the two
-			char strand = 'F';
-			string chromosome = "*";
-			long start = 0;
-			int length = 0;
+			// Storing the mates unaligned is the fallback, any pair has to be cheaper than that
+			Alignment unaligned_1 = unalignedAlignment(id_1, pattern_1);
+			Alignment unaligned_2 = unalignedAlignment(id_2, pattern_2);
+			long max_bits = pairCodeLength(unaligned_1, unaligned_2, maintainOrder);
 
-			std::vector<std::pair<int, char> > edit_vector_1;
+			std::pair<int, int> best = choosePair(first_alignments, second_alignments, max_bits, maintainOrder);
 
-			char c = pattern_1.at(0);
+			// Mate rescue: look for the other mate near the alignments of the one that aligned
+			if(best.first < 0 && reference_index.isOpen() && (first_alignments.empty() != second_alignments.empty())) {
 
-			edit_vector_1.push_back(make_pair(0, tolower(c)));
+				if(second_alignments.empty())
+					rescueMate(reference_index, first_alignments, id_2, pattern_2, second_alignments);
+				else
+					rescueMate(reference_index, second_alignments, id_1, pattern_1, first_alignments);
 
-			for(unsigned i = 1; i < pattern_1.length(); i++) {
-				c = pattern_1.at(i);
-				edit_vector_1.push_back(make_pair(maintainOrder ? 1 : 0,tolower(c)));
+				best = choosePair(first_alignments, second_alignments, max_bits, maintainOrder);
+
+				if(best.first >= 0)
+					rescued++;
 			}
 
-			Alignment new_a_1 = Alignment(id_1, strand, length, chromosome, start, edit_vector_1);
+			if(best.first >= 0) {
+				cached.push_back(first_alignments.at(best.first));
+				cached.push_back(second_alignments.at(best.second));
+			}
+			else {
+				cached.push_back(unaligned_1);
+				cached.push_back(unaligned_2);
+			}
+		}
 
-			out_1 << new_a_1.toString() << endl;
+		if(cached.at(0).getChromosome() == "*")
+			number_of_missing++;
 
+		out_1 << renameAlignment(cached.at(0), id_1).toString() << endl;
+		out_2 << renameAlignment(cached.at(1), id_2).toString() << endl;
+	}
 
-			std::vector<std::pair<int, char> > edit_vector_2;
+	reportAlignmentStats(stats);
+	std::cerr << "Mate rescue: " << rescued << " pairs had the missing mate found near the other one." << std::endl;
 
-			c = pattern_2.at(0);
+	in_reads_1.close();
+	in_reads_2.close();
+	out_1.close();
+	out_2.close();
 
-			edit_vector_2.push_back(make_pair(0, tolower(c)));
+	unlink((temp_file_1 + ".sorted").c_str());
+	unlink((temp_file_2 + ".sorted").c_str());
 
-			for(unsigned i = 1; i < pattern_2.length(); i++) {
-				c = pattern_2.at(i);
-				edit_vector_2.push_back(make_pair(maintainOrder ? 1 : 0,tolower(c)));
-			}
+	unlink(reads_file_1.c_str());
+	unlink(reads_file_2.c_str());
 
-			Alignment new_a_2 = Alignment(id_2, strand, length, chromosome, start, edit_vector_2);
+	if(number_of_missing > (0.5 * total_number))
+		std::cerr << "Warning: more than half the reads failed to align, compression isn't good." << std::endl;
 
-			out_2 << new_a_2.toString() << endl;
+	return true;
+}
 
-			// Scroll the AlignmentReaders to next read if necessary
-			while(!no_more_alignments_1 && (a_1.getName() == id_1))
-				if(!alignment_reader_1->next(a_1))
-					no_more_alignments_1 = true;
+// Copies the lines of the next read from the stream, false at the end of the stream
+static bool copyRead(std::istream& in, std::ostream& out, read_mode_t read_mode, bool& truncated) {
 
-			while(!no_more_alignments_2 && (a_2.getName() == id_2))
-				if(!alignment_reader_2->next(a_2))
-					no_more_alignments_2 = true;
+	unsigned lines = (read_mode == read_mode_fastq ? 4 : 2);
+	std::string row;
+
+	for(unsigned i = 0; i < lines; i++) {
+
+		if(!getline(in, row)) {
+			truncated = truncated || i > 0;
+			return false;
 		}
 
-		else {
+		out << row << '\n';
+	}
 
-			bool found_match = false;
+	return true;
+}
 
-			vector<Alignment> first_alignments;
-			vector<Alignment> second_alignments;
+bool align_single(std::string inputfile, std::string index, std::string outputfile, read_mode_t read_mode, bool maintainOrder) {
 
-			while(!no_more_alignments_1 && (a_1.getName() == id_1)) {
-				first_alignments.push_back(a_1);
-				if(!alignment_reader_1->next(a_1))
-					no_more_alignments_1 = true;
-			}
+	// The file is aligned a chunk at a time like a stream, so that the duplicate cache is bounded however big the file is
+	ifstream in(inputfile.c_str());
+	ofstream out(outputfile.c_str());
 
-			while(!no_more_alignments_2 && (a_2.getName() == id_2)) {
-				second_alignments.push_back(a_2);
-				if(!alignment_reader_2->next(a_2))
-					no_more_alignments_2 = true;
-			}
+	if(!in.is_open() || !out.is_open()) {
+		std::cerr << "Failure to open files." << std::endl;
+		return false;
+	}
 
-			for(unsigned i = 0; i < first_alignments.size(); i++) {
+	StreamAligner aligner(in, NULL, index, read_mode, maintainOrder);
+	Alignment a;
 
-				Alignment candidate_1 = first_alignments.at(i);
+	while(aligner.next(a))
+		out << a.toString() << '\n';
 
-				for(unsigned j = 0; j < second_alignments.size(); j++) {
+	return aligner.good() && out.good();
+}
 
-					Alignment candidate_2 = second_alignments.at(j);
+bool align_pair(std::string inputfile_1, std::string inputfile_2, std::string index, std::string outputfile_1, std::string outputfile_2, read_mode_t read_mode, bool maintainOrder) {
 
-					if((candidate_1.getChromosome() == candidate_2.getChromosome()) && (candidate_2.getStart() > candidate_1.getStart())) {
-						out_1 << candidate_1.toString() << endl;
-						out_2 << candidate_2.toString() << endl;
-						found_match = true;
-					}
-					if(found_match)
-						break;
+	// A chunk at a time like align_single
+	ifstream in_1(inputfile_1.c_str());
+	ifstream in_2(inputfile_2.c_str());
+	ofstream out_1(outputfile_1.c_str());
+	ofstream out_2(outputfile_2.c_str());
 
-				}
-				if(found_match)
-					break;
-			}
+	if(!in_1.is_open() || !in_2.is_open() || !out_1.is_open() || !out_2.is_open()) {
+		std::cerr << "Failure to open files." << std::endl;
+		return false;
+	}
+
+	StreamAligner aligner(in_1, &in_2, index, read_mode, maintainOrder);
+	Alignment a_1, a_2;
+
+	while(aligner.next(a_1, a_2)) {
+		out_1 << a_1.toString() << '\n';
+		out_2 << a_2.toString() << '\n';
+	}
+
+	return aligner.good() && out_1.good() && out_2.good();
+}
+
+std::string temporary_prefix() {
 
-			if(!found_match) {
-				number_of_missing++;
+	static std::atomic<unsigned> files(0);
 
-				// Create insertion alignments for the two
-				char strand = 'F';
-				string chromosome = "*";
-				long start = 0;
-				int length = 0;
+	const char* dir = getenv("TMPDIR");
+	return std::string(dir ? dir : "/tmp") + "/readzip." + std::to_string(getpid()) + "." + std::to_string(files++);
+}
 
-				std::vector<std::pair<int, char> > edit_vector_1;
+bool run_program(const std::vector<std::string>& args, const std::string& output_file) {
 
-				char c = pattern_1.at(0);
+	// The output goes to the file, or to the standard error so that it doesn't mix with readzip's own output
+	int out = output_file.empty() ? fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0)
+		: open(output_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
 
-				edit_vector_1.push_back(make_pair(0, tolower(c)));
+	if(out < 0) {
+		std::cerr << "Failure to open the output of " << args.at(0) << "." << std::endl;
+		return false;
+	}
 
-				for(unsigned i = 1; i < pattern_1.length(); i++) {
-					c = pattern_1.at(i);
-					edit_vector_1.push_back(make_pair(maintainOrder ? 1 : 0,tolower(c)));
-				}
+	// The arguments go to the program as they are, without a shell that would interpret them
+	std::vector<char*> argv;
 
-				Alignment new_a_1 = Alignment(id_1, strand, length, chromosome, start, edit_vector_1);
+	for(unsigned i = 0; i < args.size(); i++)
+		argv.push_back(const_cast<char*>(args[i].c_str()));
+	argv.push_back(NULL);
 
-				out_1 << new_a_1.toString() << endl;
+	pid_t pid = fork();
 
+	if(pid == 0) {
+		dup2(out, STDOUT_FILENO);
+		execvp(argv[0], argv.data());
+		_exit(127);
+	}
 
-				std::vector<std::pair<int, char> > edit_vector_2;
+	close(out);
 
-				c = pattern_2.at(0);
+	if(pid < 0) {
+		std::cerr << "Failure to run " << args.at(0) << "." << std::endl;
+		return false;
+	}
 
-				edit_vector_2.push_back(make_pair(0, tolower(c)));
+	int status;
+
+	while(waitpid(pid, &status, 0) < 0) {
+
+		if(errno != EINTR)
+			return false;
+	}
+
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+StreamAligner::StreamAligner(std::istream& in_1_, std::istream* in_2_, std::string genome_file, read_mode_t read_mode_, bool maintainOrder_)
+	: in_1(&in_1_), in_2(in_2_), genome(genome_file), read_mode(read_mode_), maintainOrder(maintainOrder_), failed(false),
+	reader_1(NULL), reader_2(NULL) {
+
+	prefix = temporary_prefix();
+}
+
+StreamAligner::~StreamAligner() {
+
+	removeChunk();
+}
 
-				for(unsigned i = 1; i < pattern_2.length(); i++) {
-					c = pattern_2.at(i);
-					edit_vector_2.push_back(make_pair(maintainOrder ? 1 : 0,tolower(c)));
-				}
+void StreamAligner::removeChunk() {
 
-				Alignment new_a_2 = Alignment(id_2, strand, length, chromosome, start, edit_vector_2);
+	delete reader_1;
+	delete reader_2;
+	reader_1 = NULL;
+	reader_2 = NULL;
 
-				out_2 << new_a_2.toString() << endl;
+	std::remove((prefix + ".1.tab").c_str());
+	std::remove((prefix + ".2.tab").c_str());
+}
+
+bool StreamAligner::nextChunk() {
+
+	removeChunk();
+
+	if(failed)
+		return false;
+
+	std::string reads_1 = prefix + ".1";
+	std::string reads_2 = prefix + ".2";
+	long reads = 0;
+	bool truncated = false;
+
+	{
+		ofstream out_1(reads_1.c_str());
+		ofstream out_2;
+
+		if(in_2)
+			out_2.open(reads_2.c_str());
+
+		while(reads < STREAM_CHUNK_READS && copyRead(*in_1, out_1, read_mode, truncated)) {
+
+			if(in_2 && !copyRead(*in_2, out_2, read_mode, truncated)) {
+				std::cerr << "The second reads ended before the first, error in syncronizing the reads." << std::endl;
+				failed = true;
+				break;
 			}
+
+			reads++;
+		}
+
+		// With separate streams the second one has to end at the same read
+		if(!failed && in_2 && in_2 != in_1 && reads < STREAM_CHUNK_READS && in_2->peek() != EOF) {
+			std::cerr << "The first reads ended before the second, error in syncronizing the reads." << std::endl;
+			failed = true;
+		}
+
+		if(truncated) {
+			std::cerr << "The input ended in the middle of a read." << std::endl;
+			failed = true;
+		}
+
+		if(!out_1 || (in_2 && !out_2)) {
+			std::cerr << "Failure to write the reads to " << prefix << "." << std::endl;
+			failed = true;
 		}
 	}
 
-	in_reads_1.close();
-	in_reads_2.close();
-	out_1.close();
-	out_2.close();
+	bool aligned = !failed && reads > 0;
 
-	system(("rm " + temp_file_1 + ".sorted").c_str());
-	system(("rm " + temp_file_2 + ".sorted").c_str());
+	if(aligned && in_2)
+		aligned = alignPairChunk(reads_1, reads_2, genome, reads_1 + ".tab", reads_2 + ".tab", read_mode, maintainOrder);
+	else if(aligned)
+		aligned = alignSingleChunk(reads_1, genome, reads_1 + ".tab", read_mode, maintainOrder);
 
-	system(("rm " + inputfile_1 + ".tmp").c_str());
-	system(("rm " + inputfile_2 + ".tmp").c_str());
+	std::remove(reads_1.c_str());
+	std::remove(reads_2.c_str());
 
-	if(number_of_missing > (0.5 * total_number))
-		std::cerr << "Warning: more than half the reads failed to align, compression isn't good." << std::endl;
+	if(!aligned) {
+		failed = failed || reads > 0;
+		return false;
+	}
+
+	reader_1 = new AlignmentReader(AlignmentReader::input_tabdelimited, reads_1 + ".tab");
+
+	if(in_2)
+		reader_2 = new AlignmentReader(AlignmentReader::input_tabdelimited, reads_2 + ".tab");
+
+	return true;
+}
+
+bool StreamAligner::next(Alignment& a) {
+
+	while(!(reader_1 && reader_1->next(a))) {
+
+		if(!nextChunk())
+			return false;
+	}
 
 	return true;
 }
 
-long getRead(bit_file_c& in, const std::string& reference, std::string& out, long prevPos, bool decreasePos)
+bool StreamAligner::next(Alignment& a_1, Alignment& a_2) {
+
+	if(!next(a_1))
+		return false;
+
+	if(!reader_2->next(a_2)) {
+		std::cerr << "Second alignments ended before the first, error in syncronizing the alignments." << std::endl;
+		failed = true;
+		return false;
+	}
+
+	return true;
+}
+
+// Decodes the fields of a read after its start (see writeAlignmentFields) into the read, returns the start or -1 on failure.
+// The strand is read from the record unless it's given (the strand of a second mate), it's stored to strand.
+static long getReadFields(bit_file_c& in, const std::string& reference, std::string& out, long modal, long posField, long* span, char& strand)
 {
-	long posField = readGammaCode(in);
-	if(!in.good())
+	long lengthField = readLength(in, modal);
+	if(strand == 0)
+		strand = in.GetBit() == 1 ? 'R' : 'F';
+	bool reverse = (strand == 'R');
+
+	// Start positions are 1-based, unaligned reads have start 0 and all of the read in the edits
+	if(posField < 0 || (posField > 0 && posField - 1 + lengthField > (long)reference.length()))
 		return -1;
-	if(decreasePos)
-		posField = prevPos - posField;
-	else
-		posField += prevPos;
-	long lengthField = readGammaCode(in);
-	out = reference.substr(posField, lengthField);
-	if(in.GetBit())
-	{
-		complement(out);
-		std::reverse(out.begin(), out.end());
-	}
-	if(posField >= reference.length())
-		std::cerr << posField << " >= " << reference.length() << '\n';
+
+	out = (posField > 0) ? reference.substr(posField - 1, lengthField) : "";
+
+	if(span != NULL)
+		*span = lengthField;
 
 	long edField = readGammaCode(in);
 
@@ -660,8 +1647,135 @@ long getRead(bit_file_c& in, const std::string& reference, std::string& out, lon
 	{
 		std::pair<long, int> edOp = readEditOp(in);
 		lastEditPos += edOp.first;
+
+		// A corrupted record can have edits out of the read
+		if(!editFits(edOp.second, lastEditPos + offset, out))
+			return -1;
+
 		offset += modifyString(edOp.second, out, lastEditPos+offset);
 	}
 
+	if(!in.good())
+		return -1;
+
+	// Edits are given on the forward strand
+	if(reverse)
+	{
+		complement(out);
+		std::reverse(out.begin(), out.end());
+	}
+
 	return posField;
 }
+
+long getRead(bit_file_c& in, const std::string& reference, std::string& out, long modal, long prevPos, long* span, long* repeats, char* strand)
+{
+	long posField = readStartDelta(in, repeats);
+	if(posField < 0)
+		return -1;
+	if(repeats != NULL && *repeats > 0)
+		return prevPos;
+	char coded = 0;
+	long start = getReadFields(in, reference, out, modal, prevPos + posField, span, coded);
+	if(strand != NULL)
+		*strand = coded;
+	return start;
+}
+
+long getMate(bit_file_c& in, const std::string& reference, std::string& out, long modal, long start, char strand, uint32_t insert_size, uint32_t rice,
+	uint32_t orientations, long* span)
+{
+	char mate_strand;
+	long direction, distance = 0;
+	if(!readMateOrientation(in, orientations, strand, start, mate_strand, direction) || (start > 0 && !readMateDistance(in, insert_size, rice, distance)))
+		return -1;
+	return getReadFields(in, reference, out, modal, start + direction * distance, span, mate_strand);
+}
+
+// Decodes the fields of an alignment after its start (see writeAlignmentFields), returns false on failure.
+// The strand is read from the record unless it's given (the strand of a second mate).
+static bool readAlignmentFields(bit_file_c& in, Alignment& a, const std::string& chromosome, long modal, long posField, char strand)
+{
+	long lengthField = readLength(in, modal);
+	if(strand == 0)
+		strand = in.GetBit() == 1 ? 'R' : 'F';
+	long edField = readGammaCode(in);
+
+	if(posField < 0 || !in.good())
+		return false;
+
+	std::vector<std::pair<int, char> > edits;
+	long lastEditPos = 0;
+
+	for(long i = 0; i < edField; ++i)
+	{
+		std::pair<long, int> edOp = readEditOp(in);
+		lastEditPos += edOp.first;
+		char edit = getEditChar(edOp.second);
+		if(edit == 0 || !in.good())
+			return false;
+		edits.push_back(std::make_pair((int)lastEditPos, edit));
+	}
+
+	// Unaligned reads are the ones starting at 0
+	a = Alignment("", strand, lengthField, posField > 0 ? chromosome : "*", posField, edits);
+	return true;
+}
+
+bool readAlignment(bit_file_c& in, Alignment& a, const std::string& chromosome, long modal, long prevPos, long* repeats)
+{
+	long posField = readStartDelta(in, repeats);
+	if(posField < 0)
+		return false;
+	if(repeats != NULL && *repeats > 0)
+		return true;
+	return readAlignmentFields(in, a, chromosome, modal, prevPos + posField, 0);
+}
+
+bool readMate(bit_file_c& in, Alignment& a, const std::string& chromosome, long modal, const Alignment& first, uint32_t insert_size, uint32_t rice,
+	uint32_t orientations)
+{
+	char strand;
+	long direction, distance = 0;
+	return readMateOrientation(in, orientations, first.getStrand(), first.getStart(), strand, direction) &&
+		(first.getStart() == 0 || readMateDistance(in, insert_size, rice, distance)) &&
+		readAlignmentFields(in, a, chromosome, modal, first.getStart() + direction * distance, strand);
+}
+
+bool alignedSequence(const Alignment& a, const std::map<std::string, std::string>& chromosomes, std::string& data)
+{
+	data = "";
+
+	if(a.getChromosome() != "*") {
+
+		std::map<std::string, std::string>::const_iterator it = chromosomes.find(a.getChromosome());
+
+		if(a.getStart() == 0 || it == chromosomes.end() || a.getStart() - 1 + a.getLength() > (long)it->second.length()) {
+			std::cerr << "Failure to decompress position." << std::endl;
+			return false;
+		}
+
+		data = it->second.substr(a.getStart() - 1, a.getLength());
+	}
+
+	// Indels can mess up the indexes. Offset keeps track of them.
+	const std::vector<std::pair<int, char> >& edits = a.getEdits();
+	long offset = 0;
+
+	for(unsigned i = 0; i < edits.size(); i++) {
+
+		if(!editFits(getEditCode(edits[i].second), edits[i].first + offset, data)) {
+			std::cerr << "Failure to decompress edits." << std::endl;
+			return false;
+		}
+
+		offset += modifyString(getEditCode(edits[i].second), data, edits[i].first + offset);
+	}
+
+	if(a.getStrand() == 'R') {
+		revstr(data);
+		complement(data);
+	}
+
+	return true;
+}
@@ -9,11 +9,15 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <mutex>
+#include <stdint.h>
 #include "Alignment.h"
+#include "AlignmentReader.h"
+#include "ReferenceIndex.h"
 
 // Fixed length code (with 4 bits) can be used to display these
 enum edit_codes_t {mismatch_A, mismatch_C, mismatch_G, mismatch_T, mismatch_N, insertion_A, insertion_N, insertion_C, insertion_G, insertion_T, deletion};
-enum read_mode_t {read_mode_undef, read_mode_fasta, read_mode_fastq};
+enum read_mode_t {read_mode_undef, read_mode_fasta, read_mode_fastq, read_mode_sam};
 
 /* Writes gamma code using bitfile. */
 void writeGammaCode(bit_file_c& out, long value);
@@ -21,11 +25,27 @@ void writeGammaCode(bit_file_c& out, long value);
 /* Reads gamma code using bitfile. */
 long readGammaCode(bit_file_c& in);
 
-/* Comparison operator for Alignments based on start positions. */
+/* Most common of the lengths of the reads of a block, 0 if flagging the reads of that length wouldn't take fewer bits
+ * than gamma coding it for them. */
+long modalLength(const std::vector<long>& lengths);
+
+/* Writes the length of a read of a block with the modal length: a set bit for the modal length, otherwise a clear bit
+ * and the gamma code of the length. With modal length 0 the length is only gamma coded. */
+void writeLength(bit_file_c& out, long length, long modal);
+
+/* Reads a length written with writeLength. */
+long readLength(bit_file_c& in, long modal);
+
+/* Comparison operator for Alignments based on chromosomes and start positions, ties broken by the rest of the alignment
+ * so that duplicates sort next to each other. */
 bool startPosComp(const Alignment& a, const Alignment& b);
 
+/* Whether the alignments code the same read at the same place, names aside. */
+bool sameAlignment(const Alignment& a, const Alignment& b);
+bool sameAlignment(const std::pair<Alignment, Alignment>& a, const std::pair<Alignment, Alignment>& b);
+
 /* Reads all alignments from the file to the vector using AlignmentReader. */
-void readAllAlignments(std::vector<Alignment>& alignments, const std::string& infile);
+void readAllAlignments(std::vector<Alignment>& alignments, const std::string& infile, AlignmentReader::input_format_t format = AlignmentReader::input_tabdelimited, const std::string& genomefile = "");
 
 /* Complements the sequence (source: readaligner). */
 void complement(std::string &t);
@@ -36,22 +56,245 @@ void revstr(std::string &t);
 /* Creates codes for the chromosomes in the given genome file. */
 std::map<std::string, int> code_chromosomes(std::string genomefile);
 
+/* Names of the chromosomes indexed by their codes. */
+std::vector<std::string> chromosome_names(const std::map<std::string, int>& codes);
+
+/* Reads the sequences of the chromosomes in the given genome file. */
+std::map<std::string, std::string> read_chromosomes(std::string genomefile);
+
+/* Chromosome codes and sequences of a genome file, loaded once and shared by everything using the genome. */
+class Reference {
+
+public:
+
+	explicit Reference(const std::string& genomefile_);
+
+	inline const std::map<std::string, int>& getCodes() const {
+		return codes;
+	}
+
+	/* Names of the chromosomes indexed by their codes. */
+	inline const std::vector<std::string>& getNames() const {
+		return names;
+	}
+
+	/* Sequences of the chromosomes, read from the genome file on first use. */
+	const std::map<std::string, std::string>& getChromosomes() const;
+
+private:
+
+	std::string genomefile;
+	std::map<std::string, int> codes;
+	std::vector<std::string> names;
+
+	mutable std::once_flag loaded;
+	mutable std::map<std::string, std::string> chromosomes;
+
+};
+
+/* Reference of the genome file, loaded on the first call and kept for the rest of the process. */
+const Reference& load_reference(const std::string& genomefile);
+
+/* Creates an "insertion alignment" that stores the whole sequence of an unaligned read. */
+Alignment unalignedAlignment(const std::string& name, const std::string& sequence);
+
+/* Opens the file, "-" gives the standard input (output) instead. */
+std::istream& open_input(const std::string& file, std::ifstream& stream);
+std::ostream& open_output(const std::string& file, std::ofstream& stream);
+
+/* Converts a BAM file to SAM with samtools. */
+bool bam_to_sam(std::string bamfile, std::string samfile);
+
 std::pair<long, int> readEditOp(bit_file_c& in);
 
 void writeEditOp(bit_file_c& out, long edPos, int edCode);
 
 int getEditCode(char c);
 
+/* Edit of the code, the inverse of getEditCode. Returns 0 for codes that aren't edits. */
+char getEditChar(int edCode);
+
+/* Makes the edit at the index of the string, returns the change in its length. Edits out of the string are left out. */
 long modifyString(int edCode, std::string& str, size_t index);
 
-/* Prepares the reads for compression by aligning them (Single reads) */
+// A read needs PRESCREEN_MIN_HITS k-mers in the reference, plus one for every PRESCREEN_KMERS_PER_HIT k-mers it has,
+// so that false positives of the filter don't let contaminant reads through
+const unsigned PRESCREEN_MIN_HITS = 2;
+const unsigned PRESCREEN_KMERS_PER_HIT = 20;
+
+// Reads with at most this many mismatches to the reference (and no indels) are aligned without the aligner
+const unsigned FAST_PATH_MAX_MISMATCHES = 2;
+
+// Mismatches allowed when looking for a missing mate near the other one
+const unsigned RESCUE_MAX_MISMATCHES = 5;
+
+/* Opens the readzip index (genome file + ".rzi") of the genome, building it first if there isn't one or it's stale. */
+bool open_reference_index(std::string genomefile, ReferenceIndex& index);
+
+/* Returns true if the read has too few k-mers in the reference to align. */
+bool prescreen_fails(const BloomFilter& filter, const std::string& read);
+
+/* Prepares the reads for compression by aligning them (Single reads), a chunk of STREAM_CHUNK_READS reads at a time.
+ * Identical reads of a chunk are aligned once. */
 bool align_single(std::string inputfile, std::string genome_file, std::string outputfile, read_mode_t read_mode, bool maintainOrder = true) ;
 
-/* Prepares the reads for compression by aligning them (Paired reads) */
+// Mates further apart than this are not considered a pair
+const long MAX_INSERT_SIZE = 10000;
+
+/* Number of bits the gamma code of the value takes. */
+long gammaCodeLength(long value);
+
+/* Number of bits the edits of the alignment take when coded with writeEditOp. */
+long editsCodeLength(const Alignment& a);
+
+/* Number of bits writeAlignment takes for the alignment in a block without runs of duplicates. */
+long alignmentCodeLength(const Alignment& a, long prevPos, long modal);
+
+/* Number of bits the mates take in method C (maintainOrder) or D, leaving out the parts that are the same for every pair
+ * and counting the distance of the mates without the insert size of the block.
+ * Returns -1 if the mates can't be coded as a pair. */
+long pairCodeLength(const Alignment& a_1, const Alignment& a_2, bool maintainOrder);
+
+/* Picks the pair of candidate alignments that is cheapest to code, and cheaper than maxBits.
+ * Returns the indexes of the mates or (-1, -1) if there is no such pair. */
+std::pair<int, int> choosePair(const std::vector<Alignment>& first_alignments, const std::vector<Alignment>& second_alignments, long maxBits, bool maintainOrder);
+
+/* Prepares the reads for compression by aligning them (Paired reads), a chunk at a time like align_single. */
 bool align_pair(std::string input1, std::string input2, std::string genome_file, std::string outputfile_1, std::string outputfile_2, read_mode_t read_mode, bool maintainOrder = true);
 
+/* Prefix for the names of temporary files ($TMPDIR or /tmp), different on every call. */
+std::string temporary_prefix();
 
-void writeAlignment(bit_file_c& out, Alignment& a, long prevPos);
+/* Runs the program (searched in PATH unless the name has a slash) with the arguments, without a shell, writing its
+ * standard output to the file or to the standard error if the file is "". Returns true if it exited with status 0. */
+bool run_program(const std::vector<std::string>& args, const std::string& output_file = "");
+
+// Reads aligned at a time when aligning a stream
+const long STREAM_CHUNK_READS = 1000000;
+
+/* Aligns reads coming from a stream (e.g. the standard input) a chunk at a time, so that only one chunk of reads
+ * and alignments is kept on disk at once however long the stream is. For paired reads both streams can be the
+ * same, the mates are then interleaved. */
+class StreamAligner {
+
+public:
+
+	StreamAligner(std::istream& in_1, std::istream* in_2, std::string genome_file, read_mode_t read_mode_, bool maintainOrder_ = true);
+
+	/* Removes the files of the last chunk. */
+	~StreamAligner();
+
+	/* Next alignment of single reads, false at the end of the stream. */
+	bool next(Alignment& a);
+
+	/* Next alignments of the mates of paired reads, false at the end of the streams. */
+	bool next(Alignment& a_1, Alignment& a_2);
+
+	/* False if aligning a chunk failed or the mate streams were of different lengths. */
+	inline bool good() const {
+		return !failed;
+	}
+
+private:
+
+	std::istream* in_1;
+	std::istream* in_2;
+	std::string genome;
+	read_mode_t read_mode;
+	bool maintainOrder;
+	bool failed;
+	std::string prefix;
+	AlignmentReader* reader_1;
+	AlignmentReader* reader_2;
+
+	/* Aligns the next chunk of reads, false if there are none left. */
+	bool nextChunk();
+
+	/* Closes and removes the alignments of the last chunk. */
+	void removeChunk();
+
+};
+
+/* Codes the alignment of a read in a sorted block: the start as a delta from prevPos, the length against the modal
+ * length of the block (see writeLength), the strand and the edits. In a block with runs of duplicates a delta of 0 is
+ * followed by a clear bit, a set one makes it a run. */
+void writeAlignment(bit_file_c& out, const Alignment& a, long prevPos, long modal, bool runs);
+
+/* Codes a run of records repeating the record before them in a sorted block with runs, in place of the first of them. */
+void writeDuplicates(bit_file_c& out, long count);
+
+/* Typical distance between the starts of the mates of the pairs of a block (the median of the distances, ignoring
+ * their direction) and the Rice parameter that codes the distances in the fewest bits with writeMateDistance. */
+void insertSizeModel(std::vector<long> distances, uint32_t& insert_size, uint32_t& rice);
+
+/* Codes the distance from the start of the first mate to the start of the second, ignoring its direction (given by the
+ * orientation of the pair, see writeMateOrientation): the difference of the distance to the insert size of the block
+ * (zigzag mapped, 0, -1, 1... to 0, 1, 2...) as a Rice code with the parameter of the block. Distances whose Rice code
+ * would start with 16 ones or more are coded as 16 ones and the gamma code of the distance. The model is a static code
+ * fitted to each block in place of an adaptive entropy coder, whose state would have to carry over from block to block:
+ * the blocks are decoded on their own, in parallel and from any indexed read. Pairs with the first mate unaligned
+ * (at 0) have both mates at 0 and code no distance. */
+void writeMateDistance(bit_file_c& out, long distance, uint32_t insert_size, uint32_t rice);
+
+/* Decodes a distance written with writeMateDistance (without its direction), returns false on failure. */
+bool readMateDistance(bit_file_c& in, uint32_t insert_size, uint32_t rice, long& distance);
+
+/* Number of bits writeMateDistance takes for the distance. */
+long mateDistanceCodeLength(long distance, uint32_t insert_size, uint32_t rice);
+
+/* Orientation of the second mate of a pair relative to the first: 2 if it's on the same strand as the first, plus 1 if
+ * it starts behind the first along the strand of the first. Pairs of FR libraries are mostly 0, RF 1 and FF 2 or 3. */
+int mateOrientation(const Alignment& a_1, const Alignment& a_2);
+
+/* Orientations of the aligned pairs of a block (see mateOrientation) in the order of how many pairs have them, the most
+ * common first, packed 2 bits each from the lowest ones, and the number of orientations the pairs have less one in bits
+ * 8-9. */
+uint32_t mateOrientationModel(const std::vector<int>& orientations);
+
+/* Codes the orientation of the pair by its rank r in the orientations of the block: r ones and a zero, without the zero
+ * for the last orientation the aligned pairs of the block have. A block of one orientation takes no bits, one of two a
+ * bit per pair. With the strand of the first mate it gives the strand of the second and the direction of their distance.
+ * Pairs with the first mate unaligned aren't in the model and take no bits: both mates are unaligned reads on the
+ * forward strand at 0. The ranks are a static unary code of the orientations of each block by frequency in place of an
+ * adaptive binary coder, so that the blocks can be decoded on their own. */
+void writeMateOrientation(bit_file_c& out, const Alignment& a_1, const Alignment& a_2, uint32_t orientations);
+
+/* Decodes an orientation written with writeMateOrientation against the strand and the start of the first mate into
+ * the strand of the second and the direction of the distance (1 or -1). Returns false on failure. */
+bool readMateOrientation(bit_file_c& in, uint32_t orientations, char strand, long start, char& mate_strand, long& direction);
+
+/* Number of bits writeMateOrientation takes for the pair. */
+long mateOrientationCodeLength(const Alignment& a_1, const Alignment& a_2, uint32_t orientations);
+
+/* Codes the second mate of a pair in a sorted block like writeAlignment, its strand and start relative to the first
+ * mate: the orientation of the pair (see writeMateOrientation) and the distance of the starts (see writeMateDistance). */
+void writeMate(bit_file_c& out, const Alignment& a, const Alignment& first, long modal, uint32_t insert_size, uint32_t rice, uint32_t orientations);
+
+/* Comparison operator for pairs based on the first mates like startPosComp, ties broken by the second mates. */
 bool startPosPairComp(const std::pair<Alignment, Alignment>& a, const std::pair<Alignment, Alignment>& b);
-void readAllPairAlignments(std::vector<std::pair<Alignment, Alignment> >& alignments, const std::string& infile1, const std::string& infile2);
-long getRead(bit_file_c& in, const std::string& reference, std::string& out, long prevPos=0, bool decreasePos=false);
+
+/* Reads the pairs of the two alignment files, or of the one SAM file whose mates are adjacent records (see
+ * AlignmentReader::nextPair). Returns false if the files don't pair up. */
+bool readAllPairAlignments(std::vector<std::pair<Alignment, Alignment> >& alignments, const std::string& infile1, const std::string& infile2,
+	AlignmentReader::input_format_t format = AlignmentReader::input_tabdelimited, const std::string& genomefile = "");
+
+/* Decodes a read written with writeAlignment, returns its start or -1 on failure. The reference span and the strand of
+ * the read are stored to span and strand if given. Repeats is given in blocks with runs of duplicates: a run stores its
+ * number of records to it (0 for a read) and returns prevPos without decoding a read, the caller repeats the previous one. */
+long getRead(bit_file_c& in, const std::string& reference, std::string& out, long modal, long prevPos=0, long* span=NULL, long* repeats=NULL, char* strand=NULL);
+
+/* Decodes a second mate written with writeMate against the start and the strand of the first mate, like getRead. */
+long getMate(bit_file_c& in, const std::string& reference, std::string& out, long modal, long start, char strand, uint32_t insert_size, uint32_t rice,
+	uint32_t orientations, long* span=NULL);
+
+/* Reconstructs the read of the alignment from the chromosome sequences, returns false if it's outside of them. */
+bool alignedSequence(const Alignment& a, const std::map<std::string, std::string>& chromosomes, std::string& data);
+
+/* Decodes the alignment of a read written with writeAlignment without the reference, the name is left empty and the
+ * chromosome is the given one ("*" for unaligned reads). Returns false if the record is truncated or malformed.
+ * Runs of duplicates are returned in repeats like in getRead, a is then left as it is. */
+bool readAlignment(bit_file_c& in, Alignment& a, const std::string& chromosome, long modal, long prevPos=0, long* repeats=NULL);
+
+/* Decodes the alignment of a second mate written with writeMate against the first mate, like readAlignment. */
+bool readMate(bit_file_c& in, Alignment& a, const std::string& chromosome, long modal, const Alignment& first, uint32_t insert_size, uint32_t rice,
+	uint32_t orientations);